@@ -0,0 +1,187 @@
+#include "background.h"
+#include "trace.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && 2 <= _M_IX86_FP)
+#define BLOCK_IDENTIFIER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    int const FRAC_BITS = BackgroundModel::FRAC_BITS;
+    int const STRIPE_ROWS = 64; ///< 並列に処理する行数の単位
+
+#ifdef BLOCK_IDENTIFIER_SSE2
+    /*!
+    5画素の前景の印(5ビット)を、1画素1バイト(0か255)に広げた8バイトを引く表
+    */
+    std::array<uint64_t, 32> const SPREAD = []{
+        std::array<uint64_t, 32> dst;
+        for (int bits = 0; bits < 32; ++bits){
+            dst[bits] = 0;
+            for (int p = 0; p < 5; ++p){
+                if (bits >> p & 1){
+                    dst[bits] |= static_cast<uint64_t>(0xFF) << (8 * p);
+                }
+            }
+        }
+        return dst;
+    }();
+#endif // BLOCK_IDENTIFIER_SSE2
+
+    /*!
+    1行の前景を求め、背景を更新する
+    @param[in] src 画像の行
+    @param[in,out] bg 背景の行
+    @param[in] cols 画素数
+    @param[in] threshold 閾値
+    @param[in] shift 背景の画素の更新の速さ
+    @param[in] foreground_shift 前景の画素の更新の速さ
+    @param[out] fg 前景の行
+    */
+    void subtractRow(uchar const * src, ushort * bg, int cols, int threshold, int shift, int foreground_shift, uchar * fg)
+    {
+        int x = 0;
+#ifdef BLOCK_IDENTIFIER_SSE2
+        // 16バイトずつ読み、画素の境界がずれないよう15バイト(5画素)ずつ進む
+        // 背景も画像も15ビットに収まるので、差は16ビットの符号付き整数で求められる
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const th = _mm_set1_epi8(static_cast<char>(threshold));
+        __m128i const count = _mm_cvtsi32_si128(shift);
+        __m128i const foreground_count = _mm_cvtsi32_si128(foreground_shift);
+        // 画素の先頭のバイトと、5画素分のバイト
+        __m128i const first = _mm_setr_epi8(-1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, 0);
+        __m128i const used = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0);
+        __m128i b0 = zero;
+        __m128i b1 = zero;
+        if (8 <= cols){
+            b0 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(bg));
+            b1 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(bg + 8));
+        }
+        // 前景は8バイトずつ書くので、8画素分の余裕があるところまで
+        for (; x + 8 <= cols; x += 5){
+            int const i = 3 * x;
+            __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+            __m128i const b = _mm_packus_epi16(_mm_srli_epi16(b0, FRAC_BITS), _mm_srli_epi16(b1, FRAC_BITS));
+            __m128i const d = _mm_or_si128(_mm_subs_epu8(v, b), _mm_subs_epu8(b, v));
+            // 閾値を超えた成分を画素の先頭に集め、画素の3バイトに広げる
+            __m128i const over = _mm_subs_epu8(d, th);
+            __m128i const pixel = _mm_and_si128(_mm_or_si128(over, _mm_or_si128(_mm_srli_si128(over, 1), _mm_srli_si128(over, 2))), first);
+            __m128i const spread = _mm_or_si128(pixel, _mm_or_si128(_mm_slli_si128(pixel, 1), _mm_slli_si128(pixel, 2)));
+            __m128i const is_bg = _mm_cmpeq_epi8(spread, zero);
+            __m128i const update = _mm_and_si128(is_bg, used);
+            __m128i const absorb = _mm_andnot_si128(is_bg, used);
+            __m128i const x0 = _mm_slli_epi16(_mm_unpacklo_epi8(v, zero), FRAC_BITS);
+            __m128i const x1 = _mm_slli_epi16(_mm_unpackhi_epi8(v, zero), FRAC_BITS);
+            __m128i const d0 = _mm_sub_epi16(x0, b0);
+            __m128i const d1 = _mm_sub_epi16(x1, b1);
+            __m128i const u0 = _mm_add_epi16(b0, _mm_or_si128(
+                _mm_and_si128(_mm_unpacklo_epi8(update, update), _mm_sra_epi16(d0, count)),
+                _mm_and_si128(_mm_unpacklo_epi8(absorb, absorb), _mm_sra_epi16(d0, foreground_count))));
+            __m128i const u1 = _mm_add_epi16(b1, _mm_or_si128(
+                _mm_and_si128(_mm_unpackhi_epi8(update, update), _mm_sra_epi16(d1, count)),
+                _mm_and_si128(_mm_unpackhi_epi8(absorb, absorb), _mm_sra_epi16(d1, foreground_count))));
+            // 16バイト目は次の画素なので変えずに書き戻す
+            // 書き戻した直後に重ねて読むとストアフォワーディングが効かず遅いので、次の5画素の背景を先に読む
+            if (x + 13 <= cols){
+                b0 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(bg + i + 15));
+                b1 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(bg + i + 23));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(bg + i), u0);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(bg + i + 8), u1);
+            int const m = ~_mm_movemask_epi8(_mm_cmpeq_epi8(pixel, zero));
+            std::memcpy(fg + x, &SPREAD[(m & 1) | (m >> 2 & 2) | (m >> 4 & 4) | (m >> 6 & 8) | (m >> 8 & 16)], 8);
+        }
+#endif // BLOCK_IDENTIFIER_SSE2
+        for (; x < cols; ++x){
+            auto const s = src + 3 * x;
+            auto const b = bg + 3 * x;
+            bool const over =
+                threshold < std::abs(s[0] - (b[0] >> FRAC_BITS)) ||
+                threshold < std::abs(s[1] - (b[1] >> FRAC_BITS)) ||
+                threshold < std::abs(s[2] - (b[2] >> FRAC_BITS));
+            fg[x] = over ? 255 : 0;
+            int const n = over ? foreground_shift : shift;
+            for (int c = 0; c < 3; ++c){
+                b[c] = static_cast<ushort>(b[c] + (((s[c] << FRAC_BITS) - b[c]) >> n));
+            }
+        }
+    }
+
+    /*!
+    行の範囲ごとにsubtractRowを呼ぶ
+    */
+    class SubtractBody : public cv::ParallelLoopBody
+    {
+        cv::Mat const & image_;
+        cv::Mat & background_;
+        int const threshold_;
+        int const shift_;
+        int const foreground_shift_;
+        cv::Mat & foreground_;
+    public:
+        SubtractBody(cv::Mat const & image, cv::Mat & background, int threshold, int shift, int foreground_shift, cv::Mat & foreground)
+            : image_(image)
+            , background_(background)
+            , threshold_(threshold)
+            , shift_(shift)
+            , foreground_shift_(foreground_shift)
+            , foreground_(foreground)
+        {
+        }
+        void operator()(cv::Range const & range) const
+        {
+            for (int y = range.start; y < range.end; ++y){
+                subtractRow(image_.ptr<uchar>(y), background_.ptr<ushort>(y), image_.cols, threshold_, shift_, foreground_shift_, foreground_.ptr<uchar>(y));
+            }
+        }
+    };
+}
+
+void subtractBackground(cv::Mat const & image, cv::Mat & background, int threshold, int shift, int foreground_shift, cv::Mat & foreground)
+{
+    CV_Assert(image.type() == CV_8UC3 && background.type() == CV_16UC3 && image.size() == background.size());
+    foreground.create(image.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, image.rows), SubtractBody(image, background, threshold, shift, foreground_shift, foreground), std::max(1, image.rows / STRIPE_ROWS));
+}
+
+BackgroundModel::BackgroundModel()
+    : learned_(0)
+{
+}
+
+bool BackgroundModel::apply(cv::Mat const & image, int threshold, cv::Mat & foreground)
+{
+    TRACE_SCOPE("background");
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (background_.size() != image.size()){
+        // 最初のフレームか、画像の大きさが変わった
+        image.convertTo(background_, CV_16UC3, 1 << FRAC_BITS);
+        learned_ = 1;
+        return false;
+    }
+    if (learned_ < LEARN_FRAMES){
+        subtractBackground(image, background_, 255, LEARN_SHIFT, LEARN_SHIFT, foreground);
+        ++learned_;
+        return false;
+    }
+    subtractBackground(image, background_, threshold, UPDATE_SHIFT, FOREGROUND_SHIFT, foreground);
+    if (image.rows * image.cols < cv::countNonZero(foreground) * 2){
+        // 照明が急に変わったとみなし、このフレームから覚え直す
+        image.convertTo(background_, CV_16UC3, 1 << FRAC_BITS);
+        learned_ = 1;
+        return false;
+    }
+    return true;
+}
+
+void BackgroundModel::reset()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    background_.release();
+    learned_ = 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <mutex>
+
+/*!
+背景との差分を求め、背景を更新する
+各画素のチャンネルごとの差の絶対値の最大がthresholdを超えたら前景とし、背景の画素は(画像 - 背景) / 2^shift、前景の画素は(画像 - 背景) / 2^foreground_shiftだけ画像に近づける
+差分、閾値、更新を1回の走査でまとめて行い、SSE2が使えるときは5画素ずつ処理する。行の範囲ごとに並列に処理する
+@param[in] image カメラ画像(CV_8UC3)
+@param[in,out] background 背景(CV_16UC3)。各チャンネルをBackgroundModel::FRAC_BITSビットの固定小数点で持つ
+@param[in] threshold 前景とする差の閾値(0から255)。255なら全て背景とする
+@param[in] shift 背景の画素を更新する速さ(1 / 2^shift)
+@param[in] foreground_shift 前景の画素を更新する速さ(1 / 2^foreground_shift)
+@param[out] foreground 前景を255、背景を0とした画像(CV_8UC1)
+*/
+void subtractBackground(cv::Mat const & image, cv::Mat & background, int threshold, int shift, int foreground_shift, cv::Mat & foreground);
+
+/*!
+背景モデル
+カメラを固定し、ブロックを置く前の画像を背景として覚えて、背景との差分でブロックの領域を求める
+HLSへの変換より軽く、照明がゆっくり変わっても背景が追従するので閾値を調整し直さなくてよい
+前景の画素はごくゆっくり更新するので、置いたブロックはしばらく前景のままで、
+背景を覚える間に置いてあって取り除いたブロックの跡やコップのように、置いたままのものはやがて背景に溶け込む
+照明が急に変わって画像の半分以上が前景になったら、背景を覚え直す
+並列に認識するフレームから同時に呼んでよい
+*/
+class BackgroundModel
+{
+    BackgroundModel & operator=(BackgroundModel const &) = delete;
+    BackgroundModel(BackgroundModel const &) = delete;
+public:
+    static int const FRAC_BITS = 7; ///< 背景の固定小数点の小数部のビット数
+    static int const LEARN_FRAMES = 16; ///< 背景を覚えるフレーム数
+    static int const LEARN_SHIFT = 2; ///< 背景を覚えている間の更新の速さ
+    static int const UPDATE_SHIFT = 5; ///< 背景を覚えた後の更新の速さ
+    static int const FOREGROUND_SHIFT = 10; ///< 前景の画素の更新の速さ。差が100なら30fpsで40秒ほどで閾値25を下回る
+private:
+    std::mutex mutex_;
+    cv::Mat background_; ///< mutex_で保護する
+    int learned_; ///< 背景を覚えたフレーム数。mutex_で保護する
+public:
+    BackgroundModel();
+    /*!
+    前景を求め、背景を更新する
+    画像の大きさが変わったら背景を覚え直す
+    @param[in] image カメラ画像(preprocessImageの後)
+    @param[in] threshold 前景とする差の閾値
+    @param[out] foreground 前景を255、背景を0とした画像
+    @return 背景を覚え終えていればtrue。falseなら背景を覚えている途中で、foregroundは使えない
+    */
+    bool apply(cv::Mat const & image, int threshold, cv::Mat & foreground);
+    /*!
+    背景を捨て、次のフレームから覚え直す
+    */
+    void reset();
+};
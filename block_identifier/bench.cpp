@@ -0,0 +1,1211 @@
+#include "bench.h"
+#include "trigger.h"
+#include "trace.h"
+#include "scene.h"
+#include "identify.h"
+#include "segment.h"
+#include "background.h"
+#include "pipeline.h"
+#include "classify.h"
+#include "metrics.h"
+#include "preview.h"
+#include "governor.h"
+#include "log.h"
+#include "sender.h"
+#include "thread_policy.h"
+#include "memory_budget.h"
+#include <boost/format.hpp>
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#if !(defined _WIN32 || defined _WIN64)
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif // !(defined _WIN32 || defined _WIN64)
+
+namespace {
+    typedef std::chrono::steady_clock clock_type;
+
+    /*!
+    計測値を表示する
+    @param[in] name 計測名
+    @param[in] samples 計測値(マイクロ秒)
+    */
+    void printLatency(std::string const & name, std::vector<double> samples)
+    {
+        if (samples.empty()){
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (auto v : samples){
+            sum += v;
+        }
+        auto percentile = [&samples](double p){
+            return samples[std::min(samples.size() - 1, static_cast<size_t>(samples.size() * p))];
+        };
+        std::cout << boost::format("%-20s : n=%d mean=%.1fus p50=%.1fus p99=%.1fus max=%.1fus")
+            % name % samples.size() % (sum / samples.size()) % percentile(0.5) % percentile(0.99) % samples.back()
+            << std::endl;
+    }
+
+    /*!
+    トレースの区間1つあたりのコストを、記録しないときとするときで計測する
+    @return Exit code
+    */
+    int benchTrace()
+    {
+        int const count = 10000000;
+        auto measure = [count](bool on){
+            Trace::enable(on);
+            volatile int sink = 0;
+            auto const t0 = clock_type::now();
+            for (int i = 0; i < count; ++i){
+                TRACE_SCOPE("bench");
+                sink = sink + 1;
+            }
+            auto const t1 = clock_type::now();
+            return std::chrono::duration<double, std::nano>(t1 - t0).count() / count;
+        };
+        auto const base = [count]{
+            volatile int sink = 0;
+            auto const t0 = clock_type::now();
+            for (int i = 0; i < count; ++i){
+                sink = sink + 1;
+            }
+            return std::chrono::duration<double, std::nano>(clock_type::now() - t0).count() / count;
+        }();
+        auto const off = measure(false);
+        auto const on = measure(true);
+        Trace::enable(false);
+        std::cout << boost::format("%-20s : %.2fns/scope") % "trace off" % (off - base) << std::endl;
+        std::cout << boost::format("%-20s : %.2fns/scope") % "trace on" % (on - base) << std::endl;
+        // 1フレームあたり10区間として、30fps(33ms)に対する割合
+        std::cout << boost::format("%-20s : %.5f%% of 33ms frame (10 scopes)") % "trace off overhead" % (100 * 10 * (off - base) / 33e6) << std::endl;
+        return 0;
+    }
+
+#if !(defined _WIN32 || defined _WIN64)
+    /*!
+    疑似端末をArduinoボタンの代わりにして、ボタンを押してから
+    トリガーのハンドラが呼ばれるまでの遅延と、待機中のCPU使用率を計測する
+    @return Exit code
+    */
+    int benchButton()
+    {
+        size_t const count = 100;
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0){
+            std::cerr << "failed to open pseudo terminal." << std::endl;
+            return -1;
+        }
+        std::string const slave = ptsname(master);
+        // 0D0Aが一緒に届く場合、別々に届く場合、前の改行が後から届く場合
+        std::vector<std::vector<std::string>> const framings = {
+            { "0\r\n" },
+            { "0", "\r", "\n" },
+            { "\r\n0" },
+        };
+        std::mutex mutex;
+        std::vector<clock_type::time_point> pushed;
+        std::vector<double> latency;
+        boost::asio::io_service io_service;
+        TriggerConfig config = { 0, slave, 0, 0, 0 };
+        TriggerLoop loop(io_service, config, [&]{
+            auto const fired = clock_type::now();
+            std::unique_lock<std::mutex> lock(mutex);
+            latency.push_back(std::chrono::duration<double, std::micro>(fired - pushed.at(latency.size())).count());
+            if (latency.size() == count){
+                io_service.stop();
+            }
+        });
+        loop.start();
+        std::thread arduino([&]{
+            for (size_t i = 0; i < count; ++i){
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                for (auto const & chunk : framings[i % framings.size()]){
+                    if (chunk.find('0') != std::string::npos){
+                        std::unique_lock<std::mutex> lock(mutex);
+                        pushed.push_back(clock_type::now());
+                    }
+                    if (write(master, chunk.data(), chunk.size()) != static_cast<ssize_t>(chunk.size())){
+                        std::cerr << "failed to write pseudo terminal." << std::endl;
+                    }
+                }
+            }
+        });
+        auto const wall0 = clock_type::now();
+        auto const cpu0 = std::clock();
+        io_service.run();
+        arduino.join();
+        auto const cpu = static_cast<double>(std::clock() - cpu0) / CLOCKS_PER_SEC;
+        auto const wall = std::chrono::duration<double>(clock_type::now() - wall0).count();
+        close(master);
+        printLatency("button latency", latency);
+        std::cout << boost::format("%-20s : %.1f%% (%.3fs / %.3fs)") % "cpu usage" % (100 * cpu / wall) % cpu % wall << std::endl;
+        return 0;
+    }
+#endif // !(defined _WIN32 || defined _WIN64)
+
+    /*!
+    テスト画像を作る速さを、スレッド数を変えて計測する
+    あわせて、ブロック認識の速さと正解と一致した割合を表示する
+    @return Exit code
+    */
+    int benchScene(Option const & opt)
+    {
+        SceneParams params;
+        params.stacks = 2;
+        params.gradient = 0.3;
+        params.noise = 8;
+        params.blur = 3;
+        params.angle = 3;
+        SceneGenerator const generator(opt, params, 1);
+        size_t const count = 2000;
+        unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned threads = 1; ; threads = std::min(threads * 2, cores)){
+            auto const begin = clock_type::now();
+            generator.generate(0, count, threads);
+            double const sec = std::chrono::duration<double>(clock_type::now() - begin).count();
+            std::cout << boost::format("%-20s : threads=%d %.0f frames/s") % "generate" % threads % (count / sec) << std::endl;
+            if (threads == cores){
+                break;
+            }
+        }
+
+        SceneParams single;
+        single.gradient = 0.3;
+        single.noise = 8;
+        auto const scenes = SceneGenerator(opt, single, 2).generate(0, 500, cores);
+        size_t matched = 0;
+        auto const begin = clock_type::now();
+        for (auto const & scene : scenes){
+            std::vector<BlockInfo> blockInfo;
+            identifyBlock(scene.image, opt, blockInfo, FrameStamp(), false);
+            auto const & expected = scene.stacks.front();
+            matched += blockInfo.size() == expected.size() && std::equal(expected.begin(), expected.end(), blockInfo.begin(), [](Block const & e, BlockInfo const & a){
+                return e.color == a.color.name && e.width == a.width;
+            });
+        }
+        double const sec = std::chrono::duration<double>(clock_type::now() - begin).count();
+        std::cout << boost::format("%-20s : threads=1 %.0f frames/s, %d/%d frames matched") % "identify" % (scenes.size() / sec) % matched % scenes.size() << std::endl;
+        return 0;
+    }
+
+    /*!
+    高解像度の画像でブロック領域の抽出にかかる時間を、並列数を変えて計測する
+    @return Exit code
+    */
+    int benchSegment(Option const & opt)
+    {
+        unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+        int const iterations = 20;
+        struct Resolution { char const * name; int width; int height; };
+        for (auto const & r : { Resolution{ "1080p", 1920, 1080 }, Resolution{ "4K", 3840, 2160 } }){
+            Option o = opt;
+            double const scale = static_cast<double>(r.height) / (o.tune.camera_height * o.tune.camera_ratio);
+            o.tune.camera_width = r.width;
+            o.tune.camera_height = r.height;
+            o.tune.camera_ratio = 1.0;
+            o.tune.block_height = static_cast<int>(o.tune.block_height * opt.tune.camera_ratio * scale);
+            o.tune.block_width = static_cast<int>(o.tune.block_width * opt.tune.camera_ratio * scale);
+            auto const image = SceneGenerator(o, SceneParams(), 3).generate(0).image;
+            double base = 0;
+            for (unsigned threads = 1; ; threads = std::min(threads * 2, cores)){
+                cv::setNumThreads(threads);
+                auto const begin = clock_type::now();
+                for (int i = 0; i < iterations; ++i){
+                    segmentBlocks(image, o.tune.bin_th);
+                }
+                double const ms = std::chrono::duration<double, std::milli>(clock_type::now() - begin).count() / iterations;
+                if (threads == 1){
+                    base = ms;
+                }
+                std::cout << boost::format("%-20s : threads=%d %.2fms x%.2f") % (std::string("segment ") + r.name) % threads % ms % (base / ms) << std::endl;
+                if (threads == cores){
+                    break;
+                }
+            }
+            // 縮小した画像で探すときの抽出と境界の調整を含めた認識全体の時間
+            for (int pyramid : { 1, 2, 4, 8 }){
+                o.tune.pyramid = pyramid;
+                std::vector<BlockInfo> blockInfo;
+                auto const begin = clock_type::now();
+                for (int i = 0; i < iterations; ++i){
+                    identifyBlock(image, o, blockInfo, FrameStamp(), false);
+                }
+                double const ms = std::chrono::duration<double, std::milli>(clock_type::now() - begin).count() / iterations;
+                std::cout << boost::format("%-20s : pyramid=%d %.2fms %d blocks") % (std::string("identify ") + r.name) % pyramid % ms % blockInfo.size() << std::endl;
+            }
+        }
+        cv::setNumThreads(-1);
+        return 0;
+    }
+
+    /*!
+    ノイズなどを加えずに作ったテスト画像から、ブロックの領域を求める
+    @param[in] image テスト画像
+    @param[in] empty 同じ作り方でブロックを置かずに作った画像
+    @return ブロックの領域を255、それ以外を0とした画像
+    */
+    cv::Mat blockMask(cv::Mat const & image, cv::Mat const & empty)
+    {
+        cv::Mat diff;
+        cv::absdiff(image, empty, diff);
+        std::vector<cv::Mat> channels;
+        cv::split(diff, channels);
+        cv::Mat dst;
+        cv::max(channels[0], channels[1], dst);
+        cv::max(dst, channels[2], dst);
+        return dst > 0;
+    }
+
+    /*!
+    固定したカメラで照明の明るさがゆっくり変わるときに、HLSの2値化と背景差分を比べる
+    1フレームの2値化の時間、正解の領域との一致度(IoU)、認識結果が正解と一致したフレーム数を表示する
+    背景を覚える間に置いてあったブロックの跡が溶け込むまでと、置いたブロックが前景のままでいる間のフレーム数も表示する
+    @return Exit code。跡が溶け込まないか、置いたブロックがすぐに溶け込んだら1
+    */
+    int benchBackground(Option const & opt)
+    {
+        int const learn = BackgroundModel::LEARN_FRAMES;
+        int const frames = 400;
+        SceneParams params;
+        params.salt = 0;
+        auto const scene = SceneGenerator(opt, params, 7).generate(0);
+        params.stacks = 0;
+        // 机の模様の上にブロックを置いた画像を作る
+        cv::Mat const truth = blockMask(scene.image, SceneGenerator(opt, params, 7).generate(0).image);
+        cv::Mat table(scene.image.size(), CV_8UC3);
+        cv::randn(table, cv::Scalar(50, 55, 60), cv::Scalar::all(6));
+        cv::GaussianBlur(table, table, cv::Size(5, 5), 0);
+        cv::Mat stacked = table.clone();
+        scene.image.copyTo(stacked, truth);
+        // 最初はブロックを置かず、その後は明るさを0.7倍から1.3倍まで変える
+        cv::RNG rng(7);
+        std::vector<cv::Mat> images;
+        for (int i = 0; i < learn + frames; ++i){
+            double const gain = i < learn ? 1.0 : 1 + 0.3 * std::sin(2 * CV_PI * (i - learn) / 200);
+            cv::Mat noise(table.size(), CV_16SC3);
+            rng.fill(noise, cv::RNG::NORMAL, 0, 4);
+            cv::Mat tmp;
+            (i < learn ? table : stacked).convertTo(tmp, CV_16SC3, gain);
+            cv::add(tmp, noise, tmp);
+            images.emplace_back();
+            tmp.convertTo(images.back(), CV_8UC3);
+        }
+        auto const & expected = scene.stacks.front();
+        for (int segmentation : { SEGMENT_HLS, SEGMENT_BACKGROUND }){
+            Option o = opt;
+            o.tune.segmentation = segmentation;
+            BackgroundModel model;
+            cv::Mat bin(table.size(), CV_8UC1);
+            cv::Mat both;
+            cv::Mat either;
+            clock_type::duration elapsed(0);
+            double sum = 0;
+            double worst = 1;
+            for (int i = 0; i < learn + frames; ++i){
+                auto const begin = clock_type::now();
+                bool ready = true;
+                if (segmentation == SEGMENT_HLS){
+                    binarizeBlocks(images[i], o.tune.bin_th, bin);
+                }
+                else{
+                    ready = model.apply(images[i], o.tune.background_th, bin);
+                }
+                if (i < learn){
+                    continue;
+                }
+                elapsed += clock_type::now() - begin;
+                double iou = 0;
+                if (ready){
+                    cv::bitwise_and(bin, truth, both);
+                    cv::bitwise_or(bin, truth, either);
+                    iou = static_cast<double>(cv::countNonZero(both)) / std::max(1, cv::countNonZero(either));
+                }
+                sum += iou;
+                worst = std::min(worst, iou);
+            }
+            IdentifyState state;
+            int matched = 0;
+            for (int i = 0; i < learn + frames; ++i){
+                std::vector<BlockInfo> blockInfo;
+                identifyBlock(images[i], o, blockInfo, FrameStamp(), false, &state);
+                matched += learn <= i && blockInfo.size() == expected.size() && std::equal(expected.begin(), expected.end(), blockInfo.begin(), [](Block const & e, BlockInfo const & a){
+                    return e.color == a.color.name && e.width == a.width;
+                });
+            }
+            std::cout << boost::format("%-20s : %.2fms/frame, IoU mean=%.3f min=%.3f, %d/%d frames matched")
+                % (segmentation == SEGMENT_HLS ? "hls" : "background")
+                % (std::chrono::duration<double, std::milli>(elapsed).count() / frames) % (sum / frames) % worst % matched % frames << std::endl;
+        }
+        // 背景を覚える間に置いてあったブロックを取り除き、跡が背景に溶け込むまでのフレーム数を数える
+        // 続けてブロックを置き直し、前景のままでいるフレーム数を数える
+        int const limit = 3000;
+        int const min_kept = 300; ///< ボタンを押すまで置いておく間(30fpsで10秒)は前景のままにする
+        std::vector<cv::Mat> tables;
+        std::vector<cv::Mat> stacks;
+        for (int i = 0; i < 16; ++i){
+            cv::Mat noise(table.size(), CV_16SC3);
+            rng.fill(noise, cv::RNG::NORMAL, 0, 4);
+            for (auto * dst : { &tables, &stacks }){
+                cv::Mat tmp;
+                (dst == &tables ? table : stacked).convertTo(tmp, CV_16SC3);
+                cv::add(tmp, noise, tmp);
+                dst->emplace_back();
+                tmp.convertTo(dst->back(), CV_8UC3);
+            }
+        }
+        int const truth_pixels = std::max(1, cv::countNonZero(truth));
+        BackgroundModel model;
+        cv::Mat bin;
+        cv::Mat both;
+        auto covered = [&]{
+            cv::bitwise_and(bin, truth, both);
+            return static_cast<double>(cv::countNonZero(both)) / truth_pixels;
+        };
+        for (int i = 0; i < learn; ++i){
+            model.apply(stacks[i % stacks.size()], opt.tune.background_th, bin);
+        }
+        int absorbed = -1;
+        for (int i = 0; i < limit && absorbed < 0; ++i){
+            if (model.apply(tables[i % tables.size()], opt.tune.background_th, bin) && covered() < 0.01){
+                absorbed = i + 1;
+            }
+        }
+        // 机に近い色の画素は置いたときから背景なので、置いた直後の割合と比べる
+        int kept = limit;
+        double placed = 0;
+        for (int i = 0; i < limit && kept == limit; ++i){
+            bool const ready = model.apply(stacks[i % stacks.size()], opt.tune.background_th, bin);
+            if (i == 0){
+                placed = covered();
+            }
+            if (!ready || covered() < placed * 0.9){
+                kept = i;
+            }
+        }
+        if (absorbed < 0){
+            std::cout << boost::format("%-20s : not absorbed in %d frames") % "removed stack" % limit << std::endl;
+        }
+        else{
+            std::cout << boost::format("%-20s : absorbed after %d frames (%.0fs at 30fps)") % "removed stack" % absorbed % (absorbed / 30.0) << std::endl;
+        }
+        std::cout << boost::format("%-20s : foreground for %d frames (%.0fs at 30fps)") % "placed stack" % kept % (kept / 30.0) << std::endl;
+        return absorbed < 0 || kept < min_kept ? 1 : 0;
+    }
+
+    /*!
+    bin_thを自動で決めるときの2値化の時間と、カメラの明るさが変わるときの正解率を比べる
+    ヒストグラムは2値化と同じ走査で数えるので、時間がほとんど変わらないことを確かめる
+    @return Exit code
+    */
+    int benchThreshold(Option const & opt)
+    {
+        int const iterations = 200;
+        int const frames = 400;
+        unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+        SceneParams params;
+        params.salt = 0;
+        auto scenes = SceneGenerator(opt, params, 11).generate(0, frames, cores);
+        params.stacks = 0;
+        auto const empty = SceneGenerator(opt, params, 11).generate(0).image;
+        auto const & image = scenes.front().image;
+        cv::Mat bin(image.size(), CV_8UC1);
+        for (int histogram = 0; histogram < 2; ++histogram){
+            Histogram h = {};
+            auto const begin = clock_type::now();
+            for (int i = 0; i < iterations; ++i){
+                if (histogram){
+                    binarizeBlocks(image, opt.tune.bin_th, bin, h);
+                }
+                else{
+                    binarizeBlocks(image, opt.tune.bin_th, bin);
+                }
+            }
+            double const ms = std::chrono::duration<double, std::milli>(clock_type::now() - begin).count() / iterations;
+            std::cout << boost::format("%-20s : %.3fms/frame") % (histogram ? "binarize+histogram" : "binarize") % ms << std::endl;
+        }
+        // 明るい机の上に置き、カメラの明るさを0.8倍から1.5倍までゆっくり変える
+        cv::RNG rng(11);
+        for (size_t i = 0; i < scenes.size(); ++i){
+            auto & m = scenes[i].image;
+            cv::Mat table(m.size(), CV_8UC3, cv::Scalar::all(120));
+            m.copyTo(table, blockMask(m, empty));
+            double const gain = 1.15 + 0.35 * std::sin(2 * CV_PI * i / 200);
+            cv::Mat noise(m.size(), CV_16SC3);
+            rng.fill(noise, cv::RNG::NORMAL, 0, 4);
+            cv::Mat tmp;
+            table.convertTo(tmp, CV_16SC3, gain);
+            cv::add(tmp, noise, tmp);
+            tmp.convertTo(m, CV_8UC3);
+        }
+        for (int automatic = 0; automatic < 2; ++automatic){
+            Option o = opt;
+            o.tune.auto_bin_th = automatic;
+            IdentifyState state;
+            int matched = 0;
+            int low = 255;
+            int high = 0;
+            for (auto const & scene : scenes){
+                std::vector<BlockInfo> blockInfo;
+                identifyBlock(scene.image, o, blockInfo, FrameStamp(), false, &state);
+                auto const & expected = scene.stacks.front();
+                matched += blockInfo.size() == expected.size() && std::equal(expected.begin(), expected.end(), blockInfo.begin(), [](Block const & e, BlockInfo const & a){
+                    return e.color == a.color.name && e.width == a.width;
+                });
+                int const th = automatic ? state.threshold.get(o.tune.bin_th) : o.tune.bin_th;
+                low = std::min(low, th);
+                high = std::max(high, th);
+            }
+            std::cout << boost::format("%-20s : bin_th=%d-%d, %d/%d frames matched") % (automatic ? "auto" : "fixed") % low % high % matched % frames << std::endl;
+        }
+        return 0;
+    }
+
+    /*!
+    色判定領域の大きさを変えて、平均色で判定するときと画素ごとの多数決で判定するときの
+    1ブロックあたりの時間と正解と一致した割合を計測する
+    @return Exit code
+    */
+    int benchColor(Option const & opt)
+    {
+        unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+        SceneParams params;
+        params.gradient = 0.3;
+        params.noise = 12;
+        params.salt = 0.1;
+        auto const scenes = SceneGenerator(opt, params, 5).generate(0, 300, cores);
+        for (double ratio : { 0.2, 0.4, 0.6 }){
+            Option o = opt;
+            o.tune.color_ratio = ratio;
+            size_t blocks = 0;
+            size_t mean_ok = 0;
+            size_t vote_ok = 0;
+            double confidence = 0;
+            clock_type::duration mean_time(0);
+            clock_type::duration vote_time(0);
+            for (auto const & scene : scenes){
+                std::vector<BlockInfo> blockInfo;
+                identifyBlock(scene.image, o, blockInfo, FrameStamp(), false);
+                auto const & expected = scene.stacks.front();
+                if (blockInfo.size() != expected.size()){
+                    continue;
+                }
+                for (size_t i = 0; i < blockInfo.size(); ++i){
+                    cv::Mat const area = scene.image(blockInfo[i].color_area);
+                    auto const t0 = clock_type::now();
+                    auto const ave = cv::mean(area);
+                    int const mean = nearestColor(cv::Vec3b(cv::saturate_cast<uchar>(ave[0]), cv::saturate_cast<uchar>(ave[1]), cv::saturate_cast<uchar>(ave[2])), o.table);
+                    auto const t1 = clock_type::now();
+                    auto const vote = voteColor(area, o.table);
+                    auto const t2 = clock_type::now();
+                    mean_time += t1 - t0;
+                    vote_time += t2 - t1;
+                    mean_ok += o.colors[mean].name == expected[i].color;
+                    vote_ok += o.colors[vote.index].name == expected[i].color;
+                    confidence += vote.confidence;
+                    ++blocks;
+                }
+            }
+            if (blocks == 0){
+                continue;
+            }
+            auto us = [blocks](clock_type::duration d){ return std::chrono::duration<double, std::micro>(d).count() / blocks; };
+            std::cout << boost::format("%-20s : ratio=%.1f mean %.2fus %.1f%%, vote %.2fus %.1f%% (confidence %.2f), %d blocks")
+                % "color" % ratio % us(mean_time) % (100.0 * mean_ok / blocks) % us(vote_time) % (100.0 * vote_ok / blocks) % (confidence / blocks) % blocks << std::endl;
+        }
+        return 0;
+    }
+
+    /*!
+    1スレッドで認識できるより速いカメラを模して、並列に認識するフレーム数ごとに
+    公開した結果のフレームレートと、撮影から公開までの遅延を計測する
+    @return Exit code
+    */
+    int benchPipeline(Option const & opt)
+    {
+        unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+        SceneParams params;
+        params.gradient = 0.3;
+        params.noise = 8;
+        auto const scenes = SceneGenerator(opt, params, 4).generate(0, 100, cores);
+        // 1スレッドの認識時間から、コア数分の速さのカメラにする
+        auto const begin = clock_type::now();
+        for (auto const & scene : scenes){
+            std::vector<BlockInfo> blockInfo;
+            identifyBlock(scene.image, opt, blockInfo, FrameStamp(), false);
+        }
+        auto const single = (clock_type::now() - begin) / scenes.size();
+        auto const interval = single / cores;
+        size_t const count = 30 * cores;
+        OptionWatcher watcher("", opt);
+        auto & metrics = Metrics::get();
+        for (unsigned workers = 1; ; workers = std::min(workers * 2, cores)){
+            auto const skipped = metrics.skipped_frames.get();
+            auto const stale = metrics.stale_results.get();
+            std::vector<double> age;
+            uint64_t last = 0;
+            bool ordered = true;
+            {
+                IdentifyPipeline pipeline(watcher, workers, std::chrono::milliseconds(100), [](cv::Mat const & m, Option const & o, std::vector<BlockInfo> & info, FrameStamp const & frame){
+                    identifyBlock(m, o, info, frame, false);
+                });
+                auto publish = [&]{
+                    IdentifyPipeline::Result result;
+                    while (pipeline.next(result)){
+                        age.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - result.frame.captured).count());
+                        ordered = ordered && last < result.frame.id;
+                        last = result.frame.id;
+                    }
+                };
+                auto next = clock_type::now();
+                for (size_t i = 0; i < count; ++i){
+                    std::this_thread::sleep_until(next);
+                    next += interval;
+                    FrameStamp frame;
+                    frame.id = i + 1;
+                    frame.captured = clock_type::now();
+                    pipeline.submit(scenes[i % scenes.size()].image, frame);
+                    publish();
+                }
+                std::this_thread::sleep_for(single * 2);
+                publish();
+            }
+            double const sec = std::chrono::duration<double>(interval * count + single * 2).count();
+            std::cout << boost::format("%-20s : workers=%d %.0f results/s (camera %.0f fps), skipped=%d stale=%d%s")
+                % "pipeline" % workers % (age.size() / sec) % (count / sec)
+                % (metrics.skipped_frames.get() - skipped) % (metrics.stale_results.get() - stale) % (ordered ? "" : " OUT OF ORDER") << std::endl;
+            printLatency("result age", age);
+            if (workers == cores){
+                break;
+            }
+        }
+        return 0;
+    }
+    /*!
+    プレビューの描画とJPEGエンコードの時間と大きさを品質ごとに計測する
+    あわせて、ループバックで1つの接続が見ているときと見ていないときに
+    認識側のpublishにかかる時間と、配信したフレームレートを計測する
+    @return Exit code
+    */
+    int benchPreview(Option const & opt)
+    {
+        unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+        auto const scenes = SceneGenerator(opt, SceneParams(), 6).generate(0, 50, cores);
+        std::vector<std::vector<BlockInfo>> blockInfo(scenes.size());
+        for (size_t i = 0; i < scenes.size(); ++i){
+            identifyBlock(scenes[i].image, opt, blockInfo[i], FrameStamp(), false);
+        }
+        for (int quality : { 50, 70, 90 }){
+            std::vector<double> draw;
+            std::vector<double> encode;
+            size_t bytes = 0;
+            for (size_t i = 0; i < scenes.size(); ++i){
+                auto const t0 = clock_type::now();
+                cv::Mat const canvas = drawBlockInfo(scenes[i].image, opt, blockInfo[i]);
+                auto const t1 = clock_type::now();
+                std::vector<uchar> jpeg;
+                cv::imencode(".jpg", canvas, jpeg, std::vector<int>{ CV_IMWRITE_JPEG_QUALITY, quality });
+                auto const t2 = clock_type::now();
+                draw.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+                encode.push_back(std::chrono::duration<double, std::micro>(t2 - t1).count());
+                bytes += jpeg.size();
+            }
+            std::cout << boost::format("%-20s : quality=%d %.1fKB/frame") % "preview jpeg" % quality % (bytes / 1024.0 / scenes.size()) << std::endl;
+            printLatency("draw", draw);
+            printLatency("encode", encode);
+        }
+
+        // 空いているポートを探す
+        int port = 0;
+        {
+            boost::asio::io_service io_service;
+            boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+            port = acceptor.local_endpoint().port();
+        }
+        PreviewConfig config;
+        config.port = port;
+        config.max_fps = 15;
+        std::unique_ptr<PreviewServer> server(new PreviewServer(config));
+        OptionWatcher watcher("", opt);
+        OptionWatcher::Reader reader(watcher);
+        reader.get();
+        auto measure = [&](char const * name, size_t count, clock_type::duration interval){
+            std::vector<double> samples;
+            auto next = clock_type::now();
+            for (size_t i = 0; i < count; ++i){
+                if (interval.count() != 0){
+                    std::this_thread::sleep_until(next);
+                    next += interval;
+                }
+                auto const t0 = clock_type::now();
+                server->publish(scenes[i % scenes.size()].image, reader.share(), blockInfo[i % scenes.size()]);
+                samples.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - t0).count());
+            }
+            printLatency(name, samples);
+        };
+        measure("publish unwatched", 100000, clock_type::duration(0));
+
+        auto & metrics = Metrics::get();
+        auto const frames0 = metrics.preview_frames.get();
+        auto const bytes0 = metrics.preview_bytes.get();
+        boost::asio::io_service io_service;
+        boost::asio::ip::tcp::socket sock(io_service);
+        sock.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), static_cast<unsigned short>(port)));
+        std::string const request = "GET /stream.mjpg HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        boost::asio::write(sock, boost::asio::buffer(request));
+        std::thread viewer([&sock]{
+            std::vector<char> buf(65536);
+            boost::system::error_code ec;
+            while (!ec){
+                sock.read_some(boost::asio::buffer(buf), ec);
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        // 30fpsのカメラで3秒
+        auto const begin = clock_type::now();
+        measure("publish watched", 90, std::chrono::milliseconds(33));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        double const sec = std::chrono::duration<double>(clock_type::now() - begin).count();
+        // サーバーを止めると接続が閉じ、受信が終わる
+        server.reset();
+        viewer.join();
+        std::cout << boost::format("%-20s : max_fps=%.0f %.1f frames/s, %.0fKB/s, encode p50 %.1fms")
+            % "preview stream" % config.max_fps % ((metrics.preview_frames.get() - frames0) / sec)
+            % ((metrics.preview_bytes.get() - bytes0) / 1024.0 / sec) % (metrics.preview_encode.quantile(0.5) * 1e-3) << std::endl;
+        return 0;
+    }
+    /*!
+    30fpsのカメラを仮想時刻で模して、動きのない場面、ブロックを置いた場面、トリガーを順に与え、
+    待機中と通常時の1フレームあたりの処理時間と、動きやトリガーから認識を再開するまでのフレーム数を計測する
+    @return Exit code
+    */
+    int benchGovernor(Option const & opt)
+    {
+        SceneParams params;
+        params.gradient = 0.3;
+        SceneGenerator const generator(opt, params, 7);
+        auto const before = generator.generate(0).image;
+        auto const after = generator.generate(1).image;
+        GovernorConfig config;
+        config.idle_after_ms = 1000;
+        auto const frame_interval = std::chrono::microseconds(33333);
+        auto now = clock_type::now();
+        FrameGovernor governor(config, now);
+        cv::RNG rng(1);
+        // 状態ごとのフレーム数と処理時間
+        size_t active_frames = 0;
+        size_t idle_frames = 0;
+        clock_type::duration active_time(0);
+        clock_type::duration idle_time(0);
+        auto step = [&](cv::Mat const & scene){
+            now += frame_interval;
+            cv::Mat noise(scene.size(), CV_16SC3);
+            rng.fill(noise, cv::RNG::NORMAL, 0, 4);
+            cv::Mat raw;
+            scene.convertTo(raw, CV_16SC3);
+            cv::add(raw, noise, raw);
+            raw.convertTo(raw, CV_8UC3);
+            bool const idle = governor.idle();
+            auto const begin = clock_type::now();
+            bool admitted = governor.poll(now) && governor.admit(raw, now);
+            if (admitted){
+                cv::Mat m = raw;
+                preprocessImage(opt, m);
+                std::vector<BlockInfo> blockInfo;
+                identifyBlock(m, opt, blockInfo, FrameStamp(), false);
+            }
+            auto const elapsed = clock_type::now() - begin;
+            if (idle){
+                ++idle_frames;
+                idle_time += elapsed;
+            }
+            else{
+                ++active_frames;
+                active_time += elapsed;
+            }
+            return admitted;
+        };
+        // 待機するまで
+        int frames = 0;
+        while (!governor.idle() && frames < 300){
+            step(before);
+            ++frames;
+        }
+        std::cout << boost::format("%-20s : idle after %d frames (%.1fs)") % "governor" % frames % (frames / 30.0) << std::endl;
+        for (int i = 0; i < 90; ++i){
+            step(before);
+        }
+        // ブロックを置いてから認識を再開するまで
+        int motion = 1;
+        while (!step(after) && motion < 300){
+            ++motion;
+        }
+        for (int i = 0; !governor.idle() && i < 300; ++i){
+            step(after);
+        }
+        // トリガーから認識を再開するまで
+        governor.wake();
+        int trigger = 1;
+        while (!step(after) && trigger < 300){
+            ++trigger;
+        }
+        auto us = [](clock_type::duration d, size_t n){ return std::chrono::duration<double, std::micro>(d).count() / std::max<size_t>(1, n); };
+        std::cout << boost::format("%-20s : active %.1fus/frame (%d frames), idle %.1fus/frame (%d frames), x%.1f")
+            % "governor cpu" % us(active_time, active_frames) % active_frames % us(idle_time, idle_frames) % idle_frames
+            % (us(active_time, active_frames) / std::max(us(idle_time, idle_frames), 1e-3)) << std::endl;
+        std::cout << boost::format("%-20s : motion %d frames (%.0fms), trigger %d frames") % "resume" % motion % (motion * 33.3) % trigger << std::endl;
+        std::cout << "idle frames from the camera are not even decoded, which this benchmark does not include." << std::endl;
+        return 0;
+    }
+    /*!
+    ログ1件を記録するときに呼び出し側のスレッドでかかる時間を、
+    記録しない重要度、1秒の上限を超えて捨てるとき、リングバッファに書くとき、書式化して書くときで計測する
+    @return Exit code
+    */
+    int benchLog()
+    {
+        // 書き出しは行うが、画面には出さない
+        LogConfig config;
+        config.level = LogLevel::info;
+        config.console = false;
+        Log::configure(config);
+        int const count = 1000000;
+        auto measure = [](char const * name, int n, std::function<void(int)> const & f){
+            auto const begin = clock_type::now();
+            for (int i = 0; i < n; ++i){
+                f(i);
+            }
+            double const ns = std::chrono::duration<double, std::nano>(clock_type::now() - begin).count() / n;
+            std::cout << boost::format("%-20s : %.1fns/call") % name % ns << std::endl;
+        };
+        std::string const color = "yellow";
+        measure("log disabled", count, [&color](int i){
+            LOG_DEBUG("bench", "[%s:%d] is not mapped with any instructions.", color, i);
+        });
+        measure("log rate limited", count, [&color](int i){
+            LOG_WARN("bench", "[%s:%d] is not mapped with any instructions.", color, i);
+        });
+        // リングバッファに収まる数ずつ書き、バックグラウンドのスレッドが取り出すのを待つ
+        static LogSite site = { LogLevel::info, "bench", "[%s:%d] is not mapped with any instructions.", UINT32_MAX };
+        std::vector<double> samples;
+        auto const dropped = Metrics::get().log_dropped.get();
+        for (int batch = 0; batch < 100; ++batch){
+            for (int i = 0; i < 500; ++i){
+                auto const t0 = clock_type::now();
+                Log::write(site, color, i);
+                samples.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - t0).count());
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        printLatency("log recorded", samples);
+        std::cout << boost::format("%-20s : %d") % "log dropped" % (Metrics::get().log_dropped.get() - dropped) << std::endl;
+        std::ostringstream os;
+        measure("format on caller", count / 10, [&os, &color](int i){
+            os.str("");
+            os << boost::format("[%s:%d] is not mapped with any instructions.") % color % i << std::endl;
+        });
+        return 0;
+    }
+    /*!
+    故障を起こせるPythonプロセスの代わり
+    ループバックで待ち受け、別スレッドで応答する
+    */
+    class MockRenderer
+    {
+    public:
+        enum Mode
+        {
+            OK, ///< すぐに200を返す
+            FLAKY, ///< 接続ごとに500と200を交互に返す
+            ERROR_500, ///< いつも500を返す
+            HANG, ///< 接続を受け付けるが応答しない
+            DOWN, ///< 待ち受けをやめ、接続を拒否する
+        };
+    private:
+        typedef boost::asio::ip::tcp tcp;
+        boost::asio::io_service io_service_;
+        boost::asio::io_service::work work_;
+        tcp::acceptor acceptor_;
+        unsigned short port_;
+        Mode mode_; ///< io_service_のスレッドで使う
+        int accepted_; ///< io_service_のスレッドで使う
+        std::vector<std::shared_ptr<tcp::socket>> hung_; ///< 応答しない接続
+        std::thread thread_;
+
+        void accept()
+        {
+            auto sock = std::make_shared<tcp::socket>(io_service_);
+            acceptor_.async_accept(*sock, [this, sock](boost::system::error_code const & ec){
+                if (ec){
+                    return;
+                }
+                ++accepted_;
+                if (mode_ == HANG){
+                    hung_.push_back(sock);
+                }
+                else{
+                    respond(sock, mode_ == ERROR_500 || (mode_ == FLAKY && accepted_ % 2 == 1) ? 500 : 200);
+                }
+                accept();
+            });
+        }
+
+        /*!
+        リクエストを最後まで読んでから応答する
+        */
+        void respond(std::shared_ptr<tcp::socket> sock, int status)
+        {
+            auto buf = std::make_shared<boost::asio::streambuf>();
+            boost::asio::async_read_until(*sock, *buf, "\r\n\r\n", [sock, buf, status](boost::system::error_code const & ec, size_t header){
+                if (ec){
+                    return;
+                }
+                std::string const data(boost::asio::buffers_begin(buf->data()), boost::asio::buffers_end(buf->data()));
+                auto const pos = data.find("Content-Length: ");
+                size_t const length = pos == std::string::npos ? 0 : std::stoul(data.substr(pos + 16));
+                size_t const rest = header + length - std::min(data.size(), header + length);
+                boost::asio::async_read(*sock, *buf, boost::asio::transfer_exactly(rest), [sock, buf, status](boost::system::error_code const & ec, size_t){
+                    if (ec){
+                        return;
+                    }
+                    auto response = std::make_shared<std::string>((boost::format("HTTP/1.1 %d %s\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok")
+                        % status % (status == 200 ? "OK" : "Internal Server Error")).str());
+                    boost::asio::async_write(*sock, boost::asio::buffer(*response), [sock, response](boost::system::error_code const &, size_t){
+                        boost::system::error_code ignored;
+                        sock->shutdown(tcp::socket::shutdown_both, ignored);
+                    });
+                });
+            });
+        }
+
+        void listen()
+        {
+            acceptor_.open(tcp::v4());
+            acceptor_.set_option(tcp::acceptor::reuse_address(true));
+            acceptor_.bind(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port_));
+            acceptor_.listen();
+            port_ = acceptor_.local_endpoint().port();
+            accept();
+        }
+    public:
+        MockRenderer()
+            : work_(io_service_)
+            , acceptor_(io_service_)
+            , port_(0)
+            , mode_(OK)
+            , accepted_(0)
+        {
+            listen();
+            thread_ = std::thread([this]{ io_service_.run(); });
+        }
+        ~MockRenderer()
+        {
+            io_service_.stop();
+            thread_.join();
+        }
+        int port() const { return port_; }
+        void setMode(Mode mode)
+        {
+            std::promise<void> done;
+            io_service_.post([this, mode, &done]{
+                mode_ = mode;
+                for (auto & sock : hung_){
+                    boost::system::error_code ignored;
+                    sock->close(ignored);
+                }
+                hung_.clear();
+                if (mode == DOWN){
+                    acceptor_.close();
+                }
+                else if (!acceptor_.is_open()){
+                    listen();
+                }
+                done.set_value();
+            });
+            done.get_future().wait();
+        }
+    };
+
+    /*!
+    故障を起こせる送信先に送信し、故障ごとにトリガーから送信を終えるまでの時間と結果を計測する
+    応答しない送信先でも送信の締め切りを超えないこと、送信先が止まっている間はすぐに失敗すること、
+    送信先が戻ったら送信を再開することを確かめる
+    @return Exit code
+    */
+    int benchSender(Option const & opt)
+    {
+        // 結果を読みやすくするため、送信のログはエラーだけにする
+        LogConfig log;
+        log.level = LogLevel::error;
+        Log::configure(log);
+        auto const scene = SceneGenerator(opt, SceneParams(), 7).generate(0);
+        std::vector<BlockInfo> blockInfo;
+        identifyBlock(scene.image, opt, blockInfo, FrameStamp(), false);
+        if (blockInfo.empty()){
+            std::cerr << "no block is identified in the test image." << std::endl;
+            return 1;
+        }
+        MockRenderer renderer;
+        SendConfig const config;
+        boost::asio::io_service io_service;
+        boost::asio::io_service::work work(io_service);
+        std::thread thread([&io_service]{ io_service.run(); });
+        double worst = 0;
+        auto run = [&](char const * name, std::shared_ptr<Sender> const & sender, int count){
+            std::vector<double> samples;
+            int results[4] = {};
+            for (int i = 0; i < count; ++i){
+                std::promise<SendResult> promise;
+                auto const begin = clock_type::now();
+                io_service.post([&]{
+                    sender->send(opt, blockInfo, [&promise](SendResult result){
+                        promise.set_value(result);
+                    });
+                });
+                auto const result = promise.get_future().get();
+                samples.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - begin).count());
+                ++results[static_cast<int>(result)];
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+            worst = std::max(worst, *std::max_element(samples.begin(), samples.end()));
+            std::cout << boost::format("%-20s : sent=%d failed=%d timeout=%d rejected=%d")
+                % name % results[0] % results[1] % results[2] % results[3] << std::endl;
+            printLatency(name, samples);
+        };
+        // 止めたio_serviceのスレッドで破棄するため、送信を終えても保持する
+        std::vector<std::shared_ptr<Sender>> senders;
+        auto makeSender = [&]{
+            senders.push_back(std::make_shared<Sender>(io_service, "127.0.0.1", renderer.port(), config));
+            return senders.back();
+        };
+        run("ok", makeSender(), 20);
+        renderer.setMode(MockRenderer::FLAKY);
+        run("flaky", makeSender(), 20);
+        renderer.setMode(MockRenderer::ERROR_500);
+        run("error", makeSender(), 6);
+        // 1つの送信先が応答しなくなり、止まり、戻る
+        auto const sender = makeSender();
+        renderer.setMode(MockRenderer::HANG);
+        run("hang", sender, 6);
+        renderer.setMode(MockRenderer::DOWN);
+        std::this_thread::sleep_for(std::chrono::milliseconds(config.breaker_open_ms));
+        run("down", sender, 6);
+        renderer.setMode(MockRenderer::OK);
+        std::this_thread::sleep_for(std::chrono::milliseconds(config.breaker_open_ms + config.connect_timeout_ms));
+        run("recovered", sender, 6);
+        auto & metrics = Metrics::get();
+        std::cout << boost::format("%-20s : retries=%d timeouts=%d breaker_opens=%d")
+            % "sender metrics" % metrics.send_retries.get() % metrics.send_timeouts.get() % metrics.breaker_opens.get() << std::endl;
+        std::cout << boost::format("%-20s : worst %.1fms, deadline %dms")
+            % "trigger to result" % (worst * 1e-3) % config.deadline_ms << std::endl;
+        io_service.stop();
+        thread.join();
+        senders.clear();
+        return worst * 1e-3 <= config.deadline_ms + 50 ? 0 : 1;
+    }
+
+    /*!
+    他のスレッドがCPUを使い切っているときの周期処理の遅れを、コアの固定とスケジューリングを変えて計測する
+    1msごとに起きて固定の計算をし、終わった時刻の予定からの遅れを表示する(計算の時間を含む)
+    コアを固定するときは、負荷のスレッドを残りのコアに固定する(reserveThreadCoresと同じ)
+    @return Exit code
+    */
+    int benchThread()
+    {
+        int const count = 3000;
+        int const work = 100000;
+        auto const period = std::chrono::milliseconds(1);
+        auto const cores = availableCores();
+        struct Case
+        {
+            std::string name;
+            ThreadPolicy measured; ///< 計測するスレッド
+            ThreadPolicy load; ///< 負荷のスレッド
+        };
+        ThreadPolicy pinned;
+        pinned.cores.push_back(cores.back());
+        ThreadPolicy others;
+        others.cores.assign(cores.begin(), cores.end() - 1);
+        ThreadPolicy fifo;
+        fifo.scheduling = ThreadPolicy::SCHEDULING_FIFO;
+        fifo.priority = 50;
+        ThreadPolicy pinned_fifo = pinned;
+        pinned_fifo.scheduling = fifo.scheduling;
+        pinned_fifo.priority = fifo.priority;
+        std::vector<Case> cases = { { "default", ThreadPolicy(), ThreadPolicy() }, { "fifo", fifo, ThreadPolicy() } };
+        if (1 < cores.size()){
+            cases.push_back({ "pinned", pinned, others });
+            cases.push_back({ "pinned+fifo", pinned_fifo, others });
+        }
+        else{
+            std::cout << "only 1 core is available. skipped pinning." << std::endl;
+        }
+        std::cout << boost::format("%d load threads on %d cores, %dms period") % (cores.size() * 2) % cores.size() % period.count() << std::endl;
+        for (auto const & c : cases){
+            std::atomic<bool> stop(false);
+            std::vector<std::thread> load;
+            for (size_t i = 0; i < cores.size() * 2; ++i){
+                load.emplace_back([&stop, &c]{
+                    std::string error;
+                    if (!c.load.cores.empty()){
+                        setThreadCores(c.load.cores, error);
+                    }
+                    volatile unsigned sink = 0;
+                    while (!stop.load(std::memory_order_relaxed)){
+                        sink = sink + 1;
+                    }
+                });
+            }
+            std::vector<double> late;
+            std::string error;
+            std::thread measured([&]{
+                if ((!c.measured.cores.empty() && !setThreadCores(c.measured.cores, error)) ||
+                    !setThreadScheduling(c.measured.scheduling, c.measured.priority, error)){
+                    return;
+                }
+                auto next = clock_type::now() + period;
+                for (int i = 0; i < count; ++i){
+                    std::this_thread::sleep_until(next);
+                    volatile unsigned sink = 0;
+                    for (int k = 0; k < work; ++k){
+                        sink = sink + k;
+                    }
+                    auto const now = clock_type::now();
+                    late.push_back(std::chrono::duration<double, std::micro>(now - next).count());
+                    // 周期を過ぎたら追いつこうとせず、次の周期から
+                    while (next <= now){
+                        next += period;
+                    }
+                }
+            });
+            measured.join();
+            stop = true;
+            for (auto & th : load){
+                th.join();
+            }
+            if (late.empty()){
+                std::cout << boost::format("%-20s : failed (%s)") % c.name % error << std::endl;
+                continue;
+            }
+            printLatency(c.name, late);
+        }
+        return 0;
+    }
+
+    /*!
+    カメラ画像の大きさのテスト画像を1枚ずつ作り、縮小・回転、ブロック認識、結果の描画を繰り返してRSSを計測する
+    予算を指定すると省メモリモードで動かし、ピークのRSSが予算を超えたら失敗とする
+    ulimit -vで仮想メモリを制限して動かせば、確保に失敗しないことも確かめられる
+    @param[in] opt オプション
+    @param[in] memory_budget RSSの予算(MB)。0なら制限しない
+    @return Exit code
+    */
+    int benchMemory(Option const & opt, int memory_budget)
+    {
+        size_t const frames = 300;
+        double const mb = 1024.0 * 1024.0;
+        // ブロック認識は1つの積み上げしか見ないので、積み上げは1つにする
+        SceneParams params;
+        params.gradient = 0.3;
+        params.noise = 8;
+        SceneGenerator const generator(opt, params, 1);
+        MemoryBudget budget(memory_budget);
+        IdentifyState state;
+        size_t matched = 0;
+        auto const before = residentBytes();
+        auto const begin = clock_type::now();
+        for (size_t i = 0; i < frames; ++i){
+            auto const scene = generator.generate(i);
+            // カメラの向きと大きさに戻してから、カメラ画像と同じように縮小・回転する
+            cv::Mat flipped;
+            cv::Mat camera;
+            cv::flip(scene.image, flipped, 0);
+            cv::transpose(flipped, camera);
+            flipped.release();
+            cv::resize(camera, camera, cv::Size(opt.tune.camera_width, opt.tune.camera_height));
+            preprocessImage(opt, camera);
+            std::vector<BlockInfo> blockInfo;
+            identifyBlock(camera, opt, blockInfo, FrameStamp(), false, &state);
+            drawBlockInfo(camera, opt, blockInfo);
+            budget.check();
+            auto const & expected = scene.stacks.front();
+            matched += blockInfo.size() == expected.size() && std::equal(expected.begin(), expected.end(), blockInfo.begin(), [](Block const & e, BlockInfo const & a){
+                return e.color == a.color.name && e.width == a.width;
+            });
+        }
+        double const ms = std::chrono::duration<double, std::milli>(clock_type::now() - begin).count() / frames;
+        auto const peak = peakResidentBytes();
+        std::cout << boost::format("%-20s : %s, %dx%d camera, %.3fms/frame, %d/%d frames matched")
+            % "frames" % (lowMemory() ? "low-memory" : "normal") % opt.tune.camera_width % opt.tune.camera_height % ms % matched % frames << std::endl;
+        std::cout << boost::format("%-20s : before %.1fMB, after %.1fMB, peak %.1fMB, %.1fMB per frame estimated")
+            % "rss" % (before / mb) % (residentBytes() / mb) % (peak / mb) % (MemoryBudget::frameBytes(opt) / mb) << std::endl;
+        if (!budget.budget()){
+            return 0;
+        }
+        bool const ok = peak <= budget.budget();
+        std::cout << boost::format("%-20s : %dMB %s") % "budget" % memory_budget % (ok ? "held" : "exceeded") << std::endl;
+        return ok ? 0 : 1;
+    }
+}
+
+int runBench(std::string const & name, Option const & opt, int memory_budget)
+{
+    if (name == "background"){
+        return benchBackground(opt);
+    }
+    if (name == "color"){
+        return benchColor(opt);
+    }
+    if (name == "governor"){
+        return benchGovernor(opt);
+    }
+    if (name == "log"){
+        return benchLog();
+    }
+    if (name == "memory"){
+        return benchMemory(opt, memory_budget);
+    }
+    if (name == "pipeline"){
+        return benchPipeline(opt);
+    }
+    if (name == "preview"){
+        return benchPreview(opt);
+    }
+    if (name == "segment"){
+        return benchSegment(opt);
+    }
+    if (name == "scene"){
+        return benchScene(opt);
+    }
+    if (name == "sender"){
+        return benchSender(opt);
+    }
+    if (name == "thread"){
+        return benchThread();
+    }
+    if (name == "threshold"){
+        return benchThreshold(opt);
+    }
+    if (name == "trace"){
+        return benchTrace();
+    }
+#if !(defined _WIN32 || defined _WIN64)
+    if (name == "button"){
+        return benchButton();
+    }
+#endif // !(defined _WIN32 || defined _WIN64)
+    std::cerr << boost::format("unknown benchmark [%s]") % name << std::endl;
+    return 1;
+}
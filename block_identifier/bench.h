@@ -0,0 +1,13 @@
+#pragma once
+
+#include "option.h"
+
+/*!
+ベンチマークを実行する
+ハードウェアなしで性能を計測するため
+@param[in] name ベンチマーク名
+@param[in] opt オプション
+@param[in] memory_budget RSSの予算(MB)。0なら制限しない。memoryで使う
+@return Exit code
+*/
+int runBench(std::string const & name, Option const & opt, int memory_budget);
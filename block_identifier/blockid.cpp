@@ -0,0 +1,152 @@
+#include "blockid.h"
+#include "identify.h"
+#include "orders.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+struct blockid_engine
+{
+    Option opt;
+    IdentifyState state; ///< 同じカメラの画像を続けて認識するときの背景と閾値
+    std::vector<BlockInfo> blockInfo;
+    std::vector<blockid_block> blocks;
+    std::vector<blockid_param> params;
+    std::string json; ///< 空なら未作成。JSONが要るときだけ作る
+    std::string error;
+};
+
+namespace {
+    /*!
+    ブロック情報をC ABIの構造体にする
+    文字列はオプションの中を指すので、エンジンが生きている間は有効
+    */
+    void exportBlocks(blockid_engine & engine)
+    {
+        auto const & opt = engine.opt;
+        engine.params.clear();
+        engine.blocks.clear();
+        std::vector<size_t> offsets;
+        for (auto const & info : engine.blockInfo){
+            offsets.push_back(engine.params.size());
+            auto const inst = opt.block2inst.find(info.to_block());
+            if (inst != opt.block2inst.end()){
+                for (auto const & param : inst->second.param){
+                    engine.params.push_back(blockid_param{ param.first.c_str(), param.second });
+                }
+            }
+        }
+        // paramsを確保し終えてから指す
+        for (size_t i = 0; i < engine.blockInfo.size(); ++i){
+            auto const & info = engine.blockInfo[i];
+            auto const color = std::find_if(opt.colors.begin(), opt.colors.end(), [&info](Color const & c){ return c.name == info.color.name; });
+            auto const inst = opt.block2inst.find(info.to_block());
+            size_t const end = i + 1 < offsets.size() ? offsets[i + 1] : engine.params.size();
+            blockid_block block;
+            block.color = color == opt.colors.end() ? "" : color->name.c_str();
+            block.width = info.width;
+            block.x = info.rc.x;
+            block.y = info.rc.y;
+            block.w = info.rc.width;
+            block.h = info.rc.height;
+            block.bgr[0] = info.ave[0];
+            block.bgr[1] = info.ave[1];
+            block.bgr[2] = info.ave[2];
+            block.confidence = info.confidence;
+            block.instruction = inst == opt.block2inst.end() ? nullptr : inst->second.name.c_str();
+            block.params = engine.params.data() + offsets[i];
+            block.param_count = static_cast<int>(end - offsets[i]);
+            engine.blocks.push_back(block);
+        }
+    }
+
+    /*!
+    文字列をNUL終端してバッファに書く
+    */
+    void copyError(std::string const & what, char * error, size_t error_size)
+    {
+        if (error && 0 < error_size){
+            size_t const n = std::min(what.size(), error_size - 1);
+            std::memcpy(error, what.data(), n);
+            error[n] = '\0';
+        }
+    }
+}
+
+int blockid_abi_version(void)
+{
+    return BLOCKID_ABI_VERSION;
+}
+
+blockid_engine * blockid_create(char const * option_path, char * error, size_t error_size)
+{
+    try{
+        std::unique_ptr<blockid_engine> engine(new blockid_engine);
+        engine->opt = (option_path && *option_path) ? readOptionCached(option_path) : getDefaultOption();
+        validateOption(engine->opt);
+        copyError("", error, error_size);
+        return engine.release();
+    }
+    catch (std::exception const & e){
+        copyError(e.what(), error, error_size);
+        return nullptr;
+    }
+}
+
+void blockid_destroy(blockid_engine * engine)
+{
+    delete engine;
+}
+
+int blockid_identify(blockid_engine * engine, unsigned char const * bgr, int width, int height, size_t stride, int preprocess, blockid_block const ** blocks)
+{
+    if (!engine){
+        return -1;
+    }
+    try{
+        if (!bgr || width <= 0 || height <= 0 || stride < static_cast<size_t>(width) * 3 || !blocks){
+            throw std::invalid_argument("invalid image.");
+        }
+        // 呼び出し側の画像をそのまま参照する。認識も縮尺の変換も書き換えないのでconstを外してもよい
+        cv::Mat image(height, width, CV_8UC3, const_cast<unsigned char *>(bgr), stride);
+        if (preprocess){
+            preprocessImage(engine->opt, image);
+        }
+        identifyBlock(image, engine->opt, engine->blockInfo, FrameStamp(), false, &engine->state);
+        exportBlocks(*engine);
+        engine->json.clear();
+        engine->error.clear();
+        *blocks = engine->blocks.data();
+        return static_cast<int>(engine->blocks.size());
+    }
+    catch (std::exception const & e){
+        engine->blockInfo.clear();
+        engine->blocks.clear();
+        engine->json.clear();
+        engine->error = e.what();
+        return -1;
+    }
+}
+
+char const * blockid_orders_json(blockid_engine * engine)
+{
+    if (!engine){
+        return "";
+    }
+    try{
+        if (engine->json.empty()){
+            engine->json = makeOrdersJson(engine->opt, engine->blockInfo);
+        }
+    }
+    catch (std::exception const & e){
+        engine->error = e.what();
+        return "";
+    }
+    return engine->json.c_str();
+}
+
+char const * blockid_last_error(blockid_engine const * engine)
+{
+    return engine ? engine->error.c_str() : "engine is null.";
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+/*
+libblockid: ブロック認識を他のプロセスから使うためのC ABI
+描画側(Python)からプロセス内で呼び出せば、JSONの作成、TCP送信、解析を省ける
+
+- エンジンはスレッドをまたいで同時に使わないこと。スレッドごとに作れば並列に使える
+- 結果はエンジンが所有し、次のblockid_identifyかblockid_destroyまで有効
+- 構造体はフィールドを末尾にだけ追加し、変えたらBLOCKID_ABI_VERSIONを上げる
+*/
+
+#include <stddef.h>
+
+#if defined _WIN32 || defined _WIN64
+#ifdef BLOCKID_EXPORTS
+#define BLOCKID_API __declspec(dllexport)
+#else
+#define BLOCKID_API __declspec(dllimport)
+#endif // BLOCKID_EXPORTS
+#else
+#define BLOCKID_API __attribute__((visibility("default")))
+#endif // defined _WIN32 || defined _WIN64
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+#define BLOCKID_ABI_VERSION 1
+
+/*!
+認識エンジン。オプションと結果の置き場所を持つ
+*/
+typedef struct blockid_engine blockid_engine;
+
+/*!
+命令のパラメータ
+*/
+typedef struct blockid_param
+{
+    char const * name; ///< パラメータ名
+    double value; ///< パラメータ値
+} blockid_param;
+
+/*!
+認識したブロック。上から順に並ぶ
+*/
+typedef struct blockid_block
+{
+    char const * color; ///< 色名
+    int width; ///< 横幅: 1, 2, 3
+    int x; ///< 矩形(縮尺と向きを変換した画像の座標)
+    int y;
+    int w;
+    int h;
+    unsigned char bgr[3]; ///< 色判定領域の平均色
+    double confidence; ///< 色判定領域のうちcolorに分類された画素の割合
+    char const * instruction; ///< 命令名。対応付けられていなければNULL
+    blockid_param const * params; ///< 命令のパラメータ
+    int param_count; ///< paramsの数
+} blockid_block;
+
+/*!
+@return ライブラリのBLOCKID_ABI_VERSION。ヘッダーの値と違えば使わないこと
+*/
+BLOCKID_API int blockid_abi_version(void);
+
+/*!
+エンジンを作る
+@param[in] option_path オプションファイルのパス。NULLか空文字列ならデフォルト値
+@param[out] error 失敗したときのメッセージの書き込み先。NULL可
+@param[in] error_size errorのバイト数
+@return エンジン。失敗したらNULL
+*/
+BLOCKID_API blockid_engine * blockid_create(char const * option_path, char * error, size_t error_size);
+
+/*!
+エンジンを破棄する
+@param[in] engine エンジン。NULL可
+*/
+BLOCKID_API void blockid_destroy(blockid_engine * engine);
+
+/*!
+画像からブロックを認識する
+画像はコピーせずにそのまま読む
+オプションで背景差分かbin_thの自動決定を選んだときは、エンジンごとに同じカメラの画像を続けて渡すと背景と閾値を引き継ぐ
+@param[in] engine エンジン
+@param[in] bgr BGR順、1画素3バイトの画像の先頭
+@param[in] width 画像の幅
+@param[in] height 画像の高さ
+@param[in] stride 1行のバイト数
+@param[in] preprocess 0以外ならカメラ画像として縮尺と向きを変換してから認識する(block_identifierと同じ)
+@param[out] blocks 認識したブロックの配列の書き込み先
+@return ブロック数。失敗したら-1(blockid_last_errorで理由を取得する)
+*/
+BLOCKID_API int blockid_identify(blockid_engine * engine, unsigned char const * bgr, int width, int height, size_t stride, int preprocess, blockid_block const ** blocks);
+
+/*!
+@param[in] engine エンジン
+@return 最後のblockid_identifyの結果を、block_identifierがPOSTするのと同じ形式にしたJSON
+*/
+BLOCKID_API char const * blockid_orders_json(blockid_engine * engine);
+
+/*!
+@param[in] engine エンジン
+@return 最後に失敗した理由。失敗していなければ空文字列
+*/
+BLOCKID_API char const * blockid_last_error(blockid_engine const * engine);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,136 @@
+#include "calibrate.h"
+#include <boost/format.hpp>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <thread>
+
+namespace {
+    /*!
+    クラスタごとの画素値の合計
+    */
+    struct Sum
+    {
+        int64_t b, g, r, count;
+    };
+
+    /*!
+    画素の範囲を最も近い中心に割り当て、クラスタごとに合計する
+    中心ごとに画素を連続して処理し、距離計算をベクトル化しやすくする
+    @param[in] samples 画素
+    @param[in] begin 範囲の先頭
+    @param[in] end 範囲の終端
+    @param[in] centers クラスタの中心
+    @param[in,out] labels 画素ごとのクラスタ番号
+    @param[out] sums クラスタごとの合計
+    @return 前回から割り当てが変わった画素数
+    */
+    size_t assign(ColorSamples const & samples, size_t begin, size_t end, std::vector<cv::Vec3i> const & centers, std::vector<uint8_t> & labels, std::vector<Sum> & sums)
+    {
+        size_t const CHUNK = 256;
+        int best[CHUNK];
+        uint8_t label[CHUNK];
+        size_t changed = 0;
+        sums.assign(centers.size(), Sum{ 0, 0, 0, 0 });
+        for (size_t pos = begin; pos < end; pos += CHUNK){
+            size_t const n = std::min(CHUNK, end - pos);
+            uchar const * b = samples.b() + pos;
+            uchar const * g = samples.g() + pos;
+            uchar const * r = samples.r() + pos;
+            std::fill(best, best + n, INT_MAX);
+            for (size_t k = 0; k < centers.size(); ++k){
+                int const cb = centers[k][0], cg = centers[k][1], cr = centers[k][2];
+                for (size_t i = 0; i < n; ++i){
+                    int const db = b[i] - cb, dg = g[i] - cg, dr = r[i] - cr;
+                    int const d = db * db + dg * dg + dr * dr;
+                    bool const closer = d < best[i];
+                    best[i] = closer ? d : best[i];
+                    label[i] = closer ? static_cast<uint8_t>(k) : label[i];
+                }
+            }
+            for (size_t i = 0; i < n; ++i){
+                auto & s = sums[label[i]];
+                s.b += b[i];
+                s.g += g[i];
+                s.r += r[i];
+                s.count++;
+                changed += labels[pos + i] != label[i];
+                labels[pos + i] = label[i];
+            }
+        }
+        return changed;
+    }
+}
+
+void ColorSamples::add(cv::Mat const & image, std::vector<BlockInfo> const & blockInfo)
+{
+    for (auto const & info : blockInfo){
+        cv::Mat const area = image(info.color_area);
+        for (int y = 0; y < area.rows; ++y){
+            auto const row = area.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < area.cols; ++x){
+                b_.push_back(row[x][0]);
+                g_.push_back(row[x][1]);
+                r_.push_back(row[x][2]);
+            }
+        }
+    }
+}
+
+std::vector<Color> calibrateColors(std::vector<Color> const & colors, ColorSamples const & samples, int threads)
+{
+    if (colors.empty() || 255 < colors.size()){
+        throw std::runtime_error("color count should be 1-255.");
+    }
+    std::vector<cv::Vec3i> centers;
+    for (auto const & c : colors){
+        centers.emplace_back(c.bgr[0], c.bgr[1], c.bgr[2]);
+    }
+    threads = std::max(1, threads);
+    size_t const size = samples.size();
+    std::vector<uint8_t> labels(size, 0xFF);
+    std::vector<std::vector<Sum>> sums(threads);
+    std::vector<size_t> changed(threads);
+    for (int iter = 0; iter < 100; ++iter){
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t){
+            workers.emplace_back([&, t]{
+                changed[t] = assign(samples, size * t / threads, size * (t + 1) / threads, centers, labels, sums[t]);
+            });
+        }
+        for (auto & w : workers){
+            w.join();
+        }
+        size_t total_changed = 0;
+        for (int t = 0; t < threads; ++t){
+            total_changed += changed[t];
+        }
+        for (size_t k = 0; k < centers.size(); ++k){
+            Sum s = { 0, 0, 0, 0 };
+            for (int t = 0; t < threads; ++t){
+                s.b += sums[t][k].b;
+                s.g += sums[t][k].g;
+                s.r += sums[t][k].r;
+                s.count += sums[t][k].count;
+            }
+            // 画素が割り当てられなかった色は元の値のままにする
+            if (0 < s.count){
+                centers[k] = cv::Vec3i(
+                    static_cast<int>((s.b + s.count / 2) / s.count),
+                    static_cast<int>((s.g + s.count / 2) / s.count),
+                    static_cast<int>((s.r + s.count / 2) / s.count));
+            }
+        }
+        if (total_changed == 0){
+            std::cout << boost::format("k-means converged after %d iterations.") % (iter + 1) << std::endl;
+            break;
+        }
+    }
+    std::vector<Color> dst = colors;
+    for (size_t k = 0; k < dst.size(); ++k){
+        for (int i = 0; i < 3; ++i){
+            dst[k].bgr[i] = static_cast<uchar>(centers[k][i]);
+        }
+    }
+    return dst;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "option.h"
+
+/*!
+色の校正に使う画素
+*/
+class ColorSamples
+{
+    std::vector<uchar> b_, g_, r_;
+public:
+    /*!
+    認識したブロックの色判定領域の画素を追加する
+    @param[in] image カメラ画像
+    @param[in] blockInfo 判定したブロック情報
+    */
+    void add(cv::Mat const & image, std::vector<BlockInfo> const & blockInfo);
+    /*!
+    @return 画素数
+    */
+    size_t size() const { return b_.size(); }
+    uchar const * b() const { return b_.data(); }
+    uchar const * g() const { return g_.data(); }
+    uchar const * r() const { return r_.data(); }
+};
+
+/*!
+画素をk-meansで分類し、色の基準値を校正する
+現在の色を初期値にするので、色名と色の対応は変わらない
+@param[in] colors 現在の色
+@param[in] samples 画素
+@param[in] threads スレッド数
+@return 校正した色
+*/
+std::vector<Color> calibrateColors(std::vector<Color> const & colors, ColorSamples const & samples, int threads);
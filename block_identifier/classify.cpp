@@ -0,0 +1,148 @@
+#include "classify.h"
+#include <algorithm>
+#include <array>
+#include <climits>
+
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && 2 <= _M_IX86_FP)
+#define BLOCK_IDENTIFIER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+#ifdef BLOCK_IDENTIFIER_SSE2
+    /*!
+    SSE2にはない32ビット整数の最小値
+    */
+    inline __m128i min32(__m128i a, __m128i b)
+    {
+        __m128i const lt = _mm_cmplt_epi32(a, b);
+        return _mm_or_si128(_mm_and_si128(lt, a), _mm_andnot_si128(lt, b));
+    }
+
+    /*!
+    4色ずつまとめた色判定用のテーブル
+    画素ごとに読み直さないよう、判定の前に一度だけ作る
+    */
+    class Packed
+    {
+        static int const MAX_GROUPS = 64; ///< 256色
+        __m128i bg_[MAX_GROUPS];
+        __m128i r_[MAX_GROUPS];
+        int groups_;
+    public:
+        explicit Packed(ColorTable const & table)
+            : groups_(static_cast<int>(table.bg.size() / 8))
+        {
+            CV_Assert(groups_ <= MAX_GROUPS);
+            for (int i = 0; i < groups_; ++i){
+                bg_[i] = _mm_loadu_si128(reinterpret_cast<__m128i const *>(&table.bg[i * 8]));
+                r_[i] = _mm_loadu_si128(reinterpret_cast<__m128i const *>(&table.r[i * 8]));
+            }
+        }
+        /*!
+        16ビットの(B,G)と(R,0)の組の差をmaddで2乗和にし、4色分の距離を一度に求める
+        距離を8ビット左にずらして下位に色番号を入れ、最小値と番号を同時に求める
+        */
+        int nearest(cv::Vec3b bgr) const
+        {
+            __m128i const pbg = _mm_set1_epi32(bgr[0] | (bgr[1] << 16));
+            __m128i const pr = _mm_set1_epi32(bgr[2]);
+            __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+            __m128i best = _mm_set1_epi32(INT_MAX);
+            for (int i = 0; i < groups_; ++i){
+                __m128i const dbg = _mm_sub_epi16(bg_[i], pbg);
+                __m128i const dr = _mm_sub_epi16(r_[i], pr);
+                __m128i const len = _mm_add_epi32(_mm_madd_epi16(dbg, dbg), _mm_madd_epi16(dr, dr));
+                best = min32(best, _mm_or_si128(_mm_slli_epi32(len, 8), index));
+                index = _mm_add_epi32(index, _mm_set1_epi32(4));
+            }
+            best = min32(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+            best = min32(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtsi128_si32(best) & 0xFF;
+        }
+    };
+#else
+    /*!
+    SSE2が使えないときの色判定用のテーブル
+    */
+    class Packed
+    {
+        ColorTable const & table_;
+    public:
+        explicit Packed(ColorTable const & table) : table_(table) {}
+        int nearest(cv::Vec3b bgr) const
+        {
+            int len2 = INT_MAX;
+            int dst = 0;
+            for (size_t i = 0; i < table_.bgr.size(); ++i){
+                int len = 0;
+                for (int j = 0; j < 3; ++j){
+                    len += (bgr[j] - table_.bgr[i][j]) * (bgr[j] - table_.bgr[i][j]);
+                }
+                if (len < len2){
+                    len2 = len;
+                    dst = static_cast<int>(i);
+                }
+            }
+            return dst;
+        }
+    };
+#endif // BLOCK_IDENTIFIER_SSE2
+}
+
+void packColorTable(ColorTable & table)
+{
+    CV_Assert(table.bgr.size() <= 256);
+    table.bg.clear();
+    table.r.clear();
+    for (auto const & c : table.bgr){
+        table.bg.insert(table.bg.end(), { static_cast<short>(c[0]), static_cast<short>(c[1]) });
+        table.r.insert(table.r.end(), { static_cast<short>(c[2]), 0 });
+    }
+    // 埋めた色はどの画素からも実在の色より遠い
+    while (table.bg.size() % 8 != 0){
+        table.bg.insert(table.bg.end(), { 1000, 1000 });
+        table.r.insert(table.r.end(), { 1000, 0 });
+    }
+    // 量子化した区画の中心の色で分類しておく
+    Packed const packed(table);
+    table.lut.resize(1 << 15);
+    for (int i = 0; i < (1 << 15); ++i){
+        cv::Vec3b const center(((i >> 10) << 3) | 4, (((i >> 5) & 31) << 3) | 4, ((i & 31) << 3) | 4);
+        table.lut[i] = static_cast<uchar>(packed.nearest(center));
+    }
+}
+
+int nearestColor(cv::Vec3b bgr, ColorTable const & table)
+{
+    return Packed(table).nearest(bgr);
+}
+
+ColorVote voteColor(cv::Mat const & area, ColorTable const & table)
+{
+    CV_Assert(area.type() == CV_8UC3 && table.lut.size() == (1 << 15));
+    auto const lut = table.lut.data();
+    std::array<int, 256> hist = {};
+    uint64_t sum[3] = {};
+    for (int y = 0; y < area.rows; ++y){
+        auto p = area.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < area.cols; ++x){
+            auto const bgr = p[x];
+            sum[0] += bgr[0];
+            sum[1] += bgr[1];
+            sum[2] += bgr[2];
+            ++hist[lut[((bgr[0] >> 3) << 10) | ((bgr[1] >> 3) << 5) | (bgr[2] >> 3)]];
+        }
+    }
+    ColorVote dst = { 0, 0.0, cv::Vec3b() };
+    int const pixels = area.rows * area.cols;
+    if (pixels == 0){
+        return dst;
+    }
+    dst.index = static_cast<int>(std::max_element(hist.begin(), hist.begin() + table.bgr.size()) - hist.begin());
+    dst.confidence = static_cast<double>(hist[dst.index]) / pixels;
+    for (int j = 0; j < 3; ++j){
+        dst.ave[j] = static_cast<uchar>((sum[j] + pixels / 2) / pixels);
+    }
+    return dst;
+}
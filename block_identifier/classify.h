@@ -0,0 +1,39 @@
+#pragma once
+
+#include "option.h"
+
+/*!
+色判定領域の多数決の結果
+*/
+struct ColorVote
+{
+    int index; ///< 最も多くの画素が分類された色の番号(Option::colorsの順序)
+    double confidence; ///< その色に分類された画素の割合(0から1)
+    cv::Vec3b ave; ///< 平均色
+};
+
+/*!
+bgrから画素ごとの判定に使う表を作る
+@param[in,out] table 色判定用のテーブル。bgrを設定しておく
+*/
+void packColorTable(ColorTable & table);
+
+/*!
+最も近い色を返す
+SSE2が使えるときは4色ずつまとめて距離を求める
+@param[in] bgr BGR値
+@param[in] table 色判定用のテーブル
+@return 色の番号(Option::colorsの順序)。距離が同じなら番号の小さい方
+*/
+int nearestColor(cv::Vec3b bgr, ColorTable const & table);
+
+/*!
+色判定領域の画素を1つずつ最も近い色に分類し、多数決で色を決める
+照明の反射や影の境目で平均色がずれても、領域の大半が同じ色なら正しく判定できる
+画素の分類はpackColorTableで作った表を引くだけなので、平均色を求めるのと同程度の速さ
+BGRを各5ビットに量子化するため、色の境界から4階調以内の画素は隣の色に分類されることがある
+@param[in] area 色判定領域(CV_8UC3)
+@param[in] table 色判定用のテーブル
+@return 多数決の結果。画素がなければindexは0、confidenceは0
+*/
+ColorVote voteColor(cv::Mat const & area, ColorTable const & table);
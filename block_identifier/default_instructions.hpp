@@ -1,25 +1,25 @@
-{ Block{ "blue", 2 }, Instruction{ "object-ghost", Params{ { "lifetime", 5 } } } }, // 青[2]:おばけ
-{ Block{ "blue", 3 }, Instruction{ "filter-swaying", Params{} } }, // 青[3]:メトロノーム
-{ Block{ "blue", 4 }, Instruction{ "filter-bk-wave", Params{} } }, // 青[4]:海
-{ Block{ "blue", 6 }, Instruction{ "ctrl-filter-clear", Params{} } }, // 青[6]:フィルタークリア
-{ Block{ "white", 2 }, Instruction{ "object-snowman", Params{ { "lifetime", 5 } } } }, // 白[2]:ハート
-{ Block{ "white", 3 }, Instruction{ "filter-rolldown", Params{} } }, // 白[3]:上からくりかえしスクロール
-{ Block{ "white", 4 }, Instruction{ "filter-bk-snows", Params{} } }, // 白[4]:雪
-{ Block{ "green", 2 }, Instruction{ "object-tree", Params{ { "lifetime", 5 } } } }, // 緑[2]:もみの木
-{ Block{ "green", 3 }, Instruction{ "filter-zoom", Params{} } }, // 緑[3]:Zoominandout
-{ Block{ "green", 4 }, Instruction{ "filter-bk-mountain", Params{} } }, // 緑[4]:山
-{ Block{ "yellowgreen", 2 }, Instruction{ "object-yacht", Params{ { "lifetime", 5 } } } }, // 黄緑[2]:ヨット
-{ Block{ "yellowgreen", 3 }, Instruction{ "filter-flat-wave", Params{} } }, // 黄緑[3]:ペラペラ
-{ Block{ "yellowgreen", 4 }, Instruction{ "filter-bk-grass", Params{} } }, // 黄緑[4]:草原
-{ Block{ "yellow", 2 }, Instruction{ "object-star", Params{ { "lifetime", 5 } } } }, // 黄色[2]:星
-{ Block{ "yellow", 3 }, Instruction{ "filter-skewed", Params{} } }, // 黄色[3]:y軸回転
-{ Block{ "yellow", 4 }, Instruction{ "filter-bk-stars", Params{} } }, // 黄色[4]:星空
-{ Block{ "orange", 2 }, Instruction{ "object-note", Params{ { "lifetime", 5 } } } }, // オレンジ[2]:音符
-{ Block{ "orange", 3 }, Instruction{ "filter-rainbow", Params{} } }, // オレンジ[3]:虹
-{ Block{ "orange", 4 }, Instruction{ "filter-bk-fireworks", Params{} } }, // オレンジ[4]:花火
-{ Block{ "brown", 2 }, Instruction{ "object-socks", Params{ { "lifetime", 5 } } } }, // 茶色[2]:靴下
-{ Block{ "brown", 3 }, Instruction{ "filter-spiral", Params{} } }, // 茶色[3]:スパイラル
-{ Block{ "brown", 4 }, Instruction{ "filter-bk-cloud", Params{} } }, // 茶色[4]:雲
-{ Block{ "red", 2 }, Instruction{ "object-heart", Params{ { "lifetime", 5 } } } }, // 赤[2]:雪だるま
-{ Block{ "red", 3 }, Instruction{ "filter-jump", Params{} } }, // 赤[3]:ジャンプ
-{ Block{ "red", 4 }, Instruction{ "filter-bk-sakura", Params{} } }, // 赤[4]:桜吹雪
+{ "blue", 2, "object-ghost", "lifetime", 5 }, // 青[2]:おばけ
+{ "blue", 3, "filter-swaying", nullptr, 0 }, // 青[3]:メトロノーム
+{ "blue", 4, "filter-bk-wave", nullptr, 0 }, // 青[4]:海
+{ "blue", 6, "ctrl-filter-clear", nullptr, 0 }, // 青[6]:フィルタークリア
+{ "white", 2, "object-snowman", "lifetime", 5 }, // 白[2]:ハート
+{ "white", 3, "filter-rolldown", nullptr, 0 }, // 白[3]:上からくりかえしスクロール
+{ "white", 4, "filter-bk-snows", nullptr, 0 }, // 白[4]:雪
+{ "green", 2, "object-tree", "lifetime", 5 }, // 緑[2]:もみの木
+{ "green", 3, "filter-zoom", nullptr, 0 }, // 緑[3]:Zoominandout
+{ "green", 4, "filter-bk-mountain", nullptr, 0 }, // 緑[4]:山
+{ "yellowgreen", 2, "object-yacht", "lifetime", 5 }, // 黄緑[2]:ヨット
+{ "yellowgreen", 3, "filter-flat-wave", nullptr, 0 }, // 黄緑[3]:ペラペラ
+{ "yellowgreen", 4, "filter-bk-grass", nullptr, 0 }, // 黄緑[4]:草原
+{ "yellow", 2, "object-star", "lifetime", 5 }, // 黄色[2]:星
+{ "yellow", 3, "filter-skewed", nullptr, 0 }, // 黄色[3]:y軸回転
+{ "yellow", 4, "filter-bk-stars", nullptr, 0 }, // 黄色[4]:星空
+{ "orange", 2, "object-note", "lifetime", 5 }, // オレンジ[2]:音符
+{ "orange", 3, "filter-rainbow", nullptr, 0 }, // オレンジ[3]:虹
+{ "orange", 4, "filter-bk-fireworks", nullptr, 0 }, // オレンジ[4]:花火
+{ "brown", 2, "object-socks", "lifetime", 5 }, // 茶色[2]:靴下
+{ "brown", 3, "filter-spiral", nullptr, 0 }, // 茶色[3]:スパイラル
+{ "brown", 4, "filter-bk-cloud", nullptr, 0 }, // 茶色[4]:雲
+{ "red", 2, "object-heart", "lifetime", 5 }, // 赤[2]:雪だるま
+{ "red", 3, "filter-jump", nullptr, 0 }, // 赤[3]:ジャンプ
+{ "red", 4, "filter-bk-sakura", nullptr, 0 }, // 赤[4]:桜吹雪
@@ -0,0 +1,106 @@
+#include "frame_source.h"
+#include "governor.h"
+#include "identify.h"
+#include "scene.h"
+#include "metrics.h"
+#include "trace.h"
+#include "log.h"
+#include <thread>
+
+namespace {
+    /*!
+    カメラ画像を取得し、縮尺と向きを変換する
+    */
+    class CameraSource : public FrameSource
+    {
+        typedef std::chrono::steady_clock clock_type;
+        cv::VideoCapture cap_;
+        FrameGovernor * governor_;
+    public:
+        explicit CameraSource(FrameGovernor * governor)
+            : governor_(governor)
+        {
+        }
+        /*!
+        カメラを開く
+        @param[in] device_id カメラデバイスID
+        @param[in] opt オプション
+        @retval true 成功
+        @retval false 失敗
+        */
+        bool open(int device_id, Option const & opt)
+        {
+            if (!cap_.open(device_id)){
+                LOG_ERROR("camera", "failed to open camera device.");
+                return false;
+            }
+            // CV_CAP_PROP_GAIN
+            cap_.set(CV_CAP_PROP_FRAME_WIDTH, opt.tune.camera_width);
+            cap_.set(CV_CAP_PROP_FRAME_HEIGHT, opt.tune.camera_height);
+            return true;
+        }
+        bool read(Option const & opt, cv::Mat & m, FrameStamp & frame)
+        {
+            clock_type::time_point grabbed;
+            {
+                TRACE_SCOPE("capture");
+                auto const begin = clock_type::now();
+                bool const ok = cap_.grab();
+                grabbed = clock_type::now();
+                if (ok && governor_ && !governor_->poll(grabbed)){
+                    // 待機中はデコードせずに捨てる
+                    return false;
+                }
+                m.release();
+                if (ok){
+                    cap_.retrieve(m);
+                }
+                Metrics::get().capture.since(begin);
+            }
+            if (m.size().area() == 0){
+                Metrics::get().dropped_frames.add();
+                LOG_ERROR("camera", "failed to get camera image.");
+                // 画面がなくても待つように、waitKeyではなくsleepする
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                return false;
+            }
+            if (governor_ && !governor_->admit(m, grabbed)){
+                return false;
+            }
+            ++frame.id;
+            frame.captured = grabbed;
+            preprocessImage(opt, m);
+            return true;
+        }
+    };
+
+    /*!
+    ランダムに積んだブロックのテスト画像を作る
+    */
+    class TestImageSource : public FrameSource
+    {
+    public:
+        bool read(Option const & opt, cv::Mat & m, FrameStamp & frame)
+        {
+            // オプションが変わっても反映されるように毎回作る
+            m = SceneGenerator(opt, SceneParams(), 0).generate(frame.id).image;
+            ++frame.id;
+            frame.captured = std::chrono::steady_clock::now();
+            return true;
+        }
+    };
+}
+
+std::unique_ptr<FrameSource> createCameraSource(int device_id, Option const & opt, FrameGovernor * governor)
+{
+    std::unique_ptr<CameraSource> source(new CameraSource(governor));
+    if (!source->open(device_id, opt)){
+        return nullptr;
+    }
+    return std::move(source);
+}
+
+std::unique_ptr<FrameSource> createTestImageSource()
+{
+    return std::unique_ptr<FrameSource>(new TestImageSource());
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "option.h"
+#include <memory>
+
+class FrameGovernor;
+
+/*!
+ブロック認識に渡すフレームの取得元
+*/
+class FrameSource
+{
+public:
+    virtual ~FrameSource() {}
+    /*!
+    次のフレームを取得する
+    @param[in] opt オプション
+    @param[out] image 縮尺と向きを変換したカメラ画像
+    @param[in,out] frame フレームの識別情報。成功したら次のフレームに更新する
+    @retval true 成功
+    @retval false 失敗か、間引いたフレーム。これ以上フレームがなければeof()がtrueになる
+    */
+    virtual bool read(Option const & opt, cv::Mat & image, FrameStamp & frame) = 0;
+    /*!
+    @retval true これ以上フレームがない
+    */
+    virtual bool eof() const { return false; }
+};
+
+/*!
+カメラを開く
+@param[in] device_id カメラデバイスID
+@param[in] opt オプション
+@param[in] governor 何も起きていないときにフレームを間引く。nullptrなら間引かない。取得元より長く生かすこと
+@return フレームの取得元。開けなかったらnullptr
+*/
+std::unique_ptr<FrameSource> createCameraSource(int device_id, Option const & opt, FrameGovernor * governor = nullptr);
+
+/*!
+テスト画像を作る
+カメラがなくても開発をするため。
+@return フレームの取得元
+*/
+std::unique_ptr<FrameSource> createTestImageSource();
@@ -0,0 +1,99 @@
+#include "governor.h"
+#include "metrics.h"
+#include "trace.h"
+#include "log.h"
+
+namespace {
+    /*!
+    動きを調べる縮小画像の幅
+    センサーのノイズは縮小で平均される
+    */
+    int const MOTION_WIDTH = 80;
+}
+
+FrameGovernor::FrameGovernor(GovernorConfig const & config, clock_type::time_point now)
+    : config_(config)
+    , idle_after_(std::chrono::milliseconds(config.idle_after_ms))
+    , check_interval_(std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / config.idle_fps)))
+    , woken_(false)
+    , idle_(false)
+    , last_motion_(now)
+    , next_check_(now)
+{
+    if (config.idle_after_ms <= 0 || config.idle_fps <= 0){
+        throw std::runtime_error("idle period and idle fps should be positive.");
+    }
+}
+
+void FrameGovernor::resume(char const * reason)
+{
+    idle_ = false;
+    Metrics::get().governor_wakeups.add();
+    LOG_INFO("governor", "resumed by %s", reason);
+}
+
+bool FrameGovernor::poll(clock_type::time_point now)
+{
+    if (woken_.load(std::memory_order_acquire) && woken_.exchange(false, std::memory_order_acq_rel)){
+        last_motion_ = now;
+        if (idle_){
+            resume("trigger");
+        }
+    }
+    if (!idle_ || next_check_ <= now){
+        return true;
+    }
+    Metrics::get().idle_frames.add();
+    return false;
+}
+
+bool FrameGovernor::admit(cv::Mat const & image, clock_type::time_point now)
+{
+    if (next_check_ <= now){
+        next_check_ = now + check_interval_;
+        bool moved;
+        {
+            TRACE_SCOPE("detectMotion");
+            moved = detectMotion(reference_, image, config_);
+        }
+        if (moved){
+            last_motion_ = now;
+            if (idle_){
+                // 動きを見つけたこのフレームから認識する
+                resume("motion");
+                return true;
+            }
+        }
+    }
+    if (idle_){
+        Metrics::get().idle_frames.add();
+        return false;
+    }
+    if (idle_after_ <= now - last_motion_){
+        idle_ = true;
+        LOG_INFO("governor", "idle after %.1fs without motion", std::chrono::duration<double>(now - last_motion_).count());
+    }
+    return true;
+}
+
+bool FrameGovernor::detectMotion(cv::Mat & reference, cv::Mat const & image, GovernorConfig const & config)
+{
+    int const width = std::min(MOTION_WIDTH, image.cols);
+    int const height = std::max(1, image.rows * width / std::max(1, image.cols));
+    cv::Mat small;
+    cv::resize(image, small, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    bool moved = false;
+    if (reference.size() == small.size()){
+        // 明るさが近い色のブロックも見つけるよう、グレーではなくチャンネルごとの差の最大値を使う
+        cv::Mat diff;
+        std::vector<cv::Mat> channels;
+        cv::absdiff(small, reference, diff);
+        cv::split(diff, channels);
+        cv::max(channels[0], channels[1], diff);
+        cv::max(diff, channels[2], diff);
+        cv::threshold(diff, diff, config.pixel_th, 255, cv::THRESH_BINARY);
+        moved = config.motion_ratio * diff.total() < cv::countNonZero(diff);
+    }
+    reference = small;
+    return moved;
+}
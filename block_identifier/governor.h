@@ -0,0 +1,82 @@
+#pragma once
+
+#include "option.h"
+#include <atomic>
+#include <chrono>
+
+/*!
+フレームレートの調整の設定
+*/
+struct GovernorConfig
+{
+    int idle_after_ms = 30000; ///< 動きがないままこの時間が過ぎたら待機する(0なら待機しない)
+    double idle_fps = 2; ///< 待機中に動きを調べる1秒あたりの回数。待機していなくてもこの頻度で調べる
+    int pixel_th = 24; ///< 縮小した画像で、いずれかのチャンネルがこの値より変わった画素を動いたとみなす
+    double motion_ratio = 0.002; ///< 動いた画素がこの割合を超えたら動きがあるとみなす
+};
+
+/*!
+何も起きていないときにカメラ画像の処理を間引くクラス
+動きがないままidle_after_msが過ぎると待機し、フレームの取り込みは続けるが
+idle_fpsの頻度でしか画像を取り出さず、縮小画像で動きを調べるだけにする
+動きを見つけたフレームかトリガーの直後のフレームから通常の処理に戻る
+
+poll、admitはフレームを取得するスレッドから、wakeは任意のスレッドから呼ぶ
+*/
+class FrameGovernor
+{
+    FrameGovernor & operator=(FrameGovernor const &) = delete;
+    FrameGovernor(FrameGovernor const &) = delete;
+public:
+    typedef std::chrono::steady_clock clock_type;
+private:
+    GovernorConfig const config_;
+    clock_type::duration const idle_after_;
+    clock_type::duration const check_interval_;
+    std::atomic<bool> woken_;
+    bool idle_;
+    clock_type::time_point last_motion_; ///< 最後に動きかトリガーがあった時刻
+    clock_type::time_point next_check_; ///< 次に動きを調べる時刻
+    cv::Mat reference_; ///< 前回動きを調べた縮小画像
+
+    /*!
+    待機をやめる
+    @param[in] reason 理由
+    */
+    void resume(char const * reason);
+public:
+    /*!
+    @param[in] config 設定
+    @param[in] now 現在時刻。この時刻から動きがないとみなす
+    */
+    explicit FrameGovernor(GovernorConfig const & config, clock_type::time_point now = clock_type::now());
+    /*!
+    取り込んだフレームを画像として取り出すかどうかを決める
+    @param[in] now フレームを取り込んだ時刻
+    @return falseならデコードせずに捨てる
+    */
+    bool poll(clock_type::time_point now);
+    /*!
+    取り出した画像に動きがあるか調べ、待機と通常を切り替える
+    @param[in] image 取り出したカメラ画像(縮尺と向きの変換前)
+    @param[in] now フレームを取り込んだ時刻
+    @return trueならブロック認識に回す
+    */
+    bool admit(cv::Mat const & image, clock_type::time_point now);
+    /*!
+    次に取り込むフレームから通常の処理に戻す。トリガーが来たときに呼ぶ
+    */
+    void wake() { woken_.store(true, std::memory_order_release); }
+    /*!
+    @retval true 待機中
+    */
+    bool idle() const { return idle_; }
+    /*!
+    2枚の画像の間に動きがあるか調べる
+    @param[in,out] reference 前回の縮小画像。今回の縮小画像に置き換える。空なら動きなし
+    @param[in] image カメラ画像
+    @param[in] config 設定
+    @return 動きがあればtrue
+    */
+    static bool detectMotion(cv::Mat & reference, cv::Mat const & image, GovernorConfig const & config);
+};
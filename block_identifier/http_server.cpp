@@ -0,0 +1,96 @@
+#include "http_server.h"
+#include "log.h"
+#include <boost/asio.hpp>
+#include <boost/format.hpp>
+#include <iostream>
+
+struct HttpServer::Impl
+{
+    boost::asio::io_service & io_service;
+    boost::asio::ip::tcp::acceptor acceptor;
+    Impl(boost::asio::io_service & io_service, int port)
+        : io_service(io_service)
+        , acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), static_cast<unsigned short>(port)))
+    {
+    }
+};
+
+namespace {
+    char const * reason(int status)
+    {
+        switch (status){
+        case 200: return "OK";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 503: return "Service Unavailable";
+        default: return "Internal Server Error";
+        }
+    }
+}
+
+HttpServer::HttpServer(boost::asio::io_service & io_service, int port)
+    : impl_(std::make_shared<Impl>(io_service, port))
+{
+}
+
+void HttpServer::route(std::string const & path, Handler handler)
+{
+    routes_[path] = handler;
+}
+
+void HttpServer::stream(std::string const & path, StreamHandler handler)
+{
+    streams_[path] = handler;
+}
+
+void HttpServer::start()
+{
+    accept();
+}
+
+void HttpServer::accept()
+{
+    auto self = shared_from_this();
+    auto sock = std::make_shared<boost::asio::ip::tcp::socket>(impl_->io_service);
+    impl_->acceptor.async_accept(*sock, [self, sock](boost::system::error_code const & ec){
+        if (ec){
+            LOG_WARN("http", "%s", ec.message());
+            return;
+        }
+        auto request = std::make_shared<boost::asio::streambuf>();
+        boost::asio::async_read_until(*sock, *request, "\r\n\r\n", [self, sock, request](boost::system::error_code const & ec, size_t){
+            if (ec){
+                return;
+            }
+            std::istream req_s(request.get());
+            std::string method, path;
+            req_s >> method >> path;
+            auto const stream = self->streams_.find(path.substr(0, path.find('?')));
+            if (stream != self->streams_.end()){
+                stream->second(method, sock);
+                return;
+            }
+            auto const route = self->routes_.find(path.substr(0, path.find('?')));
+            HttpResponse res = { 404, "text/plain", "" };
+            if (route != self->routes_.end()){
+                try{
+                    res = route->second(method);
+                }
+                catch (std::exception const & e){
+                    res = { 500, "text/plain", e.what() };
+                }
+            }
+            auto response = std::make_shared<std::string>((boost::format(
+                "HTTP/1.1 %d %s\r\n"
+                "Content-Type: %s\r\n"
+                "Content-Length: %d\r\n"
+                "Connection: Close\r\n"
+                "\r\n") % res.status % reason(res.status) % res.content_type % res.body.size()).str() + res.body);
+            boost::asio::async_write(*sock, boost::asio::buffer(*response), [sock, response](boost::system::error_code const &, size_t){
+                boost::system::error_code ignored;
+                sock->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+            });
+        });
+        self->accept();
+    });
+}
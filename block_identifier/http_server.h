@@ -0,0 +1,55 @@
+#pragma once
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+/*!
+HTTPレスポンス
+*/
+struct HttpResponse
+{
+    int status; ///< ステータスコード
+    std::string content_type; ///< Content-Type
+    std::string body; ///< 本文
+};
+
+/*!
+ローカルホストからの要求だけを受け付ける小さなHTTPサーバ
+1要求ごとに接続を閉じる。ハンドラはio_serviceのスレッドで呼ばれる
+ストリームのハンドラには要求ヘッダーを読んだ後の接続を渡すので、応答を書き続けられる
+*/
+class HttpServer : public std::enable_shared_from_this<HttpServer>
+{
+public:
+    typedef std::function<HttpResponse(std::string const & method)> Handler;
+    typedef std::function<void(std::string const & method, std::shared_ptr<boost::asio::ip::tcp::socket> sock)> StreamHandler;
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl_;
+    std::map<std::string, Handler> routes_;
+    std::map<std::string, StreamHandler> streams_;
+    void accept();
+public:
+    /*!
+    @param[in] io_service 要求を処理するio_service
+    @param[in] port ポート番号
+    */
+    HttpServer(boost::asio::io_service & io_service, int port);
+    /*!
+    パスにハンドラを登録する
+    */
+    void route(std::string const & path, Handler handler);
+    /*!
+    パスにストリームのハンドラを登録する
+    ハンドラは接続を受け取り、応答を書いて閉じるまで持つ
+    */
+    void stream(std::string const & path, StreamHandler handler);
+    /*!
+    要求の受け付けを開始する
+    */
+    void start();
+};
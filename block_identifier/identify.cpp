@@ -1,7 +1,14 @@
 #include "identify.h"
+#include "segment.h"
+#include "classify.h"
+#include "trace.h"
 #include <boost/format.hpp>
+#include <atomic>
+#include <memory>
 
 namespace {
+    std::atomic<bool> low_memory(false);
+
     /*!
     上端、下端
     */
@@ -35,7 +42,10 @@ namespace {
         IdentifyBlock & operator = (const IdentifyBlock &) = delete;
 
         cv::Mat const image_;
-        Option const opt_;
+        Option const & opt_;
+        IdentifyCache const * cache_; ///< 2値化の閾値より前の中間結果。nullptrなら画像から求める
+        IdentifyState * state_; ///< フレームをまたいで引き継ぐ状態。nullptrなら使わない
+        Histogram histogram_; ///< bin_thを自動で決めるときに2値化と同時に数えるヒストグラム
 
         /*!
          輪郭2値画像の上端、下端を返す
@@ -49,111 +59,134 @@ namespace {
             cv::reduce(bin, m, 1, CV_REDUCE_AVG);
             m = m.t();
             TopBottom dst;
-            for (dst.top = 0; m.data[dst.top] < opt_.tune.stud_th; dst.top++);
-            for (dst.bottom = m.cols - 1; m.data[dst.bottom] < opt_.tune.stud_th; dst.bottom--);
+            for (dst.top = 0; dst.top < m.cols && m.data[dst.top] < opt_.tune.stud_th; dst.top++);
+            for (dst.bottom = m.cols - 1; 0 <= dst.bottom && m.data[dst.bottom] < opt_.tune.stud_th; dst.bottom--);
             return dst;
         }
 
         /*!
-        ブロック情報の画像を表示する
-        @param[in] blockInfo ブロック情報
+        オプションで選んだ2値化の方法を作る
+        背景差分なら、ここで背景モデルを更新する
+        @return 2値化の方法
         */
-        void showBlockInfo(std::vector<BlockInfo> const & blockInfo)
+        std::unique_ptr<Segmenter> createSegmenter()
         {
-            auto to_instname = [this](Block const & block){
-                auto inst = opt_.block2inst.find(block);
-                return inst == opt_.block2inst.end() ? "unknown" : inst->second.name;
-            };
-            cv::Mat canvas = cv::Mat::zeros(image_.rows, image_.cols * 2, CV_8UC3);
-            image_.copyTo(canvas(cv::Rect(0, 0, image_.cols, image_.rows)));
-            for (auto info : blockInfo){
-                cv::rectangle(canvas, info.rc, cv::Scalar(0, 255, 0), 1);
-                cv::rectangle(canvas, info.color_area, cv::Scalar(255, 0, 255), 1);
-                auto instname = to_instname(info.to_block());
-                auto v = info.color.bgr;
-                auto f = boost::format("%d:%s %02X %02X %02X") % info.width % info.color.name % (int)info.ave[2] % (int)info.ave[1] % (int)info.ave[0];
-                cv::putText(canvas, f.str(), cv::Point2f(image_.cols * 1.1f, info.rc.y + info.rc.height * 0.4f), cv::FONT_HERSHEY_DUPLEX, 0.7, cv::Scalar(v[0], v[1], v[2]));
-                cv::putText(canvas, instname, cv::Point2f(image_.cols * 1.1f, info.rc.y + info.rc.height * 0.9f), cv::FONT_HERSHEY_DUPLEX, 0.7, cv::Scalar(v[0], v[1], v[2]));
+            if (cache_){
+                return std::unique_ptr<Segmenter>(new MixedSegmenter(cache_->mixed, cache_->small, opt_.tune.bin_th));
+            }
+            cv::Mat foreground;
+            if (opt_.tune.segmentation == SEGMENT_BACKGROUND && state_ && state_->background.apply(image_, opt_.tune.background_th, foreground)){
+                return std::unique_ptr<Segmenter>(new MaskSegmenter(foreground));
+            }
+            if (autoThreshold()){
+                return std::unique_ptr<Segmenter>(new HlsSegmenter(image_, state_->threshold.get(opt_.tune.bin_th), &histogram_));
             }
-            cv::imshow("blocks", canvas);
+            return std::unique_ptr<Segmenter>(new HlsSegmenter(image_, opt_.tune.bin_th));
         }
+
         /*!
-        このプログラムが認識する色の中で最も近い色を返す
-        @param[in] bgr BGR値
-        @return 最も近い色
+        @retval true bin_thを自動で決める
         */
-        Color getColor(cv::Vec3b bgr)
+        bool autoThreshold() const
         {
-            double len2 = 100000;
-            Color dst;
-            auto calcLen2 = [](cv::Vec3b v0, cv::Vec3b v1){
-                double d = 0;
-                for (int i = 0; i < 3; ++i){
-                    d += (v0[i] - v1[i]) * (v0[i] - v1[i]);
-                }
-                return d;
-            };
-            for (auto c : opt_.colors){
-                auto len = calcLen2(bgr, c.bgr);
-                if (len < len2){
-                    len2 = len;
-                    dst = c;
-                }
-            }
-            return dst;
+            return state_ && opt_.tune.auto_bin_th && !cache_;
         }
+
         /*!
         カメラの画像からブロックの輪郭を抽出する
+        @param[in] segmenter 2値化の方法
         @return ブロックの輪郭
         */
-        std::vector<cv::Point> getBlockContour()
+        std::vector<cv::Point> getBlockContour(Segmenter const & segmenter)
         {
-            cv::Mat hls;
-            cv::cvtColor(image_, hls, CV_BGR2HLS);
-            std::vector<cv::Mat> v;
-            cv::split(hls, v);
-            auto l = v[1];
-            auto s = v[2];
-            double slratio = 0.5;
-            auto mixed = slratio * l + (1 - slratio) * s;
-            cv::Mat block;
-            cv::threshold(mixed, block, opt_.tune.bin_th, 255, cv::THRESH_BINARY);
-            typedef std::vector<cv::Point> contour_t;
-            std::vector<contour_t> contours;
-            cv::findContours(block, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
-            // 一番面積の広い領域がブロックと判断する。ただし画像サイズ並みの面積だった場合は除外
-            contour_t cach;
-            double maxArea = -1;
-            for (auto points : contours){
-                double area = cv::contourArea(points);
-                if (maxArea < area && area < image_.size().area() * 0.9){
-                    maxArea = area;
-                    cach = points;
+            int const f = opt_.tune.pyramid;
+            auto points = segmenter.contour(f);
+            if (1 < f){
+                // 縮小した画像で探し、元の解像度の座標に戻す。境界はrefineEdgesで合わせる
+                for (auto & p : points){
+                    p = cv::Point(std::min(p.x * f + f / 2, image_.cols - 1), std::min(p.y * f + f / 2, image_.rows - 1));
                 }
             }
-            return cach;
+            return points;
         }
         /*!
-        画像内の指定した矩形の全ブロック情報を取得する
-        @param[in] points ブロックの矩形
+        縮小した画像で求めた輪郭の近くだけを元の解像度で2値化し直す
+        輪郭から縮小率の幅の帯の中だけを調べるので、上端・下端と各段の左右の端が元の解像度で決まる
+        @param[in] segmenter 2値化の方法
+        @param[in] points 縮小した画像で求めた輪郭(元の解像度の座標)
+        @param[in,out] bin 輪郭の内側を塗りつぶした画像
+        */
+        void refineEdges(Segmenter const & segmenter, std::vector<cv::Point> const & points, cv::Mat & bin)
+        {
+            int const f = opt_.tune.pyramid;
+            cv::Mat band = cv::Mat::zeros(bin.size(), CV_8UC1);
+            std::vector<std::vector<cv::Point>> contours = { points };
+            cv::drawContours(band, contours, 0, 255, 2 * f + 1);
+            cv::Rect const all(0, 0, bin.cols, bin.rows);
+            cv::Mat fine;
+            for (size_t i = 0; i < points.size(); ++i){
+                auto const a = points[i];
+                auto const b = points[(i + 1) % points.size()];
+                // 斜めの辺で外接矩形が大きくならないように区切る
+                int const steps = std::max(1, std::max(std::abs(b.x - a.x), std::abs(b.y - a.y)) / (8 * f));
+                for (int s = 0; s < steps; ++s){
+                    cv::Point const p(a.x + (b.x - a.x) * s / steps, a.y + (b.y - a.y) * s / steps);
+                    cv::Point const q(a.x + (b.x - a.x) * (s + 1) / steps, a.y + (b.y - a.y) * (s + 1) / steps);
+                    cv::Rect const rc = cv::Rect(std::min(p.x, q.x) - f, std::min(p.y, q.y) - f, std::abs(q.x - p.x) + 2 * f + 1, std::abs(q.y - p.y) + 2 * f + 1) & all;
+                    if (rc.area() == 0){
+                        continue;
+                    }
+                    fine.create(rc.size(), CV_8UC1);
+                    segmenter.binarize(rc, fine);
+                    fine.copyTo(bin(rc), band(rc));
+                }
+            }
+        }
+    public:
+        IdentifyBlock(cv::Mat const & image, Option const & opt, IdentifyCache const * cache, IdentifyState * state = nullptr)
+            : image_(image)
+            , opt_(opt)
+            , cache_(cache)
+            , state_(state)
+            , histogram_()
+        {
+            assert(3 == image_.channels());
+        }
+
+        /*!
+        ブロックの領域を塗りつぶした画像を作る
+        @return 背景：黒　輪郭内：白　の画像
+        */
+        cv::Mat getBlockMask()
+        {
+            auto const segmenter = createSegmenter();
+            std::vector<cv::Point> points;
+            {
+                TRACE_SCOPE("getBlockContour");
+                points = getBlockContour(*segmenter);
+            }
+            if (autoThreshold()){
+                // 背景差分で2値化したフレームではヒストグラムが空なので、閾値は変わらない
+                state_->threshold.update(opt_.tune.bin_th, histogram_);
+            }
+            cv::Mat bin = cv::Mat::zeros(image_.size(), CV_8UC1);
+            std::vector<std::vector<cv::Point>> contours = { points };
+            cv::drawContours(bin, contours, 0, 255, CV_FILLED);
+            if (1 < opt_.tune.pyramid && !points.empty()){
+                TRACE_SCOPE("refineEdges");
+                refineEdges(*segmenter, points, bin);
+            }
+            return bin;
+        }
+
+        /*!
+        ブロックの領域の全ブロック情報を取得する
+        @param[in] bin getBlockMaskで作った画像
         @return ブロック情報
         */
-        std::vector<BlockInfo> getBlockInfo(std::vector<cv::Point> const & points)
+        std::vector<BlockInfo> getBlockInfo(cv::Mat const & bin)
         {
-            /*! 背景：黒　輪郭内：黒　の画像を作る*/
-            auto const bin = [this, &points](){
-                cv::Mat bin = cv::Mat::zeros(image_.size(), CV_8UC1);
-                std::vector<std::vector<cv::Point>> contours = { points };
-                cv::drawContours(bin, contours, 0, 255, CV_FILLED);
-                return bin;
-            }();
-            /*! 画像の平均色を返す */
-            auto getAveBgr = [](cv::Mat const & src){
-                cv::Mat tmp;
-                cv::reduce(src, tmp, 1, CV_REDUCE_AVG);
-                cv::reduce(tmp, tmp, 0, CV_REDUCE_AVG);
-                return tmp.at<cv::Vec3b>(0);
-            };
+            TRACE_SCOPE("getBlockInfo");
             auto tb = getTopBottom(bin);
             std::vector<BlockInfo> dst;
             if (tb.bottom <= tb.top){
@@ -174,34 +207,120 @@ namespace {
                 if (right <= left) continue; // 計算できなかったので仕方ないからあきらめる
                 BlockInfo info;
                 info.rc = cv::Rect(left, y, right - left, opt_.tune.get_block_height());
-                info.color_area = info.rc * 0.2;
-                info.ave = getAveBgr(image_(info.color_area));
-                info.color = getColor(info.ave);
+                info.color_area = info.rc * opt_.tune.color_ratio;
+                auto const vote = voteColor(image_(info.color_area), opt_.table);
+                info.ave = vote.ave;
+                info.color = opt_.colors[vote.index];
+                info.confidence = vote.confidence;
                 info.width = (right - left + opt_.tune.get_block_width() / 2) / opt_.tune.get_block_width();
                 dst.push_back(info);
             }
             return dst;
         }
-    public:
-        IdentifyBlock(
-            cv::Mat const & image,
-            Option const & opt,
-            std::vector<BlockInfo> & blockInfo)
-            : image_(image)
-            , opt_(opt)
-        {
-            assert(3 == image_.channels());
-            auto const contour = getBlockContour();
-            blockInfo = getBlockInfo(contour);
-            showBlockInfo(blockInfo);
-        }
     };
 }
 
+void setLowMemory(bool on)
+{
+    low_memory.store(on, std::memory_order_relaxed);
+}
+
+bool lowMemory()
+{
+    return low_memory.load(std::memory_order_relaxed);
+}
+
+void preprocessImage(Option const & opt, cv::Mat & image)
+{
+    TRACE_SCOPE("resize/flip");
+    // 呼び出し側のバッファを参照する画像でも書き換えないよう、新しいバッファに書く
+    // 縮小しないときは複製せず、転置で新しいバッファに書いてからその場で上下反転する
+    cv::Mat scaled = image;
+    if (opt.tune.camera_ratio != 1){
+        cv::resize(image, scaled, cv::Size(), opt.tune.camera_ratio, opt.tune.camera_ratio);
+    }
+    cv::Mat dst;
+    cv::transpose(scaled, dst);
+    cv::flip(dst, dst, 0);
+    image = dst;
+}
+
+cv::Mat drawBlockInfo(cv::Mat const & image, Option const & opt, std::vector<BlockInfo> const & blockInfo)
+{
+    TRACE_SCOPE("drawBlockInfo");
+    auto to_instname = [&opt](Block const & block){
+        auto inst = opt.block2inst.find(block);
+        return inst == opt.block2inst.end() ? "unknown" : inst->second.name;
+    };
+    bool const compact = lowMemory();
+    cv::Mat canvas;
+    if (compact){
+        image.copyTo(canvas);
+    }
+    else{
+        canvas = cv::Mat::zeros(image.rows, image.cols * 2, CV_8UC3);
+        image.copyTo(canvas(cv::Rect(0, 0, image.cols, image.rows)));
+    }
+    // 省メモリモードではブロックの右に描く
+    auto const x = [&image, compact](BlockInfo const & info){
+        return compact ? static_cast<float>(info.rc.x + info.rc.width + 4) : image.cols * 1.1f;
+    };
+    for (auto info : blockInfo){
+        cv::rectangle(canvas, info.rc, cv::Scalar(0, 255, 0), 1);
+        cv::rectangle(canvas, info.color_area, cv::Scalar(255, 0, 255), 1);
+        auto instname = to_instname(info.to_block());
+        auto v = info.color.bgr;
+        auto f = boost::format("%d:%s %02X %02X %02X %.0f%%") % info.width % info.color.name % (int)info.ave[2] % (int)info.ave[1] % (int)info.ave[0] % (info.confidence * 100);
+        cv::putText(canvas, f.str(), cv::Point2f(x(info), info.rc.y + info.rc.height * 0.4f), cv::FONT_HERSHEY_DUPLEX, 0.7, cv::Scalar(v[0], v[1], v[2]));
+        cv::putText(canvas, instname, cv::Point2f(x(info), info.rc.y + info.rc.height * 0.9f), cv::FONT_HERSHEY_DUPLEX, 0.7, cv::Scalar(v[0], v[1], v[2]));
+    }
+    return canvas;
+}
+
+void showBlockInfo(cv::Mat const & image, Option const & opt, std::vector<BlockInfo> const & blockInfo)
+{
+    TRACE_SCOPE("showBlockInfo");
+    cv::imshow("blocks", drawBlockInfo(image, opt, blockInfo));
+}
+
 void identifyBlock(
     cv::Mat const & image,
     Option const & opt,
-    std::vector<BlockInfo> & blockInfo)
+    std::vector<BlockInfo> & blockInfo,
+    FrameStamp const & frame,
+    bool show,
+    IdentifyState * state)
+{
+    TRACE_SCOPE("identifyBlock");
+    IdentifyBlock identify(image, opt, nullptr, state);
+    blockInfo = identify.getBlockInfo(identify.getBlockMask());
+    for (auto & info : blockInfo){
+        info.frame = frame;
+    }
+    if (show){
+        showBlockInfo(image, opt, blockInfo);
+    }
+}
+
+void prepareIdentify(cv::Mat const & image, Option const & opt, IdentifyCache & cache)
+{
+    cache.pyramid = opt.tune.pyramid;
+    mixLightnessSaturation(image, cache.mixed);
+    cache.small.release();
+    if (1 < opt.tune.pyramid){
+        cv::Mat small;
+        cv::resize(image, small, cv::Size(), 1.0 / opt.tune.pyramid, 1.0 / opt.tune.pyramid, cv::INTER_AREA);
+        mixLightnessSaturation(small, cache.small);
+    }
+}
+
+cv::Mat maskBlocks(cv::Mat const & image, Option const & opt, IdentifyCache const & cache)
+{
+    assert(cache.pyramid == opt.tune.pyramid);
+    return IdentifyBlock(image, opt, &cache).getBlockMask();
+}
+
+void splitBlocks(cv::Mat const & image, cv::Mat const & mask, Option const & opt, std::vector<BlockInfo> & blockInfo)
 {
-    IdentifyBlock(image, opt, blockInfo);
+    blockInfo = IdentifyBlock(image, opt, nullptr).getBlockInfo(mask);
 }
@@ -1,6 +1,40 @@
 #pragma once
 
 #include "option.h"
+#include "background.h"
+#include "threshold.h"
+
+/*!
+フレームをまたいで引き継ぐ認識の状態
+同じカメラの画像を続けて認識するときに、カメラごとに1つ作って渡す
+並列に認識するフレームから同時に使ってよい
+*/
+struct IdentifyState
+{
+    BackgroundModel background; ///< segmentationがSEGMENT_BACKGROUNDのときの背景
+    AutoThreshold threshold; ///< auto_bin_thのときに自動で決めたbin_th
+};
+
+/*!
+省メモリモードを切り替える
+省メモリモードでは、認識結果を描いた画像を元の画像と同じ大きさにする
+並列に認識を始める前に呼ぶこと
+@param[in] on trueなら省メモリモード
+*/
+void setLowMemory(bool on);
+
+/*!
+@retval true 省メモリモード
+*/
+bool lowMemory();
+
+/*!
+カメラ画像の縮尺と向きを変換する
+元の画像のバッファには書き込まない
+@param[in] opt オプション
+@param[in,out] image カメラ画像。変換した画像に置き換える
+*/
+void preprocessImage(Option const & opt, cv::Mat & image);
 
 /*!
 カメラ画像取得後のメイン処理
@@ -8,8 +42,73 @@
 @param[in] image カメラ画像 or デバッグ画像
 @param[in] opt オプション
 @param[in] blockInfo 判定したブロック情報の書き込み先
+@param[in] frame フレームの識別情報。ブロック情報に記録する
+@param[in] show trueなら認識結果を画面に表示する
+@param[in,out] state フレームをまたいで引き継ぐ状態。背景差分とbin_thの自動決定に使う
+nullptrなら背景差分は使わずにHLSで2値化し、bin_thはオプションの値を使う
 */
 void identifyBlock(
     cv::Mat const & image,
     Option const & opt,
-    std::vector<BlockInfo> & blockInfo);
+    std::vector<BlockInfo> & blockInfo,
+    FrameStamp const & frame = FrameStamp(),
+    bool show = true,
+    IdentifyState * state = nullptr);
+
+/*!
+ブロック認識の中間結果のうち、2値化の閾値によらないもの
+閾値や後段のパラメータだけを変えて同じ画像を何度も認識するときに使い回す
+*/
+struct IdentifyCache
+{
+    int pyramid = 1; ///< 作ったときのTuning::pyramid
+    cv::Mat mixed; ///< 画像のHLSのLとSの平均
+    cv::Mat small; ///< pyramidで縮小した画像のLとSの平均(pyramidが1なら空)
+};
+
+/*!
+画像の中間結果を求める
+@param[in] image カメラ画像(preprocessImageの後)
+@param[in] opt オプション。pyramidを使う
+@param[out] cache 中間結果
+*/
+void prepareIdentify(cv::Mat const & image, Option const & opt, IdentifyCache & cache);
+
+/*!
+identifyBlockの前半。ブロックの領域を塗りつぶした画像を作る
+結果はbin_thとpyramidだけで決まるので、後段のパラメータが違う認識で使い回せる
+@param[in] image カメラ画像
+@param[in] opt オプション
+@param[in] cache prepareIdentifyで求めた中間結果。optと同じpyramidで求めておく
+@return ブロックの領域を255、それ以外を0とした画像
+*/
+cv::Mat maskBlocks(cv::Mat const & image, Option const & opt, IdentifyCache const & cache);
+
+/*!
+identifyBlockの後半。ブロックの領域を段に分け、幅と色を判定する
+@param[in] image カメラ画像
+@param[in] mask maskBlocksで作った画像
+@param[in] opt オプション。stud_th、size_th、ブロックの大きさ、color_ratio、色を使う
+@param[out] blockInfo 判定したブロック情報の書き込み先
+*/
+void splitBlocks(cv::Mat const & image, cv::Mat const & mask, Option const & opt, std::vector<BlockInfo> & blockInfo);
+
+/*!
+認識結果を描いた画像を作る
+左に認識した画像と矩形、右に色と命令名を描く
+省メモリモードでは、色と命令名も認識した画像の上に描く
+@param[in] image 認識した画像
+@param[in] opt オプション
+@param[in] blockInfo ブロック情報
+@return 認識した画像の2倍の幅の画像。省メモリモードでは同じ幅の画像
+*/
+cv::Mat drawBlockInfo(cv::Mat const & image, Option const & opt, std::vector<BlockInfo> const & blockInfo);
+
+/*!
+認識結果を画面に表示する
+画面の操作はメインスレッドで行うこと
+@param[in] image 認識した画像
+@param[in] opt オプション
+@param[in] blockInfo ブロック情報
+*/
+void showBlockInfo(cv::Mat const & image, Option const & opt, std::vector<BlockInfo> const & blockInfo);
@@ -0,0 +1,411 @@
+#include "log.h"
+#include "metrics.h"
+#include "picojson.h"
+#include "thread_local_ptr.h"
+#include <boost/format.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+std::atomic<int> Log::level_(static_cast<int>(LogLevel::info));
+
+/*!
+ログの呼び出し箇所ごとの件数
+*/
+struct LogSiteCounter
+{
+    std::atomic<int64_t> second; ///< 数えている秒
+    std::atomic<uint32_t> count; ///< secondの間に書いた件数
+    std::atomic<uint32_t> suppressed; ///< 捨てた件数
+    LogSiteCounter() : second(0), count(0), suppressed(0) {}
+};
+
+namespace {
+    /*!
+    書き出す間隔
+    */
+    std::chrono::milliseconds const FLUSH_INTERVAL(10);
+
+    /*!
+    スレッドごとのリングバッファ
+    書くのは所有スレッド、読むのはバックグラウンドのスレッドだけ
+    */
+    struct Ring
+    {
+        static size_t const SIZE = 1 << 10;
+        std::vector<LogRecord> records;
+        std::atomic<size_t> head; ///< 所有スレッドが次に書く位置
+        std::atomic<size_t> tail; ///< バックグラウンドのスレッドが次に読む位置
+        int tid;
+        std::string name; ///< Logger::mutexで保護する
+        Ring(int tid) : records(SIZE), head(0), tail(0), tid(tid) {}
+    };
+
+    /*!
+    書式化して書き出す記録
+    */
+    struct Entry
+    {
+        LogRecord record;
+        std::shared_ptr<Ring> ring;
+    };
+
+    char const * levelName(LogLevel level)
+    {
+        switch (level){
+        case LogLevel::debug: return "debug";
+        case LogLevel::info: return "info";
+        case LogLevel::warn: return "warn";
+        default: return "error";
+        }
+    }
+
+    /*!
+    文字列の引数を取り出す。切り詰めていれば元の長さを付ける
+    */
+    std::string textOf(LogRecord const & record, LogArg const & arg)
+    {
+        std::string dst(record.text + arg.s.offset, arg.s.length);
+        if (arg.s.length < arg.s.original){
+            dst += (boost::format("...(%d bytes)") % arg.s.original).str();
+        }
+        return dst;
+    }
+
+    /*!
+    記録を書式化する
+    */
+    std::string formatMessage(LogRecord const & record)
+    {
+        boost::format f(record.site->format);
+        f.exceptions(boost::io::all_error_bits ^ (boost::io::too_many_args_bit | boost::io::too_few_args_bit));
+        for (int i = 0; i < record.count; ++i){
+            auto const & arg = record.args[i];
+            switch (arg.type){
+            case LogArg::INT: f % arg.i; break;
+            case LogArg::UINT: f % arg.u; break;
+            case LogArg::DOUBLE: f % arg.d; break;
+            case LogArg::STRING: f % textOf(record, arg); break;
+            }
+        }
+        auto dst = f.str();
+        if (0 < record.suppressed){
+            dst += (boost::format(" (%d similar messages suppressed)") % record.suppressed).str();
+        }
+        return dst;
+    }
+
+    /*!
+    ログの書き出しを行う
+    */
+    class Logger
+    {
+        std::mutex mutex_;
+        std::vector<std::shared_ptr<Ring>> rings_; ///< mutex_で保護する。スレッド終了後も残りを書き出せるように保持する
+        LogConfig config_; ///< mutex_で保護する
+        std::ofstream json_; ///< バックグラウンドのスレッドだけで使う。mutex_で保護する
+        std::condition_variable cond_;
+        bool started_; ///< mutex_で保護する
+        bool stop_; ///< mutex_で保護する。一度止めたら再開しない
+        std::thread thread_;
+
+        /*!
+        全スレッドのリングバッファから取り出し、時刻順に書き出す
+        */
+        void flush()
+        {
+            std::vector<std::shared_ptr<Ring>> rings;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                rings = rings_;
+            }
+            std::vector<Entry> entries;
+            for (auto const & r : rings){
+                auto const head = r->head.load(std::memory_order_acquire);
+                auto const tail = r->tail.load(std::memory_order_relaxed);
+                for (auto i = tail; i < head; ++i){
+                    entries.push_back(Entry{ r->records[i % Ring::SIZE], r });
+                }
+                r->tail.store(head, std::memory_order_release);
+            }
+            if (entries.empty()){
+                return;
+            }
+            std::stable_sort(entries.begin(), entries.end(), [](Entry const & a, Entry const & b){
+                return a.record.time_ns < b.record.time_ns;
+            });
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (auto const & e : entries){
+                write(e);
+            }
+            std::cout.flush();
+            if (json_.is_open()){
+                json_.flush();
+            }
+        }
+
+        /*!
+        1件を書き出す。mutex_をロックして呼ぶ
+        */
+        void write(Entry const & e)
+        {
+            auto const & record = e.record;
+            auto const message = formatMessage(record);
+            auto const thread = e.ring->name.empty() ? (boost::format("thread %d") % e.ring->tid).str() : e.ring->name;
+            std::time_t const sec = static_cast<std::time_t>(record.time_ns / 1000000000);
+            int const ms = static_cast<int>(record.time_ns / 1000000 % 1000);
+            std::tm tm;
+#if defined _WIN32 || defined _WIN64
+            localtime_s(&tm, &sec);
+#else
+            localtime_r(&sec, &tm);
+#endif // defined _WIN32 || defined _WIN64
+            if (config_.console){
+                char buf[32];
+                std::strftime(buf, sizeof(buf), "%H:%M:%S", &tm);
+                auto & os = record.site->level < LogLevel::warn ? std::cout : std::cerr;
+                os << boost::format("%s.%03d %-5s [%s] %s\n") % buf % ms % levelName(record.site->level) % thread % message;
+            }
+            if (json_.is_open()){
+                picojson::object obj;
+                picojson::array args;
+                for (int i = 0; i < record.count; ++i){
+                    auto const & arg = record.args[i];
+                    switch (arg.type){
+                    case LogArg::INT: args.push_back(picojson::value(static_cast<double>(arg.i))); break;
+                    case LogArg::UINT: args.push_back(picojson::value(static_cast<double>(arg.u))); break;
+                    case LogArg::DOUBLE: args.push_back(picojson::value(arg.d)); break;
+                    case LogArg::STRING: args.push_back(picojson::value(textOf(record, arg))); break;
+                    }
+                }
+                obj["ts"] = picojson::value(record.time_ns * 1e-9);
+                obj["level"] = picojson::value(std::string(levelName(record.site->level)));
+                obj["thread"] = picojson::value(thread);
+                obj["event"] = picojson::value(std::string(record.site->event));
+                obj["msg"] = picojson::value(message);
+                obj["args"] = picojson::value(args);
+                if (0 < record.suppressed){
+                    obj["suppressed"] = picojson::value(static_cast<double>(record.suppressed));
+                }
+                json_ << picojson::value(obj).serialize() << "\n";
+            }
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stop_){
+                cond_.wait_for(lock, FLUSH_INTERVAL);
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+        }
+    public:
+        Logger()
+            : started_(false)
+            , stop_(false)
+        {
+        }
+        ~Logger()
+        {
+            stop();
+        }
+        /*!
+        現在のスレッドのリングバッファを登録する。最初の登録でバックグラウンドのスレッドを開始する
+        */
+        std::shared_ptr<Ring> add()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto r = std::make_shared<Ring>(static_cast<int>(rings_.size() + 1));
+            rings_.push_back(r);
+            startLocked();
+            return r;
+        }
+        void startLocked()
+        {
+            if (!started_ && !stop_){
+                started_ = true;
+                thread_ = std::thread([this]{ run(); });
+            }
+        }
+        void configure(LogConfig const & config)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            config_ = config;
+            if (json_.is_open()){
+                json_.close();
+            }
+            if (!config.json_path.empty()){
+                json_.open(config.json_path, std::ios::app);
+                if (!json_){
+                    throw std::runtime_error((boost::format("failed to open log file %s") % config.json_path).str());
+                }
+            }
+            startLocked();
+        }
+        void setThreadName(Ring & r, std::string const & name)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            r.name = name;
+        }
+        void stop()
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (stop_){
+                    return;
+                }
+                stop_ = true;
+                if (!started_){
+                    return;
+                }
+            }
+            cond_.notify_one();
+            thread_.join();
+            flush();
+        }
+    };
+
+    /*!
+    VS2013では関数内の静的変数の初期化がスレッドセーフでないので、名前空間の変数にしてmainより前に作る
+    */
+    Logger instance;
+
+    Logger & logger()
+    {
+        return instance;
+    }
+
+    /*!
+    現在のスレッドのリングバッファを返す。最初の呼び出しで登録する
+    */
+    Ring & ring()
+    {
+        // リングバッファはLoggerが持ち続けるので、スレッドごとにはポインタだけを持つ
+        THREAD_LOCAL_PTR(Ring, r);
+        if (!r){
+            r = logger().add().get();
+        }
+        return *r;
+    }
+
+    /*!
+    呼び出し箇所の件数を返す。最初の呼び出しで作って登録する
+    呼び出し箇所は静的変数なので、件数も解放しない
+    */
+    LogSiteCounter & counterOf(LogSite & site)
+    {
+        auto c = site.counter.load(std::memory_order_acquire);
+        if (c){
+            return *c;
+        }
+        std::unique_ptr<LogSiteCounter> created(new LogSiteCounter());
+        // 他のスレッドが先に登録していれば、そちらを使う
+        if (site.counter.compare_exchange_strong(c, created.get(), std::memory_order_acq_rel, std::memory_order_acquire)){
+            c = created.release();
+        }
+        return *c;
+    }
+}
+
+bool LogSite::admit(int64_t second)
+{
+    auto & c = counterOf(*this);
+    auto s = c.second.load(std::memory_order_relaxed);
+    if (s != second && c.second.compare_exchange_strong(s, second, std::memory_order_relaxed)){
+        c.count.store(0, std::memory_order_relaxed);
+    }
+    if (c.count.fetch_add(1, std::memory_order_relaxed) < limit){
+        return true;
+    }
+    c.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+uint32_t LogSite::takeSuppressed()
+{
+    auto & c = counterOf(*this);
+    return c.suppressed.load(std::memory_order_relaxed) == 0 ? 0 : c.suppressed.exchange(0, std::memory_order_relaxed);
+}
+
+void LogRecord::add(char const * v, size_t size)
+{
+    auto & a = next(LogArg::STRING);
+    size_t const n = std::min<size_t>(size, TEXT - used);
+    if (0 < n){
+        std::memcpy(text + used, v, n);
+    }
+    a.s.offset = used;
+    a.s.length = static_cast<uint16_t>(n);
+    a.s.original = static_cast<uint32_t>(size);
+    used = static_cast<uint16_t>(used + n);
+}
+
+LogArg & LogRecord::next(LogArg::Type type)
+{
+    auto & a = args[count++];
+    a.type = type;
+    return a;
+}
+
+LogRecord * Log::begin(LogSite & site)
+{
+    auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    if (!site.admit(ns / 1000000000)){
+        return nullptr;
+    }
+    auto & r = ring();
+    auto const head = r.head.load(std::memory_order_relaxed);
+    if (Ring::SIZE <= head - r.tail.load(std::memory_order_acquire)){
+        Metrics::get().log_dropped.add();
+        return nullptr;
+    }
+    auto & record = r.records[head % Ring::SIZE];
+    record.time_ns = ns;
+    record.site = &site;
+    record.suppressed = site.takeSuppressed();
+    record.count = 0;
+    record.used = 0;
+    return &record;
+}
+
+void Log::commit()
+{
+    auto & r = ring();
+    r.head.store(r.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void Log::configure(LogConfig const & config)
+{
+    level_.store(static_cast<int>(config.level), std::memory_order_relaxed);
+    logger().configure(config);
+}
+
+void Log::shutdown()
+{
+    logger().stop();
+}
+
+void Log::setThreadName(std::string const & name)
+{
+    logger().setThreadName(ring(), name);
+}
+
+LogLevel Log::parseLevel(std::string const & name)
+{
+    for (auto level : { LogLevel::debug, LogLevel::info, LogLevel::warn, LogLevel::error }){
+        if (name == levelName(level)){
+            return level;
+        }
+    }
+    throw std::runtime_error((boost::format("unknown log level [%s]") % name).str());
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+/*!
+ログの重要度
+*/
+enum class LogLevel : int
+{
+    debug = 0,
+    info = 1,
+    warn = 2,
+    error = 3,
+};
+
+struct LogSiteCounter;
+
+/*!
+ログの呼び出し箇所
+書式と重要度を持ち、同じ箇所から1秒にlimit件を超えるログは捨てて件数だけ数える
+LOG_WRITEが関数内の静的変数として定数で初期化するので、コンストラクタを持たない
+件数は最初に書くときに作り、compare_exchangeで登録する
+*/
+struct LogSite
+{
+    static uint32_t const DEFAULT_LIMIT = 10;
+    LogLevel level;
+    char const * event; ///< 構造化ログのイベント名
+    char const * format; ///< boost::formatの書式
+    uint32_t limit; ///< 1秒あたりの最大件数
+    std::atomic<LogSiteCounter *> counter; ///< 件数。静的変数なので登録するまではnullptr
+
+    /*!
+    @param[in] second 現在時刻(秒)
+    @return 書いてよければtrue
+    */
+    bool admit(int64_t second);
+    /*!
+    @return 前回から捨てた件数。0に戻す
+    */
+    uint32_t takeSuppressed();
+};
+
+/*!
+ログの引数1つ
+文字列は記録の中の文字列領域にコピーする
+*/
+struct LogArg
+{
+    enum Type : uint8_t { INT, UINT, DOUBLE, STRING };
+    Type type;
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+        struct
+        {
+            uint16_t offset; ///< 文字列領域の中の位置
+            uint16_t length; ///< コピーした長さ
+            uint32_t original; ///< 元の長さ。lengthより長ければ切り詰めた
+        } s;
+    };
+};
+
+/*!
+ログ1件
+書式化せずに引数のまま記録し、書式化はバックグラウンドのスレッドで行う
+*/
+struct LogRecord
+{
+    static int const MAX_ARGS = 6;
+    static int const TEXT = 200;
+    int64_t time_ns; ///< system_clockの時刻(ナノ秒)
+    LogSite const * site;
+    uint32_t suppressed; ///< この前に同じ箇所で捨てた件数
+    uint8_t count; ///< 引数の数
+    uint16_t used; ///< 文字列領域の使用量
+    LogArg args[MAX_ARGS];
+    char text[TEXT];
+
+    void add(int64_t v) { auto & a = next(LogArg::INT); a.i = v; }
+    void add(uint64_t v) { auto & a = next(LogArg::UINT); a.u = v; }
+    void add(double v) { auto & a = next(LogArg::DOUBLE); a.d = v; }
+    void add(char const * v) { add(v, v ? std::strlen(v) : 0); }
+    void add(std::string const & v) { add(v.data(), v.size()); }
+    void add(char const * v, size_t size);
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type add(T v) { add(static_cast<int64_t>(v)); }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type add(T v) { add(static_cast<uint64_t>(v)); }
+    void add(float v) { add(static_cast<double>(v)); }
+private:
+    LogArg & next(LogArg::Type type);
+};
+
+/*!
+ログの設定
+*/
+struct LogConfig
+{
+    LogLevel level = LogLevel::info; ///< これより重要度の低いログは記録しない
+    std::string json_path; ///< JSON Linesの書き出し先。空なら書き出さない
+    bool console = true; ///< 標準出力(warn以上は標準エラー出力)に書く
+};
+
+/*!
+非同期のログ
+各スレッドは自分のリングバッファに書式化前の記録を書くだけで、ロックも入出力もしない
+バックグラウンドのスレッドが定期的に全スレッドのリングバッファから取り出し、時刻順に書式化して書き出す
+リングバッファがいっぱいなら記録を捨てて数える
+*/
+class Log
+{
+    static std::atomic<int> level_;
+    /*!
+    現在のスレッドのリングバッファで次に書く記録。いっぱいならnullptr
+    */
+    static LogRecord * begin(LogSite & site);
+    /*!
+    記録を書き終える
+    */
+    static void commit();
+
+    static void pack(LogRecord &) {}
+    template <typename T, typename... Args>
+    static void pack(LogRecord & record, T const & v, Args const &... args)
+    {
+        record.add(v);
+        pack(record, args...);
+    }
+public:
+    /*!
+    @retval true levelのログを記録する
+    */
+    static bool enabled(LogLevel level) { return level_.load(std::memory_order_relaxed) <= static_cast<int>(level); }
+    /*!
+    設定を変え、バックグラウンドのスレッドを開始する。設定する前のログもこの設定で書き出す
+    */
+    static void configure(LogConfig const & config);
+    /*!
+    残っているログを書き出してから、バックグラウンドのスレッドを止める
+    */
+    static void shutdown();
+    /*!
+    現在のスレッドの名前をつける。ログのthreadに使う
+    */
+    static void setThreadName(std::string const & name);
+    /*!
+    ログを記録する。LOG_INFOなどのマクロから呼ぶ
+    @param[in] site 呼び出し箇所
+    @param[in] args 書式の引数。整数、浮動小数点数、文字列
+    */
+    template <typename... Args>
+    static void write(LogSite & site, Args const &... args)
+    {
+        static_assert(sizeof...(Args) <= LogRecord::MAX_ARGS, "too many log arguments.");
+        if (auto record = begin(site)){
+            pack(*record, args...);
+            commit();
+        }
+    }
+    /*!
+    @param[in] name debug, info, warn, error
+    @return 重要度
+    */
+    static LogLevel parseLevel(std::string const & name);
+};
+
+#define LOG_CONCAT_(a, b) a##b
+#define LOG_CONCAT(a, b) LOG_CONCAT_(a, b)
+/*!
+ログを記録する。重要度が低ければ引数を評価しない
+@param level 重要度
+@param event イベント名(文字列リテラル)
+@param format boost::formatの書式(文字列リテラル)
+*/
+#define LOG_WRITE(level, event, format, ...) do { \
+        if (Log::enabled(level)){ \
+            static LogSite LOG_CONCAT(log_site_, __LINE__) = { level, event, format, LogSite::DEFAULT_LIMIT }; \
+            Log::write(LOG_CONCAT(log_site_, __LINE__), ##__VA_ARGS__); \
+        } \
+    } while (false)
+#define LOG_DEBUG(event, format, ...) LOG_WRITE(LogLevel::debug, event, format, ##__VA_ARGS__)
+#define LOG_INFO(event, format, ...) LOG_WRITE(LogLevel::info, event, format, ##__VA_ARGS__)
+#define LOG_WARN(event, format, ...) LOG_WRITE(LogLevel::warn, event, format, ##__VA_ARGS__)
+#define LOG_ERROR(event, format, ...) LOG_WRITE(LogLevel::error, event, format, ##__VA_ARGS__)
@@ -1,107 +1,375 @@
 #include "identify.h"
 #include "sender.h"
 #include "trigger.h"
+#include "bench.h"
+#include "regress.h"
+#include "tune.h"
+#include "option_watcher.h"
+#include "calibrate.h"
+#include "trace.h"
+#include "metrics.h"
+#include "http_server.h"
+#include "frame_source.h"
+#include "record.h"
+#include "pipeline.h"
+#include "preview.h"
+#include "governor.h"
+#include "log.h"
+#include "thread_policy.h"
+#include "memory_budget.h"
 #include <boost/program_options.hpp>
 #include <boost/format.hpp>
+#include <chrono>
 #include <mutex>
 #include <thread>
 
 namespace {
     /*!
-    テスト画像を作る。
-    カメラがなくても開発をするため。
-    @param[in] rows ブロック段数
-    @return テスト画像
+    起動してから最初にブロックを認識するまでの時間
     */
-    cv::Mat createTestImage(Option const & opt, int rows, std::vector<Color> const & colors)
+    struct Startup
     {
-        cv::Mat dst = cv::Mat::zeros(static_cast<int>(opt.tune.camera_width * opt.tune.camera_ratio), static_cast<int>(opt.tune.camera_height * opt.tune.camera_ratio), CV_8UC3);
-        dst += cv::Scalar::all(10);
-        int SIZES[] = { 1, 1, 1, 1, 2, 2, 3 };
-        for (int row = 0; row < rows; ++row){
-            int y = dst.rows - opt.tune.get_block_height() * (row + 2);
-            int x = dst.cols / 2 - (rand() % opt.tune.get_block_height()) / 2;
-            int type = SIZES[rand() % 7];
-            cv::Rect rc(x, y, opt.tune.get_block_width() * type, opt.tune.get_block_height());
-            auto bgr = colors[rand() % colors.size()].bgr;
-            cv::Scalar s(bgr[0], bgr[1], bgr[2]);
-            cv::rectangle(dst, rc, s, CV_FILLED);
-            int b = rc.height / 5;
-            for (int i = 0; i < type; ++i){
-                cv::rectangle(dst, cv::Rect(rc.x + opt.tune.get_block_width() * i + b, rc.y - b, b, b), s, CV_FILLED);
-                cv::rectangle(dst, cv::Rect(rc.x + opt.tune.get_block_width() * (i + 1) - 2 * b, rc.y - b, b, b), s, CV_FILLED);
-            }
-        }
-        for (int i = 0; i < dst.size().area() / 50; ++i){
-            cv::Point pt = { rand() % dst.cols, rand() % dst.rows };
-            dst.at<cv::Vec3b>(pt) = { (uchar)(rand() % 256), (uchar)(rand() % 256), (uchar)(rand() % 256) };
-        }
-        return dst;
+        typedef std::chrono::steady_clock clock_type;
+        clock_type::time_point start; ///< main関数の開始
+        clock_type::time_point option; ///< オプション読み込み完了
+        clock_type::time_point camera; ///< カメラのオープン完了
+        bool reported;
+
+        /*!
+        最初のフレームを認識したときに一度だけ表示する
+        */
+        void report()
+        {
+            if (reported){
+                return;
+            }
+            reported = true;
+            auto ms = [this](clock_type::time_point t){
+                return std::chrono::duration<double, std::milli>(t - start).count();
+            };
+            std::cout << boost::format("startup: option %.1fms, camera %.1fms, first frame %.1fms, peak rss %.1fMB")
+                % ms(option) % ms(camera) % ms(clock_type::now()) % (peakResidentBytes() / (1024.0 * 1024.0)) << std::endl;
+        }
+    };
+
+    /*!
+    ブロックを認識し、処理時間と結果を計測値に記録する
+    @param[in] m カメラ画像
+    @param[in] opt オプション
+    @param[out] blockInfo ブロック情報
+    @param[in] frame フレームの識別情報
+    @param[in] show trueなら認識結果を画面に表示する
+    @param[in,out] state フレームをまたいで引き継ぐ認識の状態
+    */
+    void identifyFrame(cv::Mat const & m, Option const & opt, std::vector<BlockInfo> & blockInfo, FrameStamp const & frame, bool show, IdentifyState & state)
+    {
+        auto & metrics = Metrics::get();
+        auto const begin = std::chrono::steady_clock::now();
+        identifyBlock(m, opt, blockInfo, frame, show, &state);
+        metrics.identify.since(begin);
+        metrics.frames.add();
+        if (blockInfo.empty()){
+            metrics.empty_detections.add();
+        }
     }
 
     /*!
-    メイン処理
+    トリガー時点で送信するフレームの経過時間を記録し、分布をログに書く
+    @param[in] blockInfo 送信するブロック情報
+    */
+    void reportFrameAge(std::vector<BlockInfo> const & blockInfo)
+    {
+        if (blockInfo.empty() || blockInfo.front().frame.id == 0){
+            return;
+        }
+        auto const & frame = blockInfo.front().frame;
+        auto const age = std::chrono::steady_clock::now() - frame.captured;
+        auto & h = Metrics::get().frame_age;
+        h.record(age);
+        LOG_INFO("frame_age", "frame %d age %.1fms (p50 %.1fms, p99 %.1fms, max %.1fms, n=%d)",
+            frame.id, std::chrono::duration<double, std::milli>(age).count(),
+            h.quantile(0.5) * 1e-3, h.quantile(0.99) * 1e-3, h.max_us() * 1e-3, h.count());
+    }
+
+    /*!
+    画面を更新し、キー入力を待つ
+    @param[in] delay 待ち時間(ミリ秒)。0なら無限に待つ
+    @param[in] window falseなら画面がないので待たない
+    */
+    void waitKey(int delay, bool window = true)
+    {
+        if (window){
+            TRACE_SCOPE("waitKey");
+            cv::waitKey(delay);
+        }
+        if (Trace::poll()){
+            std::exit(0);
+        }
+    }
+
+    /*!
+    色の校正処理
+    認識したブロックの画素を集めてk-meansで色の基準値を求め、オプションファイルに保存する
     @param[in] opt オプション
     @param[in] device_id カメラデバイスID
+    @param[in] frames 画素を集めるフレーム数
+    @param[in] path 保存先
+    @param[in] debug デバッグ
+    @return Exit code
+    */
+    int calibrate_proc(Option const & opt, int device_id, int frames, std::string const & path, bool debug)
+    {
+        typedef std::chrono::steady_clock clock_type;
+        ColorSamples samples;
+        FrameStamp frame;
+        IdentifyState state;
+        auto source = debug ? createTestImageSource() : createCameraSource(device_id, opt);
+        if (!source){
+            return -1;
+        }
+        auto const t0 = clock_type::now();
+        for (int i = 0; i < frames; ++i){
+            cv::Mat m;
+            if (!source->read(opt, m, frame)){
+                --i;
+                continue;
+            }
+            std::vector<BlockInfo> blockInfo;
+            identifyBlock(m, opt, blockInfo, frame, true, &state);
+            samples.add(m, blockInfo);
+            waitKey(1);
+        }
+        auto const t1 = clock_type::now();
+        Option dst = opt;
+        dst.colors = calibrateColors(opt.colors, samples, std::max(1u, std::thread::hardware_concurrency()));
+        prepareOption(dst);
+        auto const t2 = clock_type::now();
+        for (size_t i = 0; i < dst.colors.size(); ++i){
+            auto const & before = opt.colors[i].bgr;
+            auto const & after = dst.colors[i].bgr;
+            std::cout << boost::format("%-12s : %02X %02X %02X -> %02X %02X %02X") % dst.colors[i].name
+                % (int)before[2] % (int)before[1] % (int)before[0] % (int)after[2] % (int)after[1] % (int)after[0] << std::endl;
+        }
+        std::cout << boost::format("calibrated %d pixels of %d frames. sampling %.1fs, k-means %.3fs")
+            % samples.size() % frames
+            % std::chrono::duration<double>(t1 - t0).count() % std::chrono::duration<double>(t2 - t1).count() << std::endl;
+        writeOption(path, dst);
+        std::cout << "saved " << path << std::endl;
+        return 0;
+    }
+
+    /*!
+    記録したフレームを再生してブロックを認識する
+    フレームごとの認識結果を表示するので、再生結果を比較すれば認識の変化がわかる
+    @param[in] opt オプション
+    @param[in] path 記録したファイル
+    @param[in] realtime trueなら記録したときの速さ、falseなら最大速度で再生する
+    @param[in] show trueなら認識結果を画面に表示する。表示の時間は認識の時間に含めない
     @param[in] address PythonプロセスのIPアドレス
     @param[in] port Pythonプロセスのポート番号
-    @param[in] com COMポート
+    @param[in] send 送信の設定
+    @return Exit code
+    */
+    int replay_proc(Option const & opt, std::string const & path, bool realtime, bool show, std::string const & address, int port, SendConfig const & send)
+    {
+        typedef std::chrono::steady_clock clock_type;
+        boost::asio::io_service io_service;
+        Sender sender(io_service, address, port, send);
+        ReplaySource source(path, realtime);
+        std::cout << boost::format("replaying %d frames of %s ...") % source.frames() % path << std::endl;
+        std::vector<BlockInfo> blockInfo;
+        FrameStamp frame;
+        IdentifyState state;
+        size_t frames = 0;
+        clock_type::duration identify(0);
+        for (;;){
+            cv::Mat m;
+            bool const ok = source.read(opt, m, frame);
+            for (int n = source.takeTriggers(); 0 < n; --n){
+                // 記録したトリガーの順に送るので、送信を終えるまで待つ
+                bool sent = false;
+                sender.send(opt, blockInfo, [&sent](SendResult){
+                    sent = true;
+                });
+                io_service.reset();
+                while (!sent && io_service.run_one()){
+                }
+            }
+            if (!ok){
+                break;
+            }
+            auto const begin = clock_type::now();
+            identifyFrame(m, opt, blockInfo, frame, false, state);
+            identify += clock_type::now() - begin;
+            if (show){
+                showBlockInfo(m, opt, blockInfo);
+            }
+            ++frames;
+            std::cout << "frame " << frame.id << ":";
+            for (auto const & info : blockInfo){
+                std::cout << boost::format(" %s:%d(%d,%d,%d,%d)") % info.color.name % info.width % info.rc.x % info.rc.y % info.rc.width % info.rc.height;
+            }
+            std::cout << std::endl;
+            waitKey(1, show);
+        }
+        double const seconds = std::chrono::duration<double>(identify).count();
+        std::cout << boost::format("replayed %d frames. identify %.3fs (%.1f fps)") % frames % seconds % (frames / std::max(seconds, 1e-9)) << std::endl;
+        return 0;
+    }
+
+    /*!
+    メイン処理
+    @param[in] watcher オプションファイルの監視
+    @param[in] device_id カメラデバイスID
+    @param[in] address PythonプロセスのIPアドレス
+    @param[in] port Pythonプロセスのポート番号
+    @param[in] send 送信の設定
+    @param[in] trigger トリガーの設定
+    @param[in] metrics_port 計測値を公開するポート番号(0なら公開しない)
+    @param[in] record フレームとトリガーの記録先(空なら記録しない)
+    @param[in] workers 並列に認識するフレーム数(1なら取得と同じスレッドで認識する)
+    @param[in] max_age_ms 並列に認識するとき、撮影からこの時間を過ぎた結果は後の結果があれば捨てる
+    @param[in] idle 何も起きていないときにフレームを間引く設定
+    @param[in] preview 認識結果の配信の設定
+    @param[in] threads スレッドを実行するコアとスケジューリング
+    @param[in] memory_budget RSSの予算(MB)。0なら制限しない
+    @param[in] window falseなら画面に表示しない
     @param[in] debug デバッグ
+    @param[in] startup 起動時間の計測
     @return Exit code
     */
-    int main_proc(Option const & opt, int device_id, std::string const & address, int port, int com, bool debug)
+    int main_proc(OptionWatcher const & watcher, int device_id, std::string const & address, int port, SendConfig const & send, TriggerConfig const & trigger, int metrics_port, std::string const & record, int workers, int max_age_ms, GovernorConfig const & idle, PreviewConfig const & preview, ThreadConfig const & threads, int memory_budget, bool window, bool debug, Startup startup)
     {
         std::vector<BlockInfo> blockInfo;
         std::mutex mutex;
-        std::thread th([&, port, com]{
-            auto trigger = Trigger::create(com);
-            for (;;){
-                trigger->wait();
+        std::unique_ptr<PreviewServer> previewServer;
+        if (0 < preview.port){
+            previewServer.reset(new PreviewServer(preview));
+        }
+        std::unique_ptr<FrameGovernor> governor;
+        if (0 < idle.idle_after_ms && !debug){
+            governor.reset(new FrameGovernor(idle));
+        }
+        std::unique_ptr<Recorder> recorder;
+        if (!record.empty()){
+            recorder.reset(new Recorder(record));
+            std::cout << "recording to " << record << std::endl;
+        }
+        // トリガーの待ち受けと送信は1つのスレッドで非同期に行う
+        std::thread th([&, port]{
+            Trace::setThreadName("trigger");
+            Log::setThreadName("trigger");
+            applyThreadPolicy("trigger", threads.trigger);
+            boost::asio::io_service io_service;
+            boost::asio::io_service::work work(io_service);
+            Sender sender(io_service, address, port, send);
+            OptionWatcher::Reader reader(watcher);
+            TriggerLoop loop(io_service, trigger, [&]{
+                auto const begin = std::chrono::steady_clock::now();
+                if (governor){
+                    governor->wake();
+                }
+                if (recorder){
+                    recorder->trigger(begin);
+                }
                 std::vector<BlockInfo> copy;
                 {
                     std::unique_lock<std::mutex> lock(mutex);
                     copy = blockInfo;
                 }
-                sendToServer(opt, copy, address, port);
+                reportFrameAge(copy);
+                sender.send(reader.get(), copy, [begin](SendResult){
+                    Metrics::get().trigger_to_send.since(begin);
+                });
+            });
+            std::shared_ptr<HttpServer> metrics;
+            if (0 < metrics_port){
+                metrics = std::make_shared<HttpServer>(io_service, metrics_port);
+                metrics->route("/metrics", [](std::string const &){
+                    return HttpResponse{ 200, "text/plain; version=0.0.4", Metrics::get().exposition() };
+                });
+                metrics->start();
+                std::cout << boost::format("GET http://127.0.0.1:%d/metrics to scrape metrics.") % metrics_port << std::endl;
             }
+            loop.start();
+            io_service.run();
         });
 
-        if (debug){
-            srand(0);
-            for (;;){
-                cv::Mat m = createTestImage(opt, 1 + (rand() % 11), opt.colors);
-                {
-                    std::unique_lock<std::mutex> lock(mutex);
-                    identifyBlock(m, opt, blockInfo);
-                }
-                cv::waitKey();
-            }
+        // オプションが更新されたらフレームの境目で取り込む
+        OptionWatcher::Reader reader(watcher);
+        Trace::setThreadName("identify");
+        Log::setThreadName("identify");
+        applyThreadPolicy("capture", threads.capture);
+        if ((workers <= 1 || debug) && !threads.identify.empty()){
+            LOG_WARN("thread", "identify runs on the capture thread without --workers. --identify-cores and --identify-sched are ignored.");
         }
-        else{
-            cv::VideoCapture cap(device_id);
-            if (!cap.isOpened()){
-                std::cerr << "failed to open camera device." << std::endl;
-                return -1;
-            }
-            // CV_CAP_PROP_GAIN
-            cap.set(CV_CAP_PROP_FRAME_WIDTH, opt.tune.camera_width);
-            cap.set(CV_CAP_PROP_FRAME_HEIGHT, opt.tune.camera_height);
+        FrameStamp frame;
+        auto source = debug ? createTestImageSource() : createCameraSource(device_id, reader.get(), governor.get());
+        if (!source){
+            return -1;
+        }
+        startup.camera = Startup::clock_type::now();
+        IdentifyState state;
+        MemoryBudget budget(memory_budget);
+        if (1 < workers && !debug){
+            // 予算に収まらなければ並列数を減らし、1になれば取得と同じスレッドで認識する
+            workers = budget.fitWorkers(workers, MemoryBudget::frameBytes(reader.get()));
+        }
+        if (1 < workers && !debug){
+            // 撮影順に公開された結果だけを送信対象と画面表示にする
+            IdentifyPipeline pipeline(watcher, workers, std::chrono::milliseconds(max_age_ms), [&state](cv::Mat const & m, Option const & opt, std::vector<BlockInfo> & info, FrameStamp const & frame){
+                identifyFrame(m, opt, info, frame, false, state);
+            }, threads.identify);
+            std::cout << boost::format("identifying %d frames in parallel.") % workers << std::endl;
             for (;;){
+                auto const & opt = reader.get();
                 cv::Mat m;
-                cap >> m;
-                if (m.size().area() == 0){
-                    std::cerr << "failed to get camera image." << std::endl;
-                    cv::waitKey(100);
-                    continue;
+                if (source->read(opt, m, frame)){
+                    if (recorder){
+                        recorder->frame(m, frame);
+                    }
+                    pipeline.submit(m, frame);
                 }
-                cv::resize(m, m, cv::Size(), opt.tune.camera_ratio, opt.tune.camera_ratio);
-                cv::flip(m.t(), m, 0);
-                {
+                budget.check();
+                IdentifyPipeline::Result result;
+                bool published = false;
+                while (pipeline.next(result)){
+                    published = true;
                     std::unique_lock<std::mutex> lock(mutex);
-                    identifyBlock(m, opt, blockInfo);
+                    blockInfo = result.blockInfo;
+                }
+                if (published){
+                    if (window){
+                        showBlockInfo(result.image, opt, result.blockInfo);
+                    }
+                    if (previewServer){
+                        previewServer->publish(result.image, reader.share(), result.blockInfo);
+                    }
+                    startup.report();
                 }
-                cv::waitKey(1);
+                waitKey(1, window);
+            }
+        }
+        for (;;){
+            auto const & opt = reader.get();
+            cv::Mat m;
+            if (!source->read(opt, m, frame)){
+                continue;
+            }
+            if (recorder){
+                recorder->frame(m, frame);
+            }
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                identifyFrame(m, opt, blockInfo, frame, window, state);
+            }
+            budget.check();
+            // 書き込むのはこのスレッドだけなので、ロックせずに読んでよい
+            if (previewServer){
+                previewServer->publish(m, reader.share(), blockInfo);
             }
+            startup.report();
+            waitKey(debug ? 0 : 1, window);
         }
         // unreachable code.
         th.join();
@@ -116,6 +384,9 @@ main proc
 @return exit code
 */
 int main(int argc, const char * argv[]) {
+    Startup startup = { Startup::clock_type::now() };
+    // 計測値はどのスレッドからも使うので、スレッドを作る前に作る
+    Metrics::init();
     try{
         namespace po = boost::program_options;
         po::options_description desc("options");
@@ -128,6 +399,44 @@ int main(int argc, const char * argv[]) {
             ("address,a", po::value<std::string>(), "Python process IP address")
             ("port,p", po::value<int>()->default_value(80), "Python process port number")
             ("com,c", po::value<int>()->default_value(0), "COM Port if you use Arduino Button(windows only)")
+            ("tty,t", po::value<std::string>(), "Serial device path if you use Arduino Button(except windows)")
+            ("http-trigger", po::value<int>()->default_value(0), "Local port number accepting POST /trigger (0: disabled)")
+            ("interval", po::value<int>()->default_value(0), "Trigger periodically in milliseconds (0: disabled)")
+            ("debounce", po::value<int>()->default_value(500), "Ignore triggers within milliseconds after the last one")
+            ("connect-timeout", po::value<int>()->default_value(200), "Give up connecting to the Python process after milliseconds")
+            ("response-timeout", po::value<int>()->default_value(1000), "Give up waiting for the response after milliseconds")
+            ("send-retries", po::value<int>()->default_value(2), "Retry failed sends with exponential backoff up to the count")
+            ("send-deadline", po::value<int>()->default_value(1500), "Give up a send including retries after milliseconds")
+            ("calibrate", po::value<int>()->implicit_value(300), "Calibrate colors from camera frames and save option file")
+            ("record", po::value<std::string>(), "Record frames and triggers to the path")
+            ("replay", po::value<std::string>(), "Identify blocks of recorded frames and print the results")
+            ("realtime", "Replay at the recorded speed instead of maximum speed")
+            ("replay-show", "Show the results of --replay in a window")
+            ("workers", po::value<int>()->default_value(1), "Identify frames in parallel on the number of threads (camera only)")
+            ("max-frame-age", po::value<int>()->default_value(100), "Discard parallel results older than milliseconds if a newer one is ready")
+            ("idle-after", po::value<int>()->default_value(30000), "Poll the camera slowly after milliseconds without motion or trigger (0: disabled)")
+            ("idle-fps", po::value<double>()->default_value(2), "Frames per second checked for motion while idle")
+            ("metrics-port", po::value<int>()->default_value(0), "Local port number serving GET /metrics in Prometheus format (0: disabled)")
+            ("preview-port", po::value<int>()->default_value(0), "Local port number streaming annotated frames as MJPEG at GET / (0: disabled)")
+            ("preview-fps", po::value<double>()->default_value(5), "Maximum frames per second encoded for the preview")
+            ("preview-quality", po::value<int>()->default_value(70), "JPEG quality of the preview (0-100)")
+            ("capture-cores", po::value<std::string>()->default_value(""), "Pin the camera capture thread to the cores (e.g. 2, 2,3, 4-7)")
+            ("capture-sched", po::value<std::string>()->default_value(""), "Scheduling of the capture thread (fifo:1-99, nice:-20-19)")
+            ("identify-cores", po::value<std::string>()->default_value(""), "Pin the identify threads of --workers to the cores")
+            ("identify-sched", po::value<std::string>()->default_value(""), "Scheduling of the identify threads of --workers")
+            ("trigger-cores", po::value<std::string>()->default_value(""), "Pin the trigger and send thread to the cores")
+            ("trigger-sched", po::value<std::string>()->default_value(""), "Scheduling of the trigger and send thread")
+            ("memory-budget", po::value<int>()->default_value(0), "Low-memory mode keeping the resident memory within megabytes (0: disabled)")
+            ("headless", "Do not open the window (use --preview-port to watch frames)")
+            ("log-level", po::value<std::string>()->default_value("info"), "Minimum log level (debug, info, warn, error)")
+            ("log-file", po::value<std::string>(), "Append logs to the path in JSON Lines")
+            ("trace", po::value<std::string>(), "Record stage timings and write chrome://tracing JSON to the path (SIGUSR1: write, SIGUSR2: on/off)")
+            ("bench", po::value<std::string>(), "Run benchmark (background, button, color, governor, log, memory, pipeline, preview, scene, segment, sender, threshold, thread, trace)")
+            ("regress", po::value<std::string>(), "Check accuracy and speed with the ground truth file (e.g. imgs/ground_truth.json)")
+            ("iterations", po::value<int>()->default_value(20), "Identify count per image of --regress and --tune")
+            ("tune", po::value<std::string>(), "Search Tuning with the ground truth file on all cores and write ranked option files")
+            ("tune-method", po::value<std::string>()->default_value("halving"), "Search method of --tune (grid, halving)")
+            ("tune-top", po::value<int>()->default_value(5), "Number of option files written by --tune")
             ("debug", "DEBUG mode");
         ;
         po::variables_map vm;
@@ -149,12 +458,91 @@ int main(int argc, const char * argv[]) {
                 return 0;
             }
             po::notify(vm);
-            auto const opt = vm.count("option") ? readOption(vm["option"].as<std::string>()) : getDefaultOption();
+            // mallocとスレッドの設定は、他のスレッドを作る前に変える
+            int const memory_budget = vm["memory-budget"].as<int>();
+            if (memory_budget < 0){
+                throw std::runtime_error("memory-budget should not be negative");
+            }
+            if (0 < memory_budget){
+                enableLowMemory();
+            }
+            // 他のスレッドとOpenCVのスレッドプールを作る前に、パイプラインのコアを外す
+            ThreadConfig threads;
+            threads.capture = parseThreadPolicy(vm["capture-cores"].as<std::string>(), vm["capture-sched"].as<std::string>());
+            threads.identify = parseThreadPolicy(vm["identify-cores"].as<std::string>(), vm["identify-sched"].as<std::string>());
+            threads.trigger = parseThreadPolicy(vm["trigger-cores"].as<std::string>(), vm["trigger-sched"].as<std::string>());
+            auto const shared = reserveThreadCores(threads);
+            LogConfig log;
+            log.level = Log::parseLevel(vm["log-level"].as<std::string>());
+            log.json_path = vm.count("log-file") ? vm["log-file"].as<std::string>() : "";
+            Log::configure(log);
+            if (!shared.empty()){
+                ThreadPolicy others;
+                others.cores = shared;
+#if defined _WIN32 || defined _WIN64
+                // Windowsのスレッドは作ったスレッドのコアを引き継がないので、他のスレッドは固定されない
+                LOG_INFO("thread", "pipeline threads without cores: %s, OpenCV: %d threads (other threads are not pinned on Windows)", describeThreadPolicy(others), shared.size());
+#else
+                LOG_INFO("thread", "other threads and OpenCV: %s (%d threads)", describeThreadPolicy(others), shared.size());
+#endif // defined _WIN32 || defined _WIN64
+            }
+            std::string const option_path = vm.count("option") ? vm["option"].as<std::string>() : "";
+            auto const opt = option_path.empty() ? getDefaultOption() : readOptionCached(option_path);
+            validateOption(opt);
+            startup.option = Startup::clock_type::now();
             auto camera = vm["device"].as<int>();
             std::string address = vm.count("address") ? vm["address"].as<std::string>() : "";
             int port = vm["port"].as<int>();
-            int com = vm["com"].as<int>();
-            return main_proc(opt, camera, address, port, com, !!vm.count("debug"));
+            TriggerConfig trigger;
+            trigger.com = vm["com"].as<int>();
+            trigger.tty = vm.count("tty") ? vm["tty"].as<std::string>() : "";
+            trigger.http_port = vm["http-trigger"].as<int>();
+            trigger.interval_ms = vm["interval"].as<int>();
+            trigger.debounce_ms = vm["debounce"].as<int>();
+            SendConfig send;
+            send.connect_timeout_ms = vm["connect-timeout"].as<int>();
+            send.response_timeout_ms = vm["response-timeout"].as<int>();
+            send.retries = vm["send-retries"].as<int>();
+            send.deadline_ms = vm["send-deadline"].as<int>();
+            // Senderはトリガーのスレッドで作るので、そこで例外を投げないよう先に調べる
+            validateSender(address, port, send);
+            if (vm.count("trace")){
+                Trace::enable(true);
+                Trace::installSignalHandler(vm["trace"].as<std::string>());
+            }
+            if (vm.count("bench")){
+                return runBench(vm["bench"].as<std::string>(), opt, memory_budget);
+            }
+            if (vm.count("regress")){
+                return runRegression(vm["regress"].as<std::string>(), opt, vm["iterations"].as<int>());
+            }
+            if (vm.count("tune")){
+                TuneConfig tune;
+                tune.method = vm["tune-method"].as<std::string>();
+                tune.top = vm["tune-top"].as<int>();
+                tune.iterations = vm["iterations"].as<int>();
+                return runTune(vm["tune"].as<std::string>(), opt, tune);
+            }
+            if (vm.count("replay")){
+                return replay_proc(opt, vm["replay"].as<std::string>(), !!vm.count("realtime"), !!vm.count("replay-show"), address, port, send);
+            }
+            if (vm.count("calibrate")){
+                auto const path = option_path.empty() ? "block_identifier.xml" : option_path;
+                int const ret = calibrate_proc(opt, camera, vm["calibrate"].as<int>(), path, !!vm.count("debug"));
+                if (vm.count("trace")){
+                    Trace::dump(vm["trace"].as<std::string>());
+                }
+                return ret;
+            }
+            GovernorConfig idle;
+            idle.idle_after_ms = vm["idle-after"].as<int>();
+            idle.idle_fps = vm["idle-fps"].as<double>();
+            PreviewConfig preview;
+            preview.port = vm["preview-port"].as<int>();
+            preview.max_fps = vm["preview-fps"].as<double>();
+            preview.quality = vm["preview-quality"].as<int>();
+            OptionWatcher watcher(option_path, opt);
+            return main_proc(watcher, camera, address, port, send, trigger, vm["metrics-port"].as<int>(), vm.count("record") ? vm["record"].as<std::string>() : "", vm["workers"].as<int>(), vm["max-frame-age"].as<int>(), idle, preview, threads, memory_budget, !vm.count("headless"), !!vm.count("debug"), startup);
         }
         catch (std::exception const & e){
             std::cerr << e.what() << "\n" << desc << std::endl;
@@ -0,0 +1,175 @@
+#include "memory_budget.h"
+#include "identify.h"
+#include "log.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+#if defined _WIN32 || defined _WIN64
+#pragma comment(lib,"Psapi.lib")
+#include <Windows.h>
+#include <Psapi.h>
+#elif defined __APPLE__
+#include <mach/mach.h>
+#include <sys/resource.h>
+#else
+#include <pthread.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif // defined _WIN32 || defined _WIN64
+
+#if defined __GLIBC__ || defined _WIN32 || defined _WIN64
+#include <malloc.h>
+#endif // defined __GLIBC__ || defined _WIN32 || defined _WIN64
+
+namespace {
+    size_t const MB = 1024 * 1024;
+
+#if defined __GLIBC__
+    /*!
+    これより大きなバッファはmmapで確保する
+    フレームの大きさのバッファはこれより大きく、タイルの2値化のような帯のバッファは小さい
+    */
+    int const MMAP_THRESHOLD = 256 * 1024;
+
+    /*!
+    省メモリモードで新しいスレッドのスタックに予約する大きさ
+    glibcがRLIMIT_STACKを無制限にしたときに使う大きさと同じ
+    */
+    size_t const THREAD_STACK = 2 * MB;
+#endif // defined __GLIBC__
+
+    /*!
+    空いたヒープをOSへ返す
+    */
+    void trimHeap()
+    {
+#if defined __GLIBC__
+        malloc_trim(0);
+#elif defined _WIN32 || defined _WIN64
+        _heapmin();
+#endif // defined __GLIBC__
+    }
+}
+
+size_t residentBytes()
+{
+#if defined _WIN32 || defined _WIN64
+    PROCESS_MEMORY_COUNTERS counters = {};
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#elif defined __APPLE__
+    mach_task_basic_info info = {};
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS){
+        return 0;
+    }
+    return info.resident_size;
+#else
+    // 2番目の値が常駐しているページ数
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0;
+    size_t resident = 0;
+    if (!(statm >> size >> resident)){
+        return 0;
+    }
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif // defined _WIN32 || defined _WIN64
+}
+
+size_t peakResidentBytes()
+{
+#if defined _WIN32 || defined _WIN64
+    PROCESS_MEMORY_COUNTERS counters = {};
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+    rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0){
+        return 0;
+    }
+#if defined __APPLE__
+    // macOSはバイト、Linuxはキロバイト
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif // defined __APPLE__
+#endif // defined _WIN32 || defined _WIN64
+}
+
+void enableLowMemory()
+{
+#if defined __GLIBC__
+    // スレッドごとのアリーナはそれぞれ64MBの仮想メモリを予約し、解放した領域もすぐには返さない
+    mallopt(M_ARENA_MAX, 1);
+    // 閾値を固定すると、解放したmmapの大きさに合わせて閾値を引き上げる動作も止まる
+    mallopt(M_MMAP_THRESHOLD, MMAP_THRESHOLD);
+    mallopt(M_TRIM_THRESHOLD, MMAP_THRESHOLD);
+#if 2 < __GLIBC__ || 18 <= __GLIBC_MINOR__
+    // std::threadもOpenCVのスレッドプールも、既定の属性でスレッドを作る
+    pthread_attr_t attr;
+    if (pthread_attr_init(&attr) == 0){
+        if (pthread_attr_setstacksize(&attr, THREAD_STACK) == 0){
+            pthread_setattr_default_np(&attr);
+        }
+        pthread_attr_destroy(&attr);
+    }
+#endif // 2 < __GLIBC__ || 18 <= __GLIBC_MINOR__
+#endif // defined __GLIBC__
+    setLowMemory(true);
+}
+
+MemoryBudget::MemoryBudget(int budget_mb)
+    : budget_(static_cast<size_t>(std::max(0, budget_mb)) * MB)
+    , frames_(0)
+    , over_(false)
+{
+}
+
+size_t MemoryBudget::frameBytes(Option const & opt)
+{
+    auto const camera = static_cast<size_t>(opt.tune.camera_width) * opt.tune.camera_height;
+    auto const scaled = static_cast<size_t>(camera * opt.tune.camera_ratio * opt.tune.camera_ratio);
+    return camera * 3 + scaled * BYTES_PER_PIXEL;
+}
+
+int MemoryBudget::fitWorkers(int workers, size_t frame_bytes) const
+{
+    if (!budget_){
+        return workers;
+    }
+    auto const resident = residentBytes();
+    auto const available = resident < budget_ ? budget_ - resident : 0;
+    int const fit = std::max(1, std::min(workers, static_cast<int>(available / std::max<size_t>(1, frame_bytes))));
+    if (available < frame_bytes){
+        LOG_WARN("memory", "budget %dMB is too small. resident %.1fMB and %.1fMB per frame.", budget_ / MB, resident / double(MB), frame_bytes / double(MB));
+    }
+    else if (fit < workers){
+        LOG_WARN("memory", "reduced workers from %d to %d to fit the budget %dMB (resident %.1fMB, %.1fMB per frame).", workers, fit, budget_ / MB, resident / double(MB), frame_bytes / double(MB));
+    }
+    return fit;
+}
+
+bool MemoryBudget::check()
+{
+    if (!budget_ || ++frames_ < CHECK_FRAMES){
+        return !over_;
+    }
+    frames_ = 0;
+    auto resident = residentBytes();
+    if (budget_ < resident){
+        trimHeap();
+        resident = residentBytes();
+    }
+    bool const over = budget_ < resident;
+    if (over){
+        Metrics::get().memory_over_budget.add();
+        if (!over_){
+            LOG_WARN("memory", "resident %.1fMB exceeds the budget %dMB (peak %.1fMB).", resident / double(MB), budget_ / MB, peakResidentBytes() / double(MB));
+        }
+    }
+    else if (over_){
+        LOG_INFO("memory", "resident %.1fMB is back within the budget %dMB.", resident / double(MB), budget_ / MB);
+    }
+    over_ = over;
+    return !over_;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+
+struct Option;
+
+/*!
+@return プロセスの常駐メモリ(RSS)のバイト数。取得できなければ0
+*/
+size_t residentBytes();
+
+/*!
+@return 起動してからのRSSの最大のバイト数。取得できなければ0
+*/
+size_t peakResidentBytes();
+
+/*!
+省メモリモードにする
+glibcのmallocのアリーナを1つにし、フレームの大きさのバッファは必ずmmapで確保して解放したらOSへ返す
+新しいスレッドのスタックの予約を小さくする。ulimit -vで仮想メモリを制限しても動くようにするため
+認識結果を描いた画像を元の画像と同じ大きさにする(setLowMemory)
+他のスレッドを起動する前にメインスレッドから呼ぶこと
+*/
+void enableLowMemory();
+
+/*!
+RSSの予算
+起動時に並列に認識するフレーム数を予算に収め、動作中はRSSが予算を超えていないか調べる
+超えたら空いたヒープをOSへ返し、それでも超えていれば警告を出す
+*/
+class MemoryBudget
+{
+public:
+    static int const CHECK_FRAMES = 30; ///< RSSを調べるフレームの間隔
+    static size_t const BYTES_PER_PIXEL = 16; ///< 1フレームの認識で使う、変換後の画像の1画素あたりのバイト数の見積もり
+private:
+    size_t const budget_; ///< バイト数。0なら制限しない
+    int frames_; ///< 前回RSSを調べてからのフレーム数
+    bool over_; ///< 前回調べたときに予算を超えていた
+public:
+    /*!
+    @param[in] budget_mb 予算(MB)。0なら制限しない
+    */
+    explicit MemoryBudget(int budget_mb);
+    /*!
+    @return 予算のバイト数。0なら制限しない
+    */
+    size_t budget() const { return budget_; }
+    /*!
+    1フレームの認識で使うメモリを見積もる
+    @param[in] opt オプション。カメラの大きさと縮尺を使う
+    @return カメラ画像と、変換後の画像の認識で使うバッファのバイト数
+    */
+    static size_t frameBytes(Option const & opt);
+    /*!
+    今のRSSに並列に認識するフレームの分を足しても予算に収まるよう、並列数を減らす
+    @param[in] workers 並列に認識するフレーム数
+    @param[in] frame_bytes 1フレームの認識で使うメモリ(frameBytes)
+    @return 予算に収まる並列数。1でも収まらなければ1
+    */
+    int fitWorkers(int workers, size_t frame_bytes) const;
+    /*!
+    1フレームごとに呼ぶ。CHECK_FRAMESごとにRSSを調べる
+    フレームを取得するスレッドから呼ぶこと
+    @return 予算を超えていればfalse
+    */
+    bool check();
+};
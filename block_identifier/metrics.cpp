@@ -0,0 +1,135 @@
+#include "metrics.h"
+#include "memory_budget.h"
+#include <boost/format.hpp>
+#include <algorithm>
+#include <sstream>
+
+LatencyHistogram::LatencyHistogram()
+    : sum_us_(0)
+    , count_(0)
+    , max_us_(0)
+{
+    for (auto & c : counts_){
+        c.store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::index(uint64_t us)
+{
+    if (us < SUB){
+        return static_cast<int>(us);
+    }
+    int e = SUB_BITS;
+    while (us >> (e + 1)){
+        ++e;
+    }
+    int const i = (e - SUB_BITS + 1) * SUB + static_cast<int>((us >> (e - SUB_BITS)) - SUB);
+    return i < BUCKETS ? i : BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::upper(int index)
+{
+    if (index < SUB){
+        return index + 1;
+    }
+    int const e = index / SUB + SUB_BITS - 1;
+    return static_cast<uint64_t>(SUB + index % SUB + 1) << (e - SUB_BITS);
+}
+
+void LatencyHistogram::record(std::chrono::steady_clock::duration d)
+{
+    auto const us = static_cast<uint64_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(d).count()));
+    counts_[index(us)].fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(us, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    auto max = max_us_.load(std::memory_order_relaxed);
+    while (max < us && !max_us_.compare_exchange_weak(max, us, std::memory_order_relaxed)){
+    }
+}
+
+uint64_t LatencyHistogram::quantile(double q) const
+{
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKETS; ++i){
+        total += count(i);
+    }
+    if (total == 0){
+        return 0;
+    }
+    auto const rank = static_cast<uint64_t>(q * (total - 1));
+    uint64_t cumulative = 0;
+    for (int i = 0; i < BUCKETS; ++i){
+        cumulative += count(i);
+        if (rank < cumulative){
+            return std::min(upper(i), max_us());
+        }
+    }
+    return max_us();
+}
+
+Metrics * Metrics::instance_ = nullptr;
+
+void Metrics::init()
+{
+    // 終了するまで使うスレッドがあるので、解放しない
+    if (!instance_){
+        instance_ = new Metrics();
+    }
+}
+
+std::string Metrics::exposition() const
+{
+    std::ostringstream os;
+    auto histogram = [&os](char const * name, char const * help, LatencyHistogram const & h){
+        os << boost::format("# HELP block_identifier_%s_seconds %s\n") % name % help
+            << boost::format("# TYPE block_identifier_%s_seconds histogram\n") % name;
+        // 記録中に読むので、バケットの合計とcountは一致しないことがある
+        uint64_t cumulative = 0;
+        for (int i = 0; i < LatencyHistogram::BUCKETS; ++i){
+            cumulative += h.count(i);
+            os << boost::format("block_identifier_%s_seconds_bucket{le=\"%g\"} %d\n") % name % (LatencyHistogram::upper(i) * 1e-6) % cumulative;
+        }
+        os << boost::format("block_identifier_%s_seconds_bucket{le=\"+Inf\"} %d\n") % name % cumulative
+            << boost::format("block_identifier_%s_seconds_sum %g\n") % name % (h.sum_us() * 1e-6)
+            << boost::format("block_identifier_%s_seconds_count %d\n") % name % cumulative;
+    };
+    auto counter = [&os](char const * name, char const * help, Counter const & c){
+        os << boost::format("# HELP block_identifier_%s_total %s\n") % name % help
+            << boost::format("# TYPE block_identifier_%s_total counter\n") % name
+            << boost::format("block_identifier_%s_total %d\n") % name % c.get();
+    };
+    auto gauge = [&os](char const * name, char const * help, size_t value){
+        os << boost::format("# HELP block_identifier_%s %s\n") % name % help
+            << boost::format("# TYPE block_identifier_%s gauge\n") % name
+            << boost::format("block_identifier_%s %d\n") % name % value;
+    };
+    histogram("capture", "Camera frame capture latency.", capture);
+    histogram("identify", "Block identification latency.", identify);
+    histogram("trigger_to_send", "Latency from trigger to the end of sending.", trigger_to_send);
+    histogram("http_round_trip", "HTTP round trip to the Python process.", http_round_trip);
+    histogram("frame_age", "Age of the sent frame at trigger time.", frame_age);
+    histogram("result_age", "Latency from frame capture to publishing its result.", result_age);
+    histogram("preview_encode", "Drawing and JPEG encoding of a preview frame.", preview_encode);
+    counter("frames", "Identified frames.", frames);
+    counter("dropped_frames", "Frames the camera failed to deliver.", dropped_frames);
+    counter("empty_detections", "Frames without any block.", empty_detections);
+    counter("skipped_frames", "Frames skipped because identification could not keep up.", skipped_frames);
+    counter("idle_frames", "Frames discarded without identification while idle.", idle_frames);
+    counter("governor_wakeups", "Resumptions from idle by motion or trigger.", governor_wakeups);
+    counter("stale_results", "Results discarded because they were overtaken or too old.", stale_results);
+    counter("unmapped_blocks", "Blocks not mapped with any instructions.", unmapped_blocks);
+    counter("send_successes", "Successful sends to the Python process.", send_successes);
+    counter("send_failures", "Failed sends to the Python process after retries.", send_failures);
+    counter("send_timeouts", "Send attempts that timed out while connecting or waiting for the response.", send_timeouts);
+    counter("send_retries", "Retried send attempts.", send_retries);
+    counter("send_rejected", "Sends rejected while the circuit breaker was open.", send_rejected);
+    counter("breaker_opens", "Times the circuit breaker opened because the Python process seemed down.", breaker_opens);
+    counter("log_dropped", "Log records dropped because the thread's ring was full.", log_dropped);
+    counter("preview_frames", "Encoded preview frames.", preview_frames);
+    counter("preview_bytes", "Bytes sent to preview viewers.", preview_bytes);
+    counter("preview_skipped", "Preview frames not sent to a viewer that could not keep up.", preview_skipped);
+    counter("memory_over_budget", "Resident memory checks over the --memory-budget.", memory_over_budget);
+    gauge("resident_memory_bytes", "Resident set size of the process.", residentBytes());
+    gauge("peak_resident_memory_bytes", "Peak resident set size of the process.", peakResidentBytes());
+    return os.str();
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/*!
+カウンタ
+*/
+class Counter
+{
+    std::atomic<uint64_t> value_;
+public:
+    Counter() : value_(0) {}
+    void add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+};
+
+/*!
+遅延のヒストグラム
+HDR Histogramと同様に、2倍ごとの区間をさらに4分割したマイクロ秒単位のバケットに記録する
+記録はロックしない
+*/
+class LatencyHistogram
+{
+public:
+    static int const SUB_BITS = 2;
+    static int const SUB = 1 << SUB_BITS;
+    static int const OCTAVES = 27; ///< 2^27us(約134秒)まで
+    static int const BUCKETS = (OCTAVES - SUB_BITS + 1) * SUB;
+private:
+    std::atomic<uint64_t> counts_[BUCKETS];
+    std::atomic<uint64_t> sum_us_;
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> max_us_;
+public:
+    LatencyHistogram();
+    /*!
+    @param[in] us 遅延(マイクロ秒)
+    @return バケット番号
+    */
+    static int index(uint64_t us);
+    /*!
+    @return バケットの上限(マイクロ秒、この値は含まない)
+    */
+    static uint64_t upper(int index);
+    /*!
+    遅延を記録する
+    */
+    void record(std::chrono::steady_clock::duration d);
+    /*!
+    開始時刻から現在までの遅延を記録する
+    */
+    void since(std::chrono::steady_clock::time_point begin) { record(std::chrono::steady_clock::now() - begin); }
+    uint64_t count(int index) const { return counts_[index].load(std::memory_order_relaxed); }
+    uint64_t sum_us() const { return sum_us_.load(std::memory_order_relaxed); }
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max_us() const { return max_us_.load(std::memory_order_relaxed); }
+    /*!
+    @param[in] q 0から1の分位
+    @return 分位を含むバケットの上限(マイクロ秒)。記録がなければ0
+    */
+    uint64_t quantile(double q) const;
+};
+
+/*!
+プロセス全体の計測値
+*/
+struct Metrics
+{
+    LatencyHistogram capture; ///< カメラ画像の取得
+    LatencyHistogram identify; ///< ブロック認識
+    LatencyHistogram trigger_to_send; ///< トリガーから送信完了まで
+    LatencyHistogram http_round_trip; ///< HTTPの接続からレスポンス受信まで
+    LatencyHistogram frame_age; ///< トリガー時点で送信するフレームの撮影からの経過時間
+    LatencyHistogram result_age; ///< 撮影から認識結果を公開するまで
+    LatencyHistogram preview_encode; ///< プレビューの描画とJPEGエンコード
+    Counter frames; ///< 認識したフレーム数
+    Counter dropped_frames; ///< 取得に失敗したフレーム数
+    Counter empty_detections; ///< ブロックが見つからなかったフレーム数
+    Counter skipped_frames; ///< 認識が追いつかず捨てたフレーム数
+    Counter idle_frames; ///< 待機中に認識せずに捨てたフレーム数
+    Counter governor_wakeups; ///< 動きかトリガーで待機をやめた回数
+    Counter stale_results; ///< 古くなり公開しなかった認識結果数
+    Counter unmapped_blocks; ///< 命令が対応付けられていないブロック数
+    Counter send_successes; ///< 送信成功数
+    Counter send_failures; ///< 送信失敗数(再送しても送れなかった送信)
+    Counter send_timeouts; ///< 待ち時間を過ぎた送信の試行数
+    Counter send_retries; ///< 再送数
+    Counter send_rejected; ///< 送信先が止まっているとみなして送らなかった数
+    Counter breaker_opens; ///< 送信先が止まっているとみなした回数
+    Counter log_dropped; ///< リングバッファがいっぱいで捨てたログ数
+    Counter preview_frames; ///< エンコードしたプレビューのフレーム数
+    Counter preview_bytes; ///< プレビューの送信バイト数
+    Counter preview_skipped; ///< 送信が追いつかず接続に送らなかったプレビューのフレーム数
+    Counter memory_over_budget; ///< RSSを調べたときに予算を超えていた回数
+
+    /*!
+    プロセス全体の計測値を作る。mainで他のスレッドを作る前に呼ぶ
+    */
+    static void init();
+    /*!
+    @return プロセス全体の計測値
+    */
+    static Metrics & get() { return *instance_; }
+    /*!
+    @return Prometheusのテキスト形式
+    */
+    std::string exposition() const;
+private:
+    static Metrics * instance_; ///< VS2013では関数内の静的変数の初期化がスレッドセーフでないので、initで作る
+};
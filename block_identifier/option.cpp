@@ -1,12 +1,17 @@
 #include "option.h"
+#include "classify.h"
 #include <boost/serialization/string.hpp>
 #include <boost/serialization/nvp.hpp>
 #include <boost/serialization/map.hpp>
 #include <boost/serialization/vector.hpp>
+#include <boost/serialization/version.hpp>
 #include <boost/archive/xml_oarchive.hpp>
 #include <boost/archive/xml_iarchive.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/format.hpp>
 #include <fstream>
+#include <set>
+#include <type_traits>
 
 namespace boost {
     namespace serialization {
@@ -50,6 +55,32 @@ namespace boost {
             ar & boost::serialization::make_nvp("camera_ratio", v.camera_ratio);
             ar & boost::serialization::make_nvp("block_height", v.block_height);
             ar & boost::serialization::make_nvp("block_width", v.block_width);
+            if (1 <= version){
+                ar & boost::serialization::make_nvp("pyramid", v.pyramid);
+            }
+            else{
+                v.pyramid = 1;
+            }
+            if (2 <= version){
+                ar & boost::serialization::make_nvp("color_ratio", v.color_ratio);
+            }
+            else{
+                v.color_ratio = 0.2;
+            }
+            if (3 <= version){
+                ar & boost::serialization::make_nvp("segmentation", v.segmentation);
+                ar & boost::serialization::make_nvp("background_threshold", v.background_th);
+            }
+            else{
+                v.segmentation = SEGMENT_HLS;
+                v.background_th = 25;
+            }
+            if (4 <= version){
+                ar & boost::serialization::make_nvp("auto_bin_threshold", v.auto_bin_th);
+            }
+            else{
+                v.auto_bin_th = 0;
+            }
         }
         
         template <class Archive>
@@ -62,6 +93,44 @@ namespace boost {
     }
 }
 
+// pyramidを追加したのでversion 1。version 0のファイルは縮小なしとして読む
+// color_ratioを追加したのでversion 2。それより前のファイルは従来の0.2として読む
+// segmentationとbackground_thresholdを追加したのでversion 3。それより前のファイルはHLSで2値化する
+// auto_bin_thresholdを追加したのでversion 4。それより前のファイルはbin_thresholdをそのまま使う
+BOOST_CLASS_VERSION(Tuning, 4)
+
+namespace {
+    /*!
+    色のデフォルト値
+    */
+    struct DefaultColor
+    {
+        char const * name; ///< 色名
+        unsigned char bgr[3]; ///< BGR値
+    };
+    DefaultColor const DEFAULT_COLORS[] = {
+#include "default_colors.hpp"
+    };
+
+    /*!
+    ブロックと命令の対応のデフォルト値
+    パラメータは0個か1個
+    */
+    struct DefaultInstruction
+    {
+        char const * color; ///< 色名
+        int width; ///< ブロック幅
+        char const * name; ///< 命令ID
+        char const * param; ///< パラメータ名(パラメータなしならnullptr)
+        double value; ///< パラメータ値
+    };
+    DefaultInstruction const DEFAULT_INSTRUCTIONS[] = {
+#include "default_instructions.hpp"
+    };
+
+    Tuning const DEFAULT_TUNING = { 40, 245, 80, 1280, 720, 0.5, 102, 150, 1, 0.2, SEGMENT_HLS, 25, 0 };
+}
+
 bool operator<(Block const & lv, Block const & rv)
 {
     return lv.color != rv.color ? lv.color < rv.color : lv.width < rv.width;
@@ -75,13 +144,19 @@ Block BlockInfo::to_block()const
 Option getDefaultOption()
 {
     Option opt;
-    opt.colors = {
-#include "default_colors.hpp"
-    };
-    opt.block2inst = std::map<Block, Instruction>{
-#include "default_instructions.hpp"
-    };
-    opt.tune = { 40, 245, 80, 1280, 720, 0.5, 102, 150 };
+    opt.colors.reserve(std::extent<decltype(DEFAULT_COLORS)>::value);
+    for (auto const & c : DEFAULT_COLORS){
+        opt.colors.push_back({ c.name, { c.bgr[0], c.bgr[1], c.bgr[2] } });
+    }
+    for (auto const & i : DEFAULT_INSTRUCTIONS){
+        Instruction inst{ i.name, Params{} };
+        if (i.param){
+            inst.param.emplace(i.param, i.value);
+        }
+        opt.block2inst.emplace(Block{ i.color, i.width }, inst);
+    }
+    opt.tune = DEFAULT_TUNING;
+    prepareOption(opt);
     return opt;
 }
 
@@ -94,10 +169,55 @@ void writeOption(std::string const & path, Option const & opt)
 
 Option readOption(std::string const & path)
 {
-    Option opt;
     std::ifstream ifs(path);
-    boost::archive::xml_iarchive ia(ifs);
+    return readOption(ifs);
+}
+
+Option readOption(std::istream & is)
+{
+    Option opt;
+    boost::archive::xml_iarchive ia(is);
     ia >> boost::serialization::make_nvp("option", opt);
+    prepareOption(opt);
     return opt;
 }
 
+
+void prepareOption(Option & opt)
+{
+    opt.table.bgr.clear();
+    for (auto const & c : opt.colors){
+        opt.table.bgr.emplace_back(c.bgr[0], c.bgr[1], c.bgr[2]);
+    }
+    packColorTable(opt.table);
+}
+
+void validateOption(Option const & opt)
+{
+    auto check = [](bool ok, std::string const & what){
+        if (!ok){
+            throw std::runtime_error("invalid option: " + what);
+        }
+    };
+    check(!opt.colors.empty() && opt.colors.size() <= 255, "color count should be 1-255");
+    check(opt.table.bgr.size() == opt.colors.size(), "color table is not prepared");
+    std::set<std::string> names;
+    for (auto const & c : opt.colors){
+        check(names.insert(c.name).second, (boost::format("color %s is duplicated") % c.name).str());
+    }
+    for (auto const & item : opt.block2inst){
+        check(names.count(item.first.color) != 0, (boost::format("block-instruction-map uses unknown color %s") % item.first.color).str());
+    }
+    auto const & tune = opt.tune;
+    check(0 <= tune.stud_th && tune.stud_th <= 255, "stud_threshold should be 0-255");
+    check(0 <= tune.size_th && tune.size_th <= 255, "size_threshold should be 0-255");
+    check(0 <= tune.bin_th && tune.bin_th <= 255, "bin_threshold should be 0-255");
+    check(0 < tune.camera_width && 0 < tune.camera_height, "camera size should be positive");
+    check(0 < tune.camera_ratio && tune.camera_ratio <= 1, "camera_ratio should be (0, 1]");
+    check(0 < tune.get_block_height() && 0 < tune.get_block_width(), "block size should be positive");
+    check(0 < tune.color_ratio && tune.color_ratio <= 1, "color_ratio should be (0, 1]");
+    check(tune.pyramid == 1 || tune.pyramid == 2 || tune.pyramid == 4 || tune.pyramid == 8, "pyramid should be 1, 2, 4 or 8");
+    check(tune.segmentation == SEGMENT_HLS || tune.segmentation == SEGMENT_BACKGROUND, "segmentation should be 0 (hls) or 1 (background)");
+    check(0 <= tune.background_th && tune.background_th < 255, "background_threshold should be 0-254");
+    check(tune.auto_bin_th == 0 || tune.auto_bin_th == 1, "auto_bin_threshold should be 0 or 1");
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <opencv2/opencv.hpp>
+#include <chrono>
 
 /*!
 色情報
@@ -22,6 +23,15 @@ struct Instruction
     Params param; ///< パラメータ
 };
 
+/*!
+ブロックの領域を抽出する方法
+*/
+enum Segmentation
+{
+    SEGMENT_HLS = 0, ///< HLSのLとSの平均をbin_thで2値化する
+    SEGMENT_BACKGROUND = 1, ///< 背景との差分をbackground_thで2値化する。カメラを固定し、起動直後はブロックを置かないこと
+};
+
 /*!
  ブロック識別のチューニングパラメータ
  */
@@ -35,6 +45,11 @@ struct Tuning
     double camera_ratio; ///< カメラ画像縮尺率
     int block_height; ///< ブロック高さ（縮尺前）
     int block_width; ///< ブロック幅（2ぼっち分）（縮尺前）
+    int pyramid; ///< ブロック領域を探す画像の縮小率(1, 2, 4, 8)。1なら縮小しない
+    double color_ratio; ///< ブロック色判定領域の大きさ(ブロックの矩形に対する比率)
+    int segmentation; ///< ブロックの領域を抽出する方法(Segmentation)
+    int background_th; ///< 背景差分の閾値。チャンネルごとの差の最大がこれを超えた画素をブロックとする
+    int auto_bin_th; ///< 0以外ならbin_thを画像のヒストグラムから自動で決める。bin_thは決まるまでの初期値
     int get_block_width() const { return static_cast<int>(block_width * camera_ratio); }
     int get_block_height() const { return static_cast<int>(block_height * camera_ratio); }
 };
@@ -54,6 +69,18 @@ std::mapのキーにするために作成
 */
 bool operator<(Block const & lv, Block const & rv);
 
+/*!
+色判定用のテーブル
+色判定のたびに作らないよう、オプションを読み込んだときに作る
+*/
+struct ColorTable
+{
+    std::vector<cv::Vec3i> bgr; ///< colorsと同じ順序のBGR値
+    std::vector<short> bg; ///< 色ごとの(B,G)。4色単位になるよう遠い色で埋める
+    std::vector<short> r; ///< 色ごとの(R,0)。bgと同じく埋める
+    std::vector<uchar> lut; ///< BGRを各5ビットに量子化した値から最も近い色の番号を引く表
+};
+
 /*!
 オプションファイルの情報
 */
@@ -62,6 +89,16 @@ struct Option
     std::vector<Color> colors; ///< 色情報
     std::map<Block, Instruction> block2inst; ///< 色と命令のマップ
     Tuning tune; ///< ブロック識別のチューニングパラメータ
+    ColorTable table; ///< 色判定用のテーブル(colorsから作る。保存しない)
+};
+
+/*!
+フレームの識別情報
+*/
+struct FrameStamp
+{
+    uint64_t id = 0; ///< フレーム番号。1から増加し、0は不明
+    std::chrono::steady_clock::time_point captured; ///< 撮影時刻(カメラ画像を受け取った時刻)
 };
 
 /*!
@@ -73,7 +110,9 @@ struct BlockInfo
     cv::Rect rc; ///< ブロックの矩形
     cv::Rect color_area; ///< ブロック色判定領域
     cv::Vec3b ave; ///< 平均色
+    double confidence; ///< 色判定領域のうちcolorに分類された画素の割合
     int width; ///< 横幅: 1, 2, 3
+    FrameStamp frame; ///< 認識したフレーム
     Block to_block()const; ///< Block型へ変換する
 };
 
@@ -95,3 +134,33 @@ void writeOption(std::string const & path, Option const & opt);
 @return オプション
 */
 Option readOption(std::string const & path);
+
+/*!
+ストリームからオプションを読み出す
+@param[in] is XMLの入力ストリーム
+@return オプション
+*/
+Option readOption(std::istream & is);
+
+/*!
+ファイルに保存したオプションを読み出す
+XMLを読み込んだときにバイナリのスナップショット(path + ".bin")を保存し、
+次回XMLが変わっていなければXMLを解析せずにスナップショットをメモリマップして読み出す
+@param[in] path XMLファイルのパス
+@return オプション
+*/
+Option readOptionCached(std::string const & path);
+
+/*!
+オプションから派生データを作り直す
+colorsを変更したら呼ぶこと
+@param[in,out] opt オプション
+*/
+void prepareOption(Option & opt);
+
+/*!
+オプションの値を検証する
+@param[in] opt オプション
+@note 不正な値がある場合例外を投げる
+*/
+void validateOption(Option const & opt);
@@ -0,0 +1,254 @@
+#include "option.h"
+#include <boost/format.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    uint32_t const MAGIC = 0x434F4942; ///< "BIOC"
+    uint32_t const VERSION = 5; ///< Optionの構造を変えたら上げる
+    uint32_t const ENDIAN_MARK = 0x01020304;
+
+    /*!
+    スナップショットのヘッダ
+    */
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t endian_mark;
+        uint32_t reserved;
+        uint64_t xml_size; ///< 元のXMLのサイズ
+        uint64_t xml_hash; ///< 元のXMLのハッシュ値
+        uint64_t payload_size; ///< ヘッダ以降のサイズ
+        uint64_t payload_hash; ///< ヘッダ以降のハッシュ値
+    };
+
+    /*!
+    FNV-1aハッシュ
+    */
+    uint64_t hash(char const * data, size_t size)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; ++i){
+            h ^= static_cast<unsigned char>(data[i]);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    /*!
+    スナップショットの書き込み
+    */
+    class Writer
+    {
+        std::string buf_;
+    public:
+        template <class T>
+        void pod(T const & v)
+        {
+            buf_.append(reinterpret_cast<char const *>(&v), sizeof(v));
+        }
+        void str(std::string const & s)
+        {
+            pod(static_cast<uint32_t>(s.size()));
+            buf_.append(s);
+        }
+        std::string const & data() const { return buf_; }
+    };
+
+    /*!
+    スナップショットの読み出し
+    範囲外を読もうとしたら例外を投げる
+    */
+    class Reader
+    {
+        char const * p_;
+        char const * end_;
+        void need(size_t size)
+        {
+            if (static_cast<size_t>(end_ - p_) < size){
+                throw std::runtime_error("option snapshot is truncated.");
+            }
+        }
+    public:
+        Reader(char const * p, size_t size) : p_(p), end_(p + size) {}
+        template <class T>
+        T pod()
+        {
+            need(sizeof(T));
+            T v;
+            std::memcpy(&v, p_, sizeof(T));
+            p_ += sizeof(T);
+            return v;
+        }
+        std::string str()
+        {
+            auto const size = pod<uint32_t>();
+            need(size);
+            std::string s(p_, size);
+            p_ += size;
+            return s;
+        }
+    };
+
+    std::string encode(Option const & opt)
+    {
+        Writer w;
+        w.pod(static_cast<uint32_t>(opt.colors.size()));
+        for (auto const & c : opt.colors){
+            w.str(c.name);
+            w.pod(c.bgr[0]);
+            w.pod(c.bgr[1]);
+            w.pod(c.bgr[2]);
+        }
+        w.pod(static_cast<uint32_t>(opt.block2inst.size()));
+        for (auto const & item : opt.block2inst){
+            w.str(item.first.color);
+            w.pod(static_cast<int32_t>(item.first.width));
+            w.str(item.second.name);
+            w.pod(static_cast<uint32_t>(item.second.param.size()));
+            for (auto const & param : item.second.param){
+                w.str(param.first);
+                w.pod(param.second);
+            }
+        }
+        auto const & tune = opt.tune;
+        for (auto v : { tune.stud_th, tune.size_th, tune.bin_th, tune.camera_width, tune.camera_height }){
+            w.pod(static_cast<int32_t>(v));
+        }
+        w.pod(tune.camera_ratio);
+        w.pod(static_cast<int32_t>(tune.block_height));
+        w.pod(static_cast<int32_t>(tune.block_width));
+        w.pod(static_cast<int32_t>(tune.pyramid));
+        w.pod(tune.color_ratio);
+        w.pod(static_cast<int32_t>(tune.segmentation));
+        w.pod(static_cast<int32_t>(tune.background_th));
+        w.pod(static_cast<int32_t>(tune.auto_bin_th));
+        return w.data();
+    }
+
+    Option decode(char const * data, size_t size)
+    {
+        Reader r(data, size);
+        Option opt;
+        opt.colors.resize(r.pod<uint32_t>());
+        for (auto & c : opt.colors){
+            c.name = r.str();
+            c.bgr[0] = r.pod<uchar>();
+            c.bgr[1] = r.pod<uchar>();
+            c.bgr[2] = r.pod<uchar>();
+        }
+        for (auto n = r.pod<uint32_t>(); 0 < n; --n){
+            Block block;
+            block.color = r.str();
+            block.width = r.pod<int32_t>();
+            Instruction inst;
+            inst.name = r.str();
+            for (auto m = r.pod<uint32_t>(); 0 < m; --m){
+                auto const name = r.str();
+                inst.param[name] = r.pod<double>();
+            }
+            opt.block2inst.emplace_hint(opt.block2inst.end(), block, inst);
+        }
+        auto & tune = opt.tune;
+        for (auto v : { &tune.stud_th, &tune.size_th, &tune.bin_th, &tune.camera_width, &tune.camera_height }){
+            *v = r.pod<int32_t>();
+        }
+        tune.camera_ratio = r.pod<double>();
+        tune.block_height = r.pod<int32_t>();
+        tune.block_width = r.pod<int32_t>();
+        tune.pyramid = r.pod<int32_t>();
+        tune.color_ratio = r.pod<double>();
+        tune.segmentation = r.pod<int32_t>();
+        tune.background_th = r.pod<int32_t>();
+        tune.auto_bin_th = r.pod<int32_t>();
+        prepareOption(opt);
+        return opt;
+    }
+
+    /*!
+    スナップショットをメモリマップして読み出す
+    @param[in] cache スナップショットのパス
+    @param[in] xml 元のXML
+    @param[out] opt オプション
+    @retval true 読み出せた
+    @retval false スナップショットがないか、XMLと一致しない
+    */
+    bool loadSnapshot(std::string const & cache, std::string const & xml, Option & opt)
+    {
+        namespace bip = boost::interprocess;
+        try{
+            bip::file_mapping file(cache.c_str(), bip::read_only);
+            bip::mapped_region region(file, bip::read_only);
+            auto const data = static_cast<char const *>(region.get_address());
+            Header header;
+            if (region.get_size() < sizeof(header)){
+                return false;
+            }
+            std::memcpy(&header, data, sizeof(header));
+            if (header.magic != MAGIC || header.version != VERSION || header.endian_mark != ENDIAN_MARK ||
+                header.xml_size != xml.size() || header.xml_hash != hash(xml.data(), xml.size()) ||
+                header.payload_size != region.get_size() - sizeof(header) ||
+                header.payload_hash != hash(data + sizeof(header), header.payload_size))
+            {
+                return false;
+            }
+            opt = decode(data + sizeof(header), header.payload_size);
+            return true;
+        }
+        catch (std::exception const &){
+            return false;
+        }
+    }
+
+    /*!
+    スナップショットを保存する
+    読み込み中のプロセスが壊れたファイルを見ないよう、一時ファイルに書いてから置き換える
+    */
+    void saveSnapshot(std::string const & cache, std::string const & xml, Option const & opt)
+    {
+        auto const payload = encode(opt);
+        Header header = { MAGIC, VERSION, ENDIAN_MARK, 0,
+            xml.size(), hash(xml.data(), xml.size()),
+            payload.size(), hash(payload.data(), payload.size()) };
+        auto const tmp = cache + ".tmp";
+        {
+            std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+            ofs.write(reinterpret_cast<char const *>(&header), sizeof(header));
+            ofs.write(payload.data(), payload.size());
+            if (!ofs){
+                std::cerr << boost::format("failed to write option snapshot %s") % tmp << std::endl;
+                return;
+            }
+        }
+#if defined _WIN32 || defined _WIN64
+        std::remove(cache.c_str()); // windowsのrenameは上書きしない
+#endif // defined _WIN32 || defined _WIN64
+        if (std::rename(tmp.c_str(), cache.c_str()) != 0){
+            std::cerr << boost::format("failed to write option snapshot %s") % cache << std::endl;
+        }
+    }
+}
+
+Option readOptionCached(std::string const & path)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs){
+        throw std::runtime_error((boost::format("failed to open option file %s") % path).str());
+    }
+    std::string const xml((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    auto const cache = path + ".bin";
+    Option opt;
+    if (loadSnapshot(cache, xml, opt)){
+        return opt;
+    }
+    std::istringstream iss(xml);
+    opt = readOption(iss);
+    saveSnapshot(cache, xml, opt);
+    return opt;
+}
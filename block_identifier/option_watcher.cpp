@@ -0,0 +1,143 @@
+#include "option_watcher.h"
+#include "log.h"
+#include <chrono>
+
+#if defined __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+    /*!
+    パスをディレクトリ名とファイル名に分ける
+    エディタは一時ファイルをリネームして保存することがあるので、ディレクトリを監視する
+    */
+    std::pair<std::string, std::string> splitPath(std::string const & path)
+    {
+        auto const pos = path.find_last_of("/\\");
+        if (pos == std::string::npos){
+            return { ".", path };
+        }
+        return { path.substr(0, pos + 1), path.substr(pos + 1) };
+    }
+}
+#else
+#include <sys/stat.h>
+#endif // defined __linux__
+
+OptionWatcher::Reader::Reader(OptionWatcher const & watcher)
+    : watcher_(watcher)
+    , generation_(watcher.generation_.load())
+{
+    std::unique_lock<std::mutex> lock(watcher_.mutex_);
+    opt_ = watcher_.current_;
+}
+
+Option const & OptionWatcher::Reader::get()
+{
+    if (watcher_.generation_.load(std::memory_order_acquire) != generation_){
+        std::unique_lock<std::mutex> lock(watcher_.mutex_);
+        opt_ = watcher_.current_;
+        generation_ = watcher_.generation_.load();
+    }
+    return *opt_;
+}
+
+OptionWatcher::OptionWatcher(std::string const & path, Option const & opt)
+    : path_(path)
+    , current_(std::make_shared<const Option>(opt))
+    , generation_(0)
+    , stop_(false)
+{
+    if (!path_.empty()){
+        thread_ = std::thread([this]{ watch(); });
+    }
+}
+
+OptionWatcher::~OptionWatcher()
+{
+    stop_ = true;
+    if (thread_.joinable()){
+        thread_.join();
+    }
+}
+
+void OptionWatcher::reload()
+{
+    try{
+        auto opt = std::make_shared<Option>(readOptionCached(path_));
+        validateOption(*opt);
+        std::shared_ptr<const Option> old;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            old = current_;
+            current_ = opt;
+            generation_.fetch_add(1, std::memory_order_release);
+        }
+        if (old->tune.camera_width != opt->tune.camera_width || old->tune.camera_height != opt->tune.camera_height){
+            LOG_WARN("option", "camera_width and camera_height are applied after restart.");
+        }
+        LOG_INFO("option", "reloaded option file %s", path_);
+        // 古いスナップショットは最後の読み出し口が手放したときに解放される
+    }
+    catch (std::exception const & e){
+        LOG_ERROR("option", "failed to reload option file %s: %s", path_, e.what());
+    }
+}
+
+#if defined __linux__
+void OptionWatcher::watch()
+{
+    auto const dir_file = splitPath(path_);
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dir_file.first.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0){
+        LOG_ERROR("option", "failed to watch option file %s", path_);
+        if (0 <= fd){
+            close(fd);
+        }
+        return;
+    }
+    std::vector<char> buffer(4096);
+    bool changed = false;
+    while (!stop_){
+        pollfd pfd = { fd, POLLIN, 0 };
+        // 保存中のイベントをまとめるため、変更後は少し待ってから読み込む
+        int const ready = poll(&pfd, 1, changed ? 100 : 500);
+        if (ready == 0 && changed){
+            changed = false;
+            reload();
+            continue;
+        }
+        if (ready <= 0){
+            continue;
+        }
+        auto const size = read(fd, buffer.data(), buffer.size());
+        for (ssize_t pos = 0; 0 < size && pos < size;){
+            auto const event = reinterpret_cast<inotify_event const *>(buffer.data() + pos);
+            if (event->len && dir_file.second == event->name){
+                changed = true;
+            }
+            pos += sizeof(inotify_event) + event->len;
+        }
+    }
+    close(fd);
+}
+#else
+void OptionWatcher::watch()
+{
+    // inotifyがない環境では更新日時を1秒ごとに確認する
+    auto mtime = [this]{
+        struct stat st;
+        return stat(path_.c_str(), &st) == 0 ? st.st_mtime : 0;
+    };
+    auto last = mtime();
+    while (!stop_){
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        auto const now = mtime();
+        if (now != last){
+            last = now;
+            reload();
+        }
+    }
+}
+#endif // defined __linux__
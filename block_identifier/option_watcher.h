@@ -0,0 +1,65 @@
+#pragma once
+
+#include "option.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*!
+オプションファイルを監視し、変更されたら読み込み直すクラス
+読み込んだオプションは変更しないスナップショットとして公開する
+*/
+class OptionWatcher
+{
+    OptionWatcher & operator=(OptionWatcher const &) = delete;
+    OptionWatcher(OptionWatcher const &) = delete;
+
+    std::string const path_;
+    mutable std::mutex mutex_;
+    std::shared_ptr<const Option> current_; ///< mutex_で保護する
+    std::atomic<unsigned> generation_;
+    std::atomic<bool> stop_;
+    std::thread thread_;
+
+    /*!
+    ファイルの変更を待ち、読み込み直す
+    */
+    void watch();
+    /*!
+    ファイルを読み込み、検証してから公開する
+    */
+    void reload();
+public:
+    /*!
+    スレッドごとに持つ読み出し口
+    新しいオプションが公開されていなければロックしない
+    */
+    class Reader
+    {
+        OptionWatcher const & watcher_;
+        std::shared_ptr<const Option> opt_;
+        unsigned generation_;
+    public:
+        explicit Reader(OptionWatcher const & watcher);
+        /*!
+        フレームの境目で呼ぶ。新しいオプションが公開されていれば取り込む
+        戻り値は次に呼ぶまで有効
+        @return オプション
+        */
+        Option const & get();
+        /*!
+        最後にgetで取り込んだオプションを共有する
+        別のスレッドで後から読むときに使う
+        @return オプション
+        */
+        std::shared_ptr<const Option> const & share() const { return opt_; }
+    };
+
+    /*!
+    @param[in] path オプションファイルのパス。空なら監視しない
+    @param[in] opt 最初のオプション
+    */
+    OptionWatcher(std::string const & path, Option const & opt);
+    ~OptionWatcher();
+};
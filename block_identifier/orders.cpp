@@ -0,0 +1,32 @@
+#include "orders.h"
+#include "picojson.h"
+
+std::string makeOrdersJson(Option const & opt, std::vector<BlockInfo> const & blockInfo, std::function<void(BlockInfo const &)> unmapped)
+{
+    using value = picojson::value;
+    picojson::array orders;
+    for (auto const & info : blockInfo){
+        auto const inst = opt.block2inst.find(info.to_block());
+        if (inst == opt.block2inst.end()){
+            if (unmapped){
+                unmapped(info);
+            }
+            continue;
+        }
+        picojson::object item;
+        item["id"] = value(inst->second.name);
+        for (auto const & param : inst->second.param){
+            item[param.first] = value(param.second);
+        }
+        orders.emplace_back(item);
+    }
+    picojson::object root;
+    root["orders"] = value(orders);
+    // 描画側でパイプライン全体の遅延を測れるように、フレームの情報があれば付ける
+    if (!blockInfo.empty() && blockInfo.front().frame.id != 0){
+        auto const & frame = blockInfo.front().frame;
+        root["frame_id"] = value(static_cast<double>(frame.id));
+        root["frame_age_ms"] = value(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame.captured).count());
+    }
+    return value(root).serialize();
+}
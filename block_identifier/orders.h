@@ -0,0 +1,13 @@
+#pragma once
+
+#include "option.h"
+#include <functional>
+
+/*!
+ブロック情報を命令に変換し、描画側へ送るJSONを作る
+@param[in] opt オプション
+@param[in] blockInfo ブロック情報
+@param[in] unmapped 命令が対応付けられていないブロックごとに呼ぶ関数。省略可
+@return {"orders": [{"id": 命令名, パラメータ名: 値, ...}, ...]}の形式のJSON
+*/
+std::string makeOrdersJson(Option const & opt, std::vector<BlockInfo> const & blockInfo, std::function<void(BlockInfo const &)> unmapped = nullptr);
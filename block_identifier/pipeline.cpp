@@ -0,0 +1,97 @@
+#include "pipeline.h"
+#include "metrics.h"
+#include "trace.h"
+#include <boost/format.hpp>
+
+IdentifyPipeline::IdentifyPipeline(OptionWatcher const & watcher, int workers, clock_type::duration max_age, Identify identify, ThreadPolicy const & policy)
+    : watcher_(watcher)
+    , identify_(identify)
+    , workers_(std::max(1, workers))
+    , max_age_(max_age)
+    , policy_(policy)
+    , submitted_(0)
+    , published_(0)
+    , stop_(false)
+{
+    for (size_t i = 0; i < workers_; ++i){
+        threads_.emplace_back([this, i]{ work(static_cast<int>(i)); });
+    }
+}
+
+IdentifyPipeline::~IdentifyPipeline()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for (auto & th : threads_){
+        th.join();
+    }
+}
+
+void IdentifyPipeline::work(int index)
+{
+    auto const name = (boost::format("identify %d") % index).str();
+    Trace::setThreadName(name);
+    applyThreadPolicy(name, policy_);
+    OptionWatcher::Reader reader(watcher_);
+    std::vector<BlockInfo> blockInfo;
+    for (;;){
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this]{ return stop_ || !pending_.empty(); });
+            if (stop_){
+                return;
+            }
+            job = std::move(pending_.front());
+            pending_.pop_front();
+            running_.emplace(job.seq, job.frame.captured);
+        }
+        identify_(job.image, reader.get(), blockInfo, job.frame);
+        std::unique_lock<std::mutex> lock(mutex_);
+        running_.erase(job.seq);
+        done_.emplace(job.seq, Result{ job.image, blockInfo, job.frame });
+    }
+}
+
+void IdentifyPipeline::submit(cv::Mat const & image, FrameStamp const & frame)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // ワーカーが空くまでに次のフレームが届くので、待たせるのは1巡分までにする
+        if (workers_ <= pending_.size()){
+            pending_.pop_front();
+            Metrics::get().skipped_frames.add();
+        }
+        pending_.push_back(Job{ ++submitted_, image, frame });
+    }
+    cond_.notify_one();
+}
+
+bool IdentifyPipeline::next(Result & result)
+{
+    auto const now = clock_type::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!done_.empty()){
+        auto it = done_.begin();
+        // 先に撮影したフレームが認識中なら待つ。ただし古くなったら追い越す
+        if (!running_.empty() && running_.begin()->first < it->first && now - running_.begin()->second < max_age_){
+            return false;
+        }
+        bool const overtaken = it->first <= published_;
+        bool const stale = max_age_ < now - it->second.frame.captured && 1 < done_.size();
+        if (overtaken || stale){
+            done_.erase(it);
+            Metrics::get().stale_results.add();
+            continue;
+        }
+        published_ = it->first;
+        Metrics::get().result_age.record(now - it->second.frame.captured);
+        result = std::move(it->second);
+        done_.erase(it);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "option_watcher.h"
+#include "thread_policy.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+/*!
+複数のフレームのブロック認識を並列に行い、撮影順に結果を公開するクラス
+カメラのフレームレートに1スレッドの認識が追いつかないときに使う
+*/
+class IdentifyPipeline
+{
+    IdentifyPipeline & operator=(IdentifyPipeline const &) = delete;
+    IdentifyPipeline(IdentifyPipeline const &) = delete;
+public:
+    typedef std::chrono::steady_clock clock_type;
+    /*!
+    ブロックを認識する関数。ワーカースレッドから並列に呼ぶ
+    */
+    typedef std::function<void(cv::Mat const & image, Option const & opt, std::vector<BlockInfo> & blockInfo, FrameStamp const & frame)> Identify;
+
+    /*!
+    認識結果
+    */
+    struct Result
+    {
+        cv::Mat image; ///< 認識した画像
+        std::vector<BlockInfo> blockInfo; ///< ブロック情報
+        FrameStamp frame; ///< フレームの識別情報
+    };
+private:
+    struct Job
+    {
+        uint64_t seq;
+        cv::Mat image;
+        FrameStamp frame;
+    };
+
+    OptionWatcher const & watcher_;
+    Identify const identify_;
+    size_t const workers_;
+    clock_type::duration const max_age_;
+    ThreadPolicy const policy_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Job> pending_; ///< 認識待ちのフレーム。mutex_で保護する
+    std::map<uint64_t, clock_type::time_point> running_; ///< 認識中のフレームの撮影時刻。mutex_で保護する
+    std::map<uint64_t, Result> done_; ///< 公開待ちの結果(並べ替えバッファ)。mutex_で保護する
+    uint64_t submitted_; ///< 投入したフレーム数。mutex_で保護する
+    uint64_t published_; ///< 最後に公開した結果の通し番号。mutex_で保護する
+    bool stop_; ///< mutex_で保護する
+    std::vector<std::thread> threads_;
+
+    /*!
+    ワーカースレッド
+    スレッドごとにオプションの読み出し口と結果の書き込み先を持つ
+    */
+    void work(int index);
+public:
+    /*!
+    @param[in] watcher オプション。ワーカーごとにフレームの境目で取り込む
+    @param[in] workers 並列に認識するフレーム数
+    @param[in] max_age 撮影からこの時間を過ぎた結果は、後のフレームの結果があれば公開しない
+    @param[in] identify ブロックを認識する関数
+    @param[in] policy ワーカースレッドを実行するコアとスケジューリング
+    */
+    IdentifyPipeline(OptionWatcher const & watcher, int workers, clock_type::duration max_age, Identify identify, ThreadPolicy const & policy = ThreadPolicy());
+    ~IdentifyPipeline();
+    /*!
+    フレームを投入する。ブロックしない
+    認識待ちのフレームがワーカー数を超えたら、古いものから捨てる
+    @param[in] image カメラ画像。認識が終わるまで参照するので、呼び出し側で書き換えないこと
+    @param[in] frame フレームの識別情報
+    */
+    void submit(cv::Mat const & image, FrameStamp const & frame);
+    /*!
+    撮影順で次の結果を取り出す。ブロックしない
+    先に撮影したフレームが認識中なら、それが終わるかmax_ageを過ぎるまで後の結果は待たせる
+    追い越されたフレームの結果とmax_ageを過ぎた結果は捨てる
+    @param[out] result 結果
+    @return 取り出せたらtrue
+    */
+    bool next(Result & result);
+};
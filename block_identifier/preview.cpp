@@ -0,0 +1,301 @@
+#include "preview.h"
+#include "identify.h"
+#include "http_server.h"
+#include "metrics.h"
+#include "trace.h"
+#include "thread_policy.h"
+#include <boost/asio.hpp>
+#include <boost/format.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+    typedef std::chrono::steady_clock clock_type;
+
+    char const * const BOUNDARY = "blockidframe";
+
+    /*!
+    /frame.jpgの要求からこの時間はストリームの接続がなくてもエンコードを続ける
+    */
+    std::chrono::seconds const SNAPSHOT_HOLD(10);
+
+    /*!
+    /frame.jpgで返す画像の鮮度
+    */
+    std::chrono::seconds const SNAPSHOT_FRESH(1);
+
+    char const * const INDEX_HTML =
+        "<!DOCTYPE html>\n"
+        "<html><head><meta charset=\"utf-8\"><title>block_identifier</title></head>\n"
+        "<body style=\"margin:0;background:#000\"><img src=\"/stream.mjpg\" style=\"max-width:100%\"></body></html>\n";
+
+    /*!
+    エンコードした画像と、MJPEGのパートのヘッダー
+    */
+    struct Encoded
+    {
+        std::vector<uchar> jpeg;
+        std::string part;
+        clock_type::time_point time; ///< エンコードした時刻
+    };
+
+    /*!
+    ストリームの接続
+    */
+    struct Viewer
+    {
+        std::shared_ptr<boost::asio::ip::tcp::socket> sock;
+        bool busy; ///< 書き込み中
+        bool waiting; ///< 書き込み中に新しい画像ができた
+    };
+}
+
+struct PreviewServer::Impl
+{
+    /*!
+    描画を待つフレーム
+    */
+    struct Frame
+    {
+        cv::Mat image;
+        std::shared_ptr<const Option> opt;
+        std::vector<BlockInfo> blockInfo;
+    };
+
+    PreviewConfig const config;
+    boost::asio::io_service io_service; ///< 他のメンバーより後に破棄する
+    boost::asio::io_service::work work;
+    std::shared_ptr<HttpServer> server;
+    std::atomic<int> viewers; ///< ストリームの接続数
+    std::atomic<clock_type::rep> snapshot_requested; ///< 最後に/frame.jpgを要求された時刻
+    std::mutex mutex;
+    std::condition_variable cond;
+    Frame pending; ///< mutexで保護する
+    bool has_pending; ///< mutexで保護する
+    bool stop; ///< mutexで保護する
+    std::shared_ptr<const Encoded> latest; ///< io_serviceのスレッドだけで使う
+    std::list<std::shared_ptr<Viewer>> streams; ///< io_serviceのスレッドだけで使う
+    std::thread encoder;
+    std::thread network;
+
+    explicit Impl(PreviewConfig const & config)
+        : config(config)
+        , work(io_service)
+        , viewers(0)
+        , snapshot_requested((clock_type::now() - SNAPSHOT_HOLD).time_since_epoch().count())
+        , has_pending(false)
+        , stop(false)
+    {
+    }
+
+    /*!
+    @return 見ている接続があればtrue
+    */
+    bool watched() const
+    {
+        auto const requested = clock_type::time_point(clock_type::duration(snapshot_requested.load(std::memory_order_relaxed)));
+        return 0 < viewers.load(std::memory_order_relaxed) || clock_type::now() - requested < SNAPSHOT_HOLD;
+    }
+
+    /*!
+    エンコードのスレッド
+    フレームが届いたら前回からmax_fpsの間隔を空けて、その時点で最新のフレームを描画してエンコードする
+    */
+    void encode()
+    {
+        Trace::setThreadName("preview");
+        lowerThreadPriority();
+        auto const interval = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / config.max_fps));
+        std::vector<int> const params = { CV_IMWRITE_JPEG_QUALITY, config.quality };
+        auto next = clock_type::now();
+        for (;;){
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this]{ return stop || has_pending; });
+                if (!stop && clock_type::now() < next){
+                    cond.wait_until(lock, next, [this]{ return stop; });
+                }
+                if (stop){
+                    return;
+                }
+                std::swap(frame, pending);
+                has_pending = false;
+            }
+            auto const begin = clock_type::now();
+            next = begin + interval;
+            auto encoded = std::make_shared<Encoded>();
+            {
+                TRACE_SCOPE("previewEncode");
+                cv::imencode(".jpg", drawBlockInfo(frame.image, *frame.opt, frame.blockInfo), encoded->jpeg, params);
+            }
+            encoded->part = (boost::format("--%s\r\nContent-Type: image/jpeg\r\nContent-Length: %d\r\n\r\n") % BOUNDARY % encoded->jpeg.size()).str();
+            encoded->time = clock_type::now();
+            auto & metrics = Metrics::get();
+            metrics.preview_encode.since(begin);
+            metrics.preview_frames.add();
+            io_service.post([this, encoded]{ broadcast(encoded); });
+        }
+    }
+
+    /*!
+    最新の画像を、書き込み中でない接続に送る
+    */
+    void broadcast(std::shared_ptr<const Encoded> const & encoded)
+    {
+        latest = encoded;
+        for (auto const & viewer : streams){
+            if (!viewer->busy){
+                send(viewer);
+            }
+            else if (viewer->waiting){
+                // 前に待たせた画像は送らずに終わる
+                Metrics::get().preview_skipped.add();
+            }
+            else{
+                viewer->waiting = true;
+            }
+        }
+    }
+
+    /*!
+    接続に最新の画像を書き込む
+    書き込み中に新しい画像ができていたら、書き終わってから続けて送る
+    */
+    void send(std::shared_ptr<Viewer> const & viewer)
+    {
+        auto const encoded = latest;
+        viewer->busy = true;
+        viewer->waiting = false;
+        std::vector<boost::asio::const_buffer> buffers = {
+            boost::asio::buffer(encoded->part),
+            boost::asio::buffer(encoded->jpeg),
+            boost::asio::buffer("\r\n", 2),
+        };
+        boost::asio::async_write(*viewer->sock, buffers, [this, viewer, encoded](boost::system::error_code const & ec, size_t bytes){
+            if (ec){
+                close(viewer);
+                return;
+            }
+            Metrics::get().preview_bytes.add(bytes);
+            viewer->busy = false;
+            if (viewer->waiting){
+                send(viewer);
+            }
+        });
+    }
+
+    /*!
+    接続を閉じ、ストリームの送り先から外す
+    */
+    void close(std::shared_ptr<Viewer> const & viewer)
+    {
+        boost::system::error_code ignored;
+        viewer->sock->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+        streams.remove(viewer);
+        --viewers;
+    }
+
+    /*!
+    GET /stream.mjpg
+    応答のヘッダーを書いてから送り先に加える
+    */
+    void accept(std::string const & method, std::shared_ptr<boost::asio::ip::tcp::socket> sock)
+    {
+        auto const viewer = std::make_shared<Viewer>(Viewer{ sock, true, false });
+        auto const header = std::make_shared<std::string>(method == "GET"
+            ? (boost::format(
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: multipart/x-mixed-replace; boundary=%s\r\n"
+                "Cache-Control: no-cache\r\n"
+                "Connection: Close\r\n"
+                "\r\n") % BOUNDARY).str()
+            : "HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: Close\r\n\r\n");
+        streams.push_back(viewer);
+        ++viewers;
+        boost::asio::async_write(*sock, boost::asio::buffer(*header), [this, viewer, header, method](boost::system::error_code const & ec, size_t){
+            if (ec || method != "GET"){
+                close(viewer);
+                return;
+            }
+            viewer->busy = false;
+            if (latest && clock_type::now() - latest->time < SNAPSHOT_FRESH){
+                send(viewer);
+            }
+        });
+    }
+
+    /*!
+    GET /frame.jpg
+    見ている接続がなくてエンコードしていなければ、エンコードを再開して503を返す
+    */
+    HttpResponse snapshot(std::string const & method)
+    {
+        if (method != "GET"){
+            return HttpResponse{ 405, "text/plain", "" };
+        }
+        snapshot_requested.store(clock_type::now().time_since_epoch().count(), std::memory_order_relaxed);
+        if (!latest || SNAPSHOT_FRESH <= clock_type::now() - latest->time){
+            return HttpResponse{ 503, "text/plain", "no frame yet. retry later.\n" };
+        }
+        return HttpResponse{ 200, "image/jpeg", std::string(latest->jpeg.begin(), latest->jpeg.end()) };
+    }
+};
+
+PreviewServer::PreviewServer(PreviewConfig const & config)
+{
+    if (config.max_fps <= 0 || config.quality < 0 || 100 < config.quality){
+        throw std::runtime_error("preview fps should be positive and quality should be 0 to 100.");
+    }
+    impl_.reset(new Impl(config));
+    auto impl = impl_.get();
+    impl->server = std::make_shared<HttpServer>(impl->io_service, config.port);
+    impl->server->route("/", [](std::string const &){
+        return HttpResponse{ 200, "text/html; charset=utf-8", INDEX_HTML };
+    });
+    impl->server->route("/frame.jpg", [impl](std::string const & method){
+        return impl->snapshot(method);
+    });
+    impl->server->stream("/stream.mjpg", [impl](std::string const & method, std::shared_ptr<boost::asio::ip::tcp::socket> sock){
+        impl->accept(method, sock);
+    });
+    impl->server->start();
+    impl->encoder = std::thread([impl]{ impl->encode(); });
+    impl->network = std::thread([impl]{
+        Trace::setThreadName("preview http");
+        lowerThreadPriority();
+        impl->io_service.run();
+    });
+    std::cout << boost::format("GET http://127.0.0.1:%d/ to preview frames.") % config.port << std::endl;
+}
+
+PreviewServer::~PreviewServer()
+{
+    {
+        std::unique_lock<std::mutex> lock(impl_->mutex);
+        impl_->stop = true;
+    }
+    impl_->cond.notify_one();
+    impl_->encoder.join();
+    impl_->io_service.stop();
+    impl_->network.join();
+}
+
+void PreviewServer::publish(cv::Mat const & image, std::shared_ptr<const Option> const & opt, std::vector<BlockInfo> const & blockInfo)
+{
+    if (!impl_->watched()){
+        return;
+    }
+    // 置き換えた古いフレームはロックの外で解放する
+    Impl::Frame frame = { image, opt, blockInfo };
+    {
+        std::unique_lock<std::mutex> lock(impl_->mutex);
+        std::swap(frame, impl_->pending);
+        impl_->has_pending = true;
+    }
+    impl_->cond.notify_one();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "option.h"
+#include <memory>
+
+/*!
+プレビュー配信の設定
+*/
+struct PreviewConfig
+{
+    int port = 0; ///< ポート番号(0なら配信しない)
+    double max_fps = 5; ///< 1秒あたりの最大エンコード数
+    int quality = 70; ///< JPEGの品質(0から100)
+};
+
+/*!
+認識結果を描いた画像をMJPEGでローカルに配信するクラス
+画面のない環境でもカメラの様子を見るため
+
+- publishは最新のフレームを置き換えるだけで、描画とエンコードは優先度を下げた専用スレッドで行う
+- エンコードは見ている接続があるときだけmax_fps以下の頻度で行い、1つの画像をすべての接続で共有する
+- 送信が追いつかない接続には、送信が終わった時点の最新の画像だけを送る
+*/
+class PreviewServer
+{
+    PreviewServer & operator=(PreviewServer const &) = delete;
+    PreviewServer(PreviewServer const &) = delete;
+
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+public:
+    /*!
+    配信を開始する
+    GET / で表示用のページ、GET /stream.mjpg でMJPEG、GET /frame.jpg で最新の1枚を返す
+    @param[in] config 設定
+    */
+    explicit PreviewServer(PreviewConfig const & config);
+    ~PreviewServer();
+    /*!
+    認識したフレームを渡す。ブロックしない
+    見ている接続がなければ何もしない。あればブロック情報だけをコピーし、画像は参照する
+    @param[in] image 認識した画像。呼び出し側で書き換えないこと
+    @param[in] opt 認識に使ったオプション
+    @param[in] blockInfo ブロック情報
+    */
+    void publish(cv::Mat const & image, std::shared_ptr<const Option> const & opt, std::vector<BlockInfo> const & blockInfo);
+};
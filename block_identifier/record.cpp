@@ -0,0 +1,263 @@
+#include "record.h"
+#include "log.h"
+#include <boost/format.hpp>
+#include <cstring>
+#include <thread>
+
+namespace {
+    uint32_t const MAGIC = 0x43524942; ///< "BIRC"
+    uint32_t const INDEX_MAGIC = 0x58524942; ///< "BIRX"
+    uint32_t const VERSION = 1; ///< 記録の構造を変えたら上げる
+    uint32_t const ENDIAN_MARK = 0x01020304;
+    uint64_t const ALIGN = 16; ///< 画素データの境界
+
+    enum : uint32_t
+    {
+        KIND_FRAME = 1,
+        KIND_TRIGGER = 2,
+    };
+
+    /*!
+    ファイルの先頭
+    */
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t endian_mark;
+        uint32_t reserved;
+    };
+
+    /*!
+    記録1件のヘッダ。直後にsizeバイトの画素データが続き、ALIGNの倍数まで0で埋める
+    */
+    struct RecordHeader
+    {
+        uint32_t kind;
+        int32_t type; ///< cv::Matの型
+        int32_t rows;
+        int32_t cols;
+        uint64_t frame_id;
+        int64_t time_us; ///< 記録開始からの時刻
+        uint64_t size; ///< 画素データのサイズ
+        uint64_t reserved;
+    };
+
+    /*!
+    ファイルの末尾。直前に記録の位置の索引がcount個並ぶ
+    */
+    struct Trailer
+    {
+        uint64_t index_offset;
+        uint64_t count;
+        uint32_t magic;
+        uint32_t reserved;
+    };
+
+    uint64_t padding(uint64_t size)
+    {
+        return (ALIGN - size % ALIGN) % ALIGN;
+    }
+
+    /*!
+    @return ファイルの位置。MSVCのftellは32ビットなので2GBを超える記録では使えない
+    */
+    uint64_t tell(std::FILE * fp)
+    {
+#if defined _WIN32 || defined _WIN64
+        return static_cast<uint64_t>(_ftelli64(fp));
+#else
+        return static_cast<uint64_t>(ftello(fp));
+#endif // defined _WIN32 || defined _WIN64
+    }
+}
+
+Recorder::Recorder(std::string const & path)
+    : fp_(std::fopen(path.c_str(), "wb"))
+    , start_(std::chrono::steady_clock::now())
+    , failed_(false)
+{
+    if (!fp_){
+        throw std::runtime_error((boost::format("failed to open %s.") % path).str());
+    }
+    std::setvbuf(fp_, nullptr, _IOFBF, 1 << 20);
+    FileHeader const header = { MAGIC, VERSION, ENDIAN_MARK, 0 };
+    if (!put(&header, sizeof(header))){
+        std::fclose(fp_);
+        throw std::runtime_error((boost::format("failed to write %s.") % path).str());
+    }
+}
+
+Recorder::~Recorder()
+{
+    // 書き込みに失敗したファイルには索引を付けず、再生するときに先頭からたどらせる
+    if (!failed_){
+        Trailer trailer = { tell(fp_), index_.size(), INDEX_MAGIC, 0 };
+        if (put(index_.data(), index_.size() * sizeof(uint64_t))){
+            put(&trailer, sizeof(trailer));
+        }
+    }
+    std::fclose(fp_);
+}
+
+bool Recorder::put(void const * data, size_t size)
+{
+    if (failed_ || (0 < size && std::fwrite(data, 1, size, fp_) != size)){
+        if (!failed_){
+            LOG_ERROR("record", "failed to write the recording. recording stopped.");
+        }
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+void Recorder::write(uint32_t kind, cv::Mat const & image, uint64_t frame_id, std::chrono::steady_clock::time_point time)
+{
+    size_t const row_size = image.cols * image.elemSize();
+    RecordHeader header = {};
+    header.kind = kind;
+    header.type = image.type();
+    header.rows = image.rows;
+    header.cols = image.cols;
+    header.frame_id = frame_id;
+    header.time_us = std::chrono::duration_cast<std::chrono::microseconds>(time - start_).count();
+    header.size = row_size * image.rows;
+    char const zero[ALIGN] = {};
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (failed_){
+        return;
+    }
+    auto const offset = tell(fp_);
+    bool ok = put(&header, sizeof(header));
+    if (image.isContinuous()){
+        ok = ok && put(image.ptr(), header.size);
+    }
+    else{
+        for (int y = 0; ok && y < image.rows; ++y){
+            ok = put(image.ptr(y), row_size);
+        }
+    }
+    // 途中で切れた記録は索引に入れない
+    if (ok && put(zero, padding(header.size))){
+        index_.push_back(offset);
+    }
+}
+
+void Recorder::frame(cv::Mat const & image, FrameStamp const & frame)
+{
+    write(KIND_FRAME, image, frame.id, frame.captured);
+}
+
+void Recorder::trigger(std::chrono::steady_clock::time_point time)
+{
+    write(KIND_TRIGGER, cv::Mat(), 0, time);
+    // 異常終了しても直前までのトリガーを再生できるように書き出しておく
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!failed_ && std::fflush(fp_) != 0){
+        LOG_ERROR("record", "failed to write the recording. recording stopped.");
+        failed_ = true;
+    }
+}
+
+ReplaySource::ReplaySource(std::string const & path, bool realtime)
+    : file_(path.c_str(), boost::interprocess::read_only)
+    , region_(file_, boost::interprocess::read_only)
+    , next_(0)
+    , frames_(0)
+    , triggers_(0)
+    , realtime_(realtime)
+    , first_us_(0)
+{
+    auto const base = static_cast<char const *>(region_.get_address());
+    uint64_t const size = region_.get_size();
+    FileHeader header;
+    if (size < sizeof(header)){
+        throw std::runtime_error((boost::format("%s is not a recording.") % path).str());
+    }
+    std::memcpy(&header, base, sizeof(header));
+    if (header.magic != MAGIC || header.version != VERSION || header.endian_mark != ENDIAN_MARK){
+        throw std::runtime_error((boost::format("%s is not a recording.") % path).str());
+    }
+    auto valid = [base, size](uint64_t offset){
+        RecordHeader r;
+        if (size < offset + sizeof(r)){
+            return false;
+        }
+        std::memcpy(&r, base + offset, sizeof(r));
+        return (r.kind == KIND_FRAME || r.kind == KIND_TRIGGER) && r.size <= size - offset - sizeof(r);
+    };
+    Trailer trailer;
+    if (sizeof(header) + sizeof(trailer) <= size){
+        std::memcpy(&trailer, base + size - sizeof(trailer), sizeof(trailer));
+    }
+    if (sizeof(header) + sizeof(trailer) <= size
+        && trailer.magic == INDEX_MAGIC
+        && trailer.index_offset <= size
+        && trailer.count <= (size - sizeof(trailer)) / sizeof(uint64_t)
+        && trailer.index_offset + trailer.count * sizeof(uint64_t) + sizeof(trailer) == size){
+        index_.resize(trailer.count);
+        std::memcpy(index_.data(), base + trailer.index_offset, trailer.count * sizeof(uint64_t));
+        for (auto offset : index_){
+            if (!valid(offset)){
+                throw std::runtime_error((boost::format("%s has a broken index.") % path).str());
+            }
+        }
+    }
+    else{
+        // 異常終了して索引がないので先頭からたどる。途中で切れた記録は捨てる
+        std::cerr << boost::format("%s has no index. scanning records...") % path << std::endl;
+        for (uint64_t offset = sizeof(header); valid(offset);){
+            RecordHeader r;
+            std::memcpy(&r, base + offset, sizeof(r));
+            index_.push_back(offset);
+            offset += sizeof(r) + r.size + padding(r.size);
+        }
+    }
+    for (auto offset : index_){
+        RecordHeader r;
+        std::memcpy(&r, base + offset, sizeof(r));
+        frames_ += r.kind == KIND_FRAME;
+    }
+    if (!index_.empty()){
+        RecordHeader r;
+        std::memcpy(&r, base + index_.front(), sizeof(r));
+        first_us_ = r.time_us;
+    }
+}
+
+bool ReplaySource::read(Option const &, cv::Mat & image, FrameStamp & frame)
+{
+    auto const base = static_cast<char const *>(region_.get_address());
+    if (next_ == 0){
+        start_ = std::chrono::steady_clock::now();
+    }
+    while (next_ < index_.size()){
+        RecordHeader r;
+        std::memcpy(&r, base + index_[next_], sizeof(r));
+        ++next_;
+        if (realtime_){
+            std::this_thread::sleep_until(start_ + std::chrono::microseconds(r.time_us - first_us_));
+        }
+        if (r.kind == KIND_TRIGGER){
+            ++triggers_;
+            continue;
+        }
+        // 画素データはコピーせずにマップした領域を参照する
+        image = cv::Mat(r.rows, r.cols, r.type, const_cast<char *>(base + index_[next_ - 1] + sizeof(r)));
+        if (image.total() * image.elemSize() != r.size){
+            throw std::runtime_error("recorded frame is broken.");
+        }
+        frame.id = r.frame_id;
+        frame.captured = std::chrono::steady_clock::now();
+        return true;
+    }
+    return false;
+}
+
+int ReplaySource::takeTriggers()
+{
+    int const n = triggers_;
+    triggers_ = 0;
+    return n;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "frame_source.h"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+/*!
+前処理後のフレームとトリガーを記録する
+追記のみのファイルに書き、閉じるときに索引を付ける
+索引がない(異常終了したか、ディスクが一杯になった)ファイルも再生できる
+*/
+class Recorder
+{
+    Recorder(Recorder const &) = delete;
+    Recorder & operator = (Recorder const &) = delete;
+
+    std::FILE * fp_;
+    std::chrono::steady_clock::time_point start_;
+    std::vector<uint64_t> index_;
+    std::mutex mutex_;
+    bool failed_; ///< 書き込みに失敗した。以降は記録しない。mutex_で保護する
+
+    /*!
+    書き込む。失敗したらエラーをログに出して記録をやめる
+    @retval true 書き込めた
+    */
+    bool put(void const * data, size_t size);
+    void write(uint32_t kind, cv::Mat const & image, uint64_t frame_id, std::chrono::steady_clock::time_point time);
+public:
+    /*!
+    @param[in] path 記録先。既にあれば上書きする
+    */
+    explicit Recorder(std::string const & path);
+    ~Recorder();
+    /*!
+    フレームを記録する
+    @param[in] image 縮尺と向きを変換したカメラ画像
+    @param[in] frame フレームの識別情報
+    */
+    void frame(cv::Mat const & image, FrameStamp const & frame);
+    /*!
+    トリガーを記録する
+    @param[in] time トリガーの時刻
+    */
+    void trigger(std::chrono::steady_clock::time_point time);
+};
+
+/*!
+記録したファイルをメモリマップして、フレームをそのまま再生する
+*/
+class ReplaySource : public FrameSource
+{
+    boost::interprocess::file_mapping file_;
+    boost::interprocess::mapped_region region_;
+    std::vector<uint64_t> index_;
+    size_t next_;
+    size_t frames_;
+    int triggers_;
+    bool realtime_;
+    int64_t first_us_;
+    std::chrono::steady_clock::time_point start_;
+public:
+    /*!
+    @param[in] path 記録したファイル
+    @param[in] realtime trueなら記録したときの速さ、falseなら最大速度で再生する
+    */
+    ReplaySource(std::string const & path, bool realtime);
+    bool read(Option const & opt, cv::Mat & image, FrameStamp & frame);
+    bool eof() const { return index_.size() <= next_; }
+    /*!
+    @return 前回から今回のフレームまでに記録されていたトリガー数。呼ぶと0に戻る
+    */
+    int takeTriggers();
+    /*!
+    @return 記録されているフレーム数
+    */
+    size_t frames() const { return frames_; }
+};
@@ -0,0 +1,143 @@
+#include "regress.h"
+#include "identify.h"
+#include "picojson.h"
+#include <boost/format.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+namespace {
+    double number(picojson::object const & obj, std::string const & name, double def)
+    {
+        auto const it = obj.find(name);
+        return it == obj.end() ? def : it->second.get<double>();
+    }
+}
+
+GroundTruth readGroundTruth(std::string const & path)
+{
+    std::ifstream ifs(path);
+    if (!ifs){
+        throw std::runtime_error((boost::format("failed to open %s.") % path).str());
+    }
+    picojson::value root;
+    auto const err = picojson::parse(root, ifs);
+    if (!err.empty()){
+        throw std::runtime_error((boost::format("%s: %s") % path % err).str());
+    }
+    auto const & obj = root.get<picojson::object>();
+    GroundTruth dst;
+    auto const slash = path.find_last_of("/\\");
+    dst.dir = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    dst.max_mean_ms = number(obj, "max_mean_ms", 1e9);
+    dst.max_p99_ms = number(obj, "max_p99_ms", 1e9);
+    for (auto const & item : obj.at("images").get<picojson::array>()){
+        auto const & image = item.get<picojson::object>();
+        TruthSample sample;
+        sample.file = image.at("file").get<std::string>();
+        for (auto const & block : image.at("blocks").get<picojson::array>()){
+            sample.blocks.push_back(block.get<std::string>());
+        }
+        sample.block_height = static_cast<int>(number(image, "block_height", 0));
+        sample.block_width = static_cast<int>(number(image, "block_width", 0));
+        sample.min_accuracy = number(image, "min_accuracy", 0);
+        auto const bad = image.find("known_bad");
+        sample.known_bad = bad != image.end() && bad->second.get<bool>();
+        dst.samples.push_back(sample);
+    }
+    return dst;
+}
+
+Option sampleOption(Option const & opt, TruthSample const & sample)
+{
+    Option o = opt;
+    if (0 < sample.block_height){
+        o.tune.block_height = sample.block_height;
+    }
+    if (0 < sample.block_width){
+        o.tune.block_width = sample.block_width;
+    }
+    return o;
+}
+
+std::vector<std::string> blockNames(std::vector<BlockInfo> const & blockInfo)
+{
+    std::vector<std::string> dst;
+    for (auto const & info : blockInfo){
+        dst.push_back((boost::format("%s:%d") % info.color.name % info.width).str());
+    }
+    return dst;
+}
+
+double blockAccuracy(std::vector<std::string> const & expected, std::vector<std::string> const & actual)
+{
+    size_t const n = std::max(expected.size(), actual.size());
+    if (n == 0){
+        return 1;
+    }
+    std::vector<size_t> d(actual.size() + 1);
+    for (size_t j = 0; j < d.size(); ++j){
+        d[j] = j;
+    }
+    for (size_t i = 1; i <= expected.size(); ++i){
+        size_t diag = d[0];
+        d[0] = i;
+        for (size_t j = 1; j <= actual.size(); ++j){
+            size_t const tmp = d[j];
+            d[j] = std::min({ d[j] + 1, d[j - 1] + 1, diag + (expected[i - 1] == actual[j - 1] ? 0 : 1) });
+            diag = tmp;
+        }
+    }
+    return 1 - static_cast<double>(d.back()) / n;
+}
+
+int runRegression(std::string const & path, Option const & opt, int iterations)
+{
+    typedef std::chrono::steady_clock clock_type;
+    auto const truth = readGroundTruth(path);
+    std::vector<std::string> failures;
+    std::cout << boost::format("%-16s %8s %9s %9s  %s") % "image" % "accuracy" % "mean(ms)" % "p99(ms)" % "detected" << std::endl;
+    for (auto const & sample : truth.samples){
+        cv::Mat image = cv::imread(truth.dir + sample.file);
+        if (image.empty()){
+            failures.push_back((boost::format("%s: failed to read.") % sample.file).str());
+            continue;
+        }
+        Option const o = sampleOption(opt, sample);
+        preprocessImage(o, image);
+        std::vector<BlockInfo> blockInfo;
+        std::vector<double> samples;
+        for (int i = 0; i < iterations; ++i){
+            auto const begin = clock_type::now();
+            identifyBlock(image, o, blockInfo, FrameStamp(), false);
+            samples.push_back(std::chrono::duration<double, std::milli>(clock_type::now() - begin).count());
+        }
+        auto const detected = blockNames(blockInfo);
+        std::sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (auto v : samples){
+            sum += v;
+        }
+        double const mean = samples.empty() ? 0 : sum / samples.size();
+        double const p99 = samples.empty() ? 0 : samples[std::min(samples.size() - 1, static_cast<size_t>(samples.size() * 0.99))];
+        double const acc = blockAccuracy(sample.blocks, detected);
+        std::string joined;
+        for (auto const & d : detected){
+            joined += (joined.empty() ? "" : " ") + d;
+        }
+        std::cout << boost::format("%-16s %8.3f %9.2f %9.2f  %s%s") % sample.file % acc % mean % p99 % (sample.known_bad ? "(known bad) " : "") % joined << std::endl;
+        if (!sample.known_bad && acc < sample.min_accuracy){
+            failures.push_back((boost::format("%s: accuracy %.3f < %.3f") % sample.file % acc % sample.min_accuracy).str());
+        }
+        if (truth.max_mean_ms < mean){
+            failures.push_back((boost::format("%s: mean %.2fms > %.2fms") % sample.file % mean % truth.max_mean_ms).str());
+        }
+        if (truth.max_p99_ms < p99){
+            failures.push_back((boost::format("%s: p99 %.2fms > %.2fms") % sample.file % p99 % truth.max_p99_ms).str());
+        }
+    }
+    for (auto const & f : failures){
+        std::cerr << "REGRESSION " << f << std::endl;
+    }
+    return failures.empty() ? 0 : 1;
+}
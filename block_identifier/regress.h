@@ -0,0 +1,65 @@
+#pragma once
+
+#include "option.h"
+
+/*!
+サンプル画像1枚の正解
+*/
+struct TruthSample
+{
+    std::string file; ///< 画像ファイル名
+    std::vector<std::string> blocks; ///< 上から順に"色:幅"
+    int block_height; ///< 撮影した距離でのブロックの高さ(0ならオプションのまま)
+    int block_width; ///< 撮影した距離でのブロックの幅(0ならオプションのまま)
+    double min_accuracy; ///< 正解率の下限
+    bool known_bad; ///< 今のアルゴリズムでは認識できない。正解率を表示するだけで下限は調べない
+};
+
+/*!
+正解ファイル
+*/
+struct GroundTruth
+{
+    std::string dir; ///< 画像を読むディレクトリ(正解ファイルと同じ)
+    std::vector<TruthSample> samples;
+    double max_mean_ms; ///< 平均処理時間の上限
+    double max_p99_ms; ///< 99パーセンタイル処理時間の上限
+};
+
+/*!
+正解ファイルを読む
+@param[in] path 正解ファイル(例: imgs/ground_truth.json)
+@return 正解
+*/
+GroundTruth readGroundTruth(std::string const & path);
+
+/*!
+@param[in] opt オプション
+@param[in] sample サンプル画像の正解
+@return サンプル画像を撮影した距離でのブロックの大きさにしたオプション
+*/
+Option sampleOption(Option const & opt, TruthSample const & sample);
+
+/*!
+@param[in] blockInfo ブロック情報
+@return 上から順に"色:幅"
+*/
+std::vector<std::string> blockNames(std::vector<BlockInfo> const & blockInfo);
+
+/*!
+正解率
+ブロックの挿入、欠落、取り違えを1つの誤りとして編集距離から求める
+@param[in] expected 正解
+@param[in] actual 認識結果
+@return 0から1
+*/
+double blockAccuracy(std::vector<std::string> const & expected, std::vector<std::string> const & actual);
+
+/*!
+正解付きのサンプル画像でブロック認識の正解率と処理時間を計測する
+@param[in] path 正解ファイル。画像はこのファイルと同じディレクトリから読む
+@param[in] opt オプション
+@param[in] iterations 画像1枚あたりの認識回数
+@return Exit code。正解率か処理時間が基準を外れたら1
+*/
+int runRegression(std::string const & path, Option const & opt, int iterations);
@@ -0,0 +1,129 @@
+#include "scene.h"
+#include <algorithm>
+#include <random>
+#include <thread>
+
+namespace {
+    int const SIZES[] = { 1, 1, 1, 1, 2, 2, 3 }; ///< ブロック幅の出現頻度
+    uchar const BACKGROUND = 10; ///< 背景の明るさ
+
+    /*!
+    明るさを一方向に線形に変える
+    @param[in,out] image 画像
+    @param[in] gradient 端と端の明るさの差
+    @param[in] direction 明るさが変わる向き(ラジアン)
+    */
+    void applyGradient(cv::Mat & image, double gradient, double direction)
+    {
+        double const dx = std::cos(direction) / std::max(1, image.cols - 1);
+        double const dy = std::sin(direction) / std::max(1, image.rows - 1);
+        // 中心の明るさは変えない
+        double const offset = 1 - gradient * (std::cos(direction) + std::sin(direction)) / 2;
+        for (int y = 0; y < image.rows; ++y){
+            auto p = image.ptr<uchar>(y);
+            double const row = offset + gradient * dy * y;
+            for (int x = 0; x < image.cols; ++x){
+                double const gain = row + gradient * dx * x;
+                for (int c = 0; c < 3; ++c, ++p){
+                    *p = cv::saturate_cast<uchar>(*p * gain);
+                }
+            }
+        }
+    }
+}
+
+SceneGenerator::SceneGenerator(Option const & opt, SceneParams const & params, uint64_t seed)
+    : opt_(opt)
+    , params_(params)
+    , seed_(seed)
+{
+    if (opt_.colors.empty()){
+        throw std::runtime_error("no colors to draw.");
+    }
+}
+
+Scene SceneGenerator::generate(uint64_t index) const
+{
+    std::seed_seq seq = {
+        static_cast<uint32_t>(seed_), static_cast<uint32_t>(seed_ >> 32),
+        static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32) };
+    std::mt19937 rng(seq);
+    auto uniform = [&rng](int lo, int hi){ return std::uniform_int_distribution<int>(lo, hi)(rng); };
+    auto real = [&rng](double lo, double hi){ return std::uniform_real_distribution<double>(lo, hi)(rng); };
+
+    auto const & tune = opt_.tune;
+    int const bh = tune.get_block_height();
+    int const bw = tune.get_block_width();
+    Scene dst;
+    dst.image = cv::Mat(static_cast<int>(tune.camera_width * tune.camera_ratio), static_cast<int>(tune.camera_height * tune.camera_ratio), CV_8UC3, cv::Scalar::all(BACKGROUND));
+    auto & image = dst.image;
+    // 1つの積み上げの幅は、いちばん幅の広いブロックとずらす幅が収まるようにする
+    int const stacks = std::min(params_.stacks, std::max(1, image.cols / (bw * 3 + bh)));
+    int const lane = image.cols / std::max(1, stacks);
+    for (int s = 0; s < stacks; ++s){
+        std::vector<Block> stack;
+        int const rows = uniform(params_.min_rows, params_.max_rows);
+        int const center = lane * s + lane / 2;
+        for (int row = 0; row < rows; ++row){
+            int const type = SIZES[uniform(0, 6)];
+            auto const & color = opt_.colors[uniform(0, static_cast<int>(opt_.colors.size()) - 1)];
+            int const y = image.rows - bh * (row + 2);
+            // 隣の積み上げにはみ出さないようにする
+            int const x = std::max(lane * s, std::min(center - bw * type / 2 - uniform(0, bh - 1) / 2, lane * (s + 1) - bw * type));
+            cv::Rect const rc(x, y, bw * type, bh);
+            cv::Scalar const c(color.bgr[0], color.bgr[1], color.bgr[2]);
+            cv::rectangle(image, rc, c, CV_FILLED);
+            int const b = rc.height / 5;
+            for (int i = 0; i < type; ++i){
+                cv::rectangle(image, cv::Rect(rc.x + bw * i + b, rc.y - b, b, b), c, CV_FILLED);
+                cv::rectangle(image, cv::Rect(rc.x + bw * (i + 1) - 2 * b, rc.y - b, b, b), c, CV_FILLED);
+            }
+            stack.push_back({ color.name, type });
+        }
+        std::reverse(stack.begin(), stack.end());
+        dst.stacks.push_back(stack);
+    }
+    if (params_.angle != 0){
+        auto const rot = cv::getRotationMatrix2D(cv::Point2f(image.cols / 2.f, image.rows / 2.f), real(-params_.angle, params_.angle), 1);
+        cv::warpAffine(image, image, rot, image.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar::all(BACKGROUND));
+    }
+    if (params_.gradient != 0){
+        applyGradient(image, params_.gradient, real(0, 2 * CV_PI));
+    }
+    if (0 < params_.blur){
+        int const k = params_.blur | 1;
+        cv::GaussianBlur(image, image, cv::Size(k, k), 0);
+    }
+    cv::RNG cvrng(rng() | static_cast<uint64_t>(rng()) << 32);
+    if (0 < params_.noise){
+        cv::Mat noise(image.size(), CV_16SC3);
+        cvrng.fill(noise, cv::RNG::NORMAL, 0, params_.noise);
+        cv::Mat tmp;
+        image.convertTo(tmp, CV_16SC3);
+        cv::add(tmp, noise, tmp);
+        tmp.convertTo(image, CV_8UC3);
+    }
+    for (int i = static_cast<int>(image.size().area() * params_.salt); 0 < i; --i){
+        auto & p = image.at<cv::Vec3b>(cvrng.uniform(0, image.rows), cvrng.uniform(0, image.cols));
+        p = cv::Vec3b(cvrng.uniform(0, 256), cvrng.uniform(0, 256), cvrng.uniform(0, 256));
+    }
+    return dst;
+}
+
+std::vector<Scene> SceneGenerator::generate(uint64_t first, size_t count, unsigned threads) const
+{
+    std::vector<Scene> dst(count);
+    threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(count)));
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t){
+        workers.emplace_back([this, &dst, first, count, threads, t]{
+            for (size_t i = t; i < count; i += threads){
+                dst[i] = generate(first + i);
+            }
+        });
+    }
+    for (auto & w : workers){
+        w.join();
+    }
+    return dst;
+}
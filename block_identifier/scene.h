@@ -0,0 +1,60 @@
+#pragma once
+
+#include "option.h"
+
+/*!
+テスト画像の作り方
+ブロックの大きさはオプションのTuningに従う(LEGO DUPLOかLEGOか)
+*/
+struct SceneParams
+{
+    int stacks = 1; ///< 積み上げの数。横に並べる。画像の幅に収まらない分は減らす
+    int min_rows = 1; ///< 1つの積み上げの最小段数
+    int max_rows = 11; ///< 1つの積み上げの最大段数
+    double gradient = 0; ///< 照明のむら。画像の端と端の明るさの差(0から1)
+    double noise = 0; ///< ガウスノイズの標準偏差
+    int blur = 0; ///< ぼかしのカーネルサイズ(0ならぼかさない)
+    double angle = 0; ///< 回転角の最大値(度)
+    double salt = 0.02; ///< ランダムな色にする画素の割合
+};
+
+/*!
+テスト画像と正解
+*/
+struct Scene
+{
+    cv::Mat image; ///< 縮尺と向きを変換した後のカメラ画像に相当する画像
+    std::vector<std::vector<Block>> stacks; ///< 積み上げごとに上から順に並べたブロック
+};
+
+/*!
+テスト画像を作る
+乱数はインスタンスごとのシードとフレーム番号から作るので、スレッドやフレームの順序によらず同じ画像になる
+*/
+class SceneGenerator
+{
+    Option opt_;
+    SceneParams params_;
+    uint64_t seed_;
+public:
+    /*!
+    @param[in] opt オプション。色とブロックの大きさを使う
+    @param[in] params テスト画像の作り方
+    @param[in] seed 乱数のシード
+    */
+    SceneGenerator(Option const & opt, SceneParams const & params, uint64_t seed);
+    /*!
+    テスト画像を1枚作る。複数のスレッドから同時に呼んでよい
+    @param[in] index フレーム番号
+    @return テスト画像と正解
+    */
+    Scene generate(uint64_t index) const;
+    /*!
+    テスト画像を並列に作る
+    @param[in] first 最初のフレーム番号
+    @param[in] count 枚数
+    @param[in] threads スレッド数
+    @return フレーム番号順のテスト画像と正解
+    */
+    std::vector<Scene> generate(uint64_t first, size_t count, unsigned threads) const;
+};
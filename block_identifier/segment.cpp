@@ -0,0 +1,392 @@
+#include "segment.h"
+#include "trace.h"
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+namespace {
+    int const TILE_ROWS = 64; ///< タイルの高さ
+    int const HISTOGRAM_STEP = 4; ///< ヒストグラムは横にこの画素数ごとに1画素を数える
+
+    /*!
+    cv::parallel_for_に関数を渡す
+    */
+    class ParallelBody : public cv::ParallelLoopBody
+    {
+        std::function<void(int)> const & f_;
+    public:
+        explicit ParallelBody(std::function<void(int)> const & f) : f_(f) {}
+        void operator()(cv::Range const & range) const
+        {
+            for (int i = range.start; i < range.end; ++i){
+                f_(i);
+            }
+        }
+    };
+
+    void parallelFor(int n, std::function<void(int)> const & f)
+    {
+        cv::parallel_for_(cv::Range(0, n), ParallelBody(f));
+    }
+
+    /*!
+    連結成分をつなぐUnion-Find
+    */
+    class UnionFind
+    {
+        std::vector<int> parent_;
+    public:
+        int add()
+        {
+            parent_.push_back(static_cast<int>(parent_.size()));
+            return static_cast<int>(parent_.size()) - 1;
+        }
+        void resize(size_t n)
+        {
+            for (size_t i = parent_.size(); i < n; ++i){
+                add();
+            }
+        }
+        int find(int i)
+        {
+            while (parent_[i] != i){
+                parent_[i] = parent_[parent_[i]];
+                i = parent_[i];
+            }
+            return i;
+        }
+        void unite(int a, int b)
+        {
+            a = find(a);
+            b = find(b);
+            if (a != b){
+                parent_[std::max(a, b)] = std::min(a, b);
+            }
+        }
+        size_t size() const { return parent_.size(); }
+    };
+
+    /*!
+    連結成分の画素数と外接矩形
+    */
+    struct Component
+    {
+        int area;
+        int left;
+        int top;
+        int right;
+        int bottom;
+
+        void merge(Component const & c)
+        {
+            area += c.area;
+            left = std::min(left, c.left);
+            top = std::min(top, c.top);
+            right = std::max(right, c.right);
+            bottom = std::max(bottom, c.bottom);
+        }
+    };
+
+    /*!
+    タイル1枚の処理結果
+    */
+    struct Tile
+    {
+        int top;
+        int bottom;
+        std::vector<Component> components; ///< タイル内のラベル-1番目の連結成分
+        int offset; ///< 画像全体でのラベルの開始番号
+    };
+
+    /*!
+    タイル内の連結成分(8近傍)にラベルを付ける
+    ラベルは1から始まり、0は背景
+    @param[in] bin タイルを2値化した画像(タイルの高さ)
+    @param[in,out] tile タイル
+    @param[out] labels 画像全体のラベル。タイルの行だけを書く
+    */
+    void label(cv::Mat const & bin, Tile & tile, cv::Mat & labels)
+    {
+        UnionFind uf;
+        uf.add(); // 背景
+        for (int y = tile.top; y < tile.bottom; ++y){
+            auto b = bin.ptr<uchar>(y - tile.top);
+            auto l = labels.ptr<int>(y);
+            auto up = tile.top < y ? labels.ptr<int>(y - 1) : nullptr;
+            for (int x = 0; x < bin.cols; ++x){
+                if (!b[x]){
+                    l[x] = 0;
+                    continue;
+                }
+                int n = 0;
+                auto join = [&n, &uf](int neighbor){
+                    if (neighbor){
+                        if (n){
+                            uf.unite(n, neighbor);
+                        }
+                        else{
+                            n = neighbor;
+                        }
+                    }
+                };
+                if (0 < x){
+                    join(l[x - 1]);
+                }
+                if (up){
+                    if (0 < x){
+                        join(up[x - 1]);
+                    }
+                    join(up[x]);
+                    if (x + 1 < bin.cols){
+                        join(up[x + 1]);
+                    }
+                }
+                l[x] = n ? n : uf.add();
+            }
+        }
+        // ラベルを詰め直して、連結成分ごとに集計する
+        std::vector<int> compact(uf.size(), 0);
+        for (size_t i = 1; i < uf.size(); ++i){
+            int const root = uf.find(static_cast<int>(i));
+            if (!compact[root]){
+                compact[root] = static_cast<int>(tile.components.size()) + 1;
+                tile.components.push_back({ 0, bin.cols, tile.bottom, -1, -1 });
+            }
+            compact[i] = compact[root];
+        }
+        for (int y = tile.top; y < tile.bottom; ++y){
+            auto l = labels.ptr<int>(y);
+            for (int x = 0; x < bin.cols; ++x){
+                if (l[x]){
+                    l[x] = compact[l[x]];
+                    tile.components[l[x] - 1].merge({ 1, x, y, x, y });
+                }
+            }
+        }
+    }
+
+    /*!
+    HLSの画素のLとSの平均
+    丸めはcv::addWeightedと同じ偶数丸め
+    */
+    inline int mix(uchar const * hls)
+    {
+        int const sum = hls[1] + hls[2];
+        int const mixed = sum >> 1;
+        return mixed + ((sum & 1) & (mixed & 1));
+    }
+
+    /*!
+    タイルに分けてブロックの領域を抽出する
+    @param[in] size 画像の大きさ
+    @param[in] binarize 画像のtopからbottomの行を2値化する関数。複数のタイルから同時に呼ぶ
+    @return segmentBlocksと同じ
+    */
+    std::vector<cv::Point> segment(cv::Size size, std::function<void(int top, int bottom, cv::Mat & dst)> const & binarize)
+    {
+        int const n = std::max(1, (size.height + TILE_ROWS - 1) / TILE_ROWS);
+        std::vector<Tile> tiles(n);
+        for (int i = 0; i < n; ++i){
+            tiles[i].top = size.height * i / n;
+            tiles[i].bottom = size.height * (i + 1) / n;
+        }
+        cv::Mat labels(size, CV_32SC1);
+        {
+            TRACE_SCOPE("segment/tiles");
+            // 2値化した画像はタイルの中でしか使わないので、画像全体の大きさでは持たない
+            parallelFor(n, [&](int i){
+                cv::Mat bin(tiles[i].bottom - tiles[i].top, size.width, CV_8UC1);
+                binarize(tiles[i].top, tiles[i].bottom, bin);
+                label(bin, tiles[i], labels);
+            });
+        }
+
+        // タイルの境界で隣り合う連結成分をつなぐ
+        UnionFind uf;
+        for (auto & tile : tiles){
+            tile.offset = static_cast<int>(uf.size());
+            uf.resize(uf.size() + tile.components.size());
+        }
+        for (int i = 1; i < n; ++i){
+            auto const above = labels.ptr<int>(tiles[i].top - 1);
+            auto const below = labels.ptr<int>(tiles[i].top);
+            for (int x = 0; x < size.width; ++x){
+                if (!below[x]){
+                    continue;
+                }
+                for (int dx = -1; dx <= 1; ++dx){
+                    if (0 <= x + dx && x + dx < size.width && above[x + dx]){
+                        uf.unite(tiles[i - 1].offset + above[x + dx] - 1, tiles[i].offset + below[x] - 1);
+                    }
+                }
+            }
+        }
+        std::vector<Component> merged(uf.size(), Component{ 0, size.width, size.height, -1, -1 });
+        std::vector<int> roots(uf.size());
+        for (auto const & tile : tiles){
+            for (size_t j = 0; j < tile.components.size(); ++j){
+                int const root = uf.find(tile.offset + static_cast<int>(j));
+                roots[tile.offset + j] = root;
+                merged[root].merge(tile.components[j]);
+            }
+        }
+
+        // 一番面積の広い領域がブロックと判断する。ただし画像サイズ並みの面積だった場合は除外
+        // 除外の判定は元と同じく輪郭の面積で行うので、画素数の多い順に輪郭を求めて調べる
+        std::vector<int> candidates;
+        for (size_t i = 0; i < merged.size(); ++i){
+            if (roots[i] == static_cast<int>(i)){
+                candidates.push_back(static_cast<int>(i));
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [&merged](int a, int b){ return merged[b].area < merged[a].area; });
+        for (int best : candidates){
+            auto const & c = merged[best];
+            cv::Rect const bbox(c.left, c.top, c.right - c.left + 1, c.bottom - c.top + 1);
+
+            // 選んだ連結成分だけを残して、外接矩形の中で外側の輪郭を求める
+            // findContoursは画像の縁を0として扱うので、縁に接した輪郭が1画素縮まないよう周りに1画素の0を付ける
+            cv::Mat mask = cv::Mat::zeros(bbox.size() + cv::Size(2, 2), CV_8UC1);
+            parallelFor(n, [&](int i){
+                auto const & tile = tiles[i];
+                for (int y = std::max(tile.top, bbox.y); y < std::min(tile.bottom, bbox.y + bbox.height); ++y){
+                    auto l = labels.ptr<int>(y) + bbox.x;
+                    auto m = mask.ptr<uchar>(y - bbox.y + 1) + 1;
+                    for (int x = 0; x < bbox.width; ++x){
+                        m[x] = l[x] && roots[tile.offset + l[x] - 1] == best ? 255 : 0;
+                    }
+                }
+            });
+            std::vector<std::vector<cv::Point>> contours;
+            cv::findContours(mask, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE, bbox.tl() - cv::Point(1, 1));
+            std::vector<cv::Point> dst;
+            double maxArea = -1;
+            for (auto & points : contours){
+                double const area = cv::contourArea(points);
+                if (maxArea < area){
+                    maxArea = area;
+                    dst.swap(points);
+                }
+            }
+            if (maxArea < size.area() * 0.9){
+                return dst;
+            }
+        }
+        return std::vector<cv::Point>();
+    }
+}
+
+void binarizeBlocks(cv::Mat const & image, int bin_th, cv::Mat & bin)
+{
+    cv::Mat hls;
+    cv::cvtColor(image, hls, CV_BGR2HLS);
+    for (int y = 0; y < hls.rows; ++y){
+        auto src = hls.ptr<uchar>(y);
+        auto dst = bin.ptr<uchar>(y);
+        for (int x = 0; x < hls.cols; ++x, src += 3){
+            dst[x] = bin_th < mix(src) ? 255 : 0;
+        }
+    }
+}
+
+void binarizeBlocks(cv::Mat const & image, int bin_th, cv::Mat & bin, Histogram & histogram)
+{
+    cv::Mat hls;
+    cv::cvtColor(image, hls, CV_BGR2HLS);
+    for (int y = 0; y < hls.rows; ++y){
+        auto src = hls.ptr<uchar>(y);
+        auto dst = bin.ptr<uchar>(y);
+        int x = 0;
+        // 閾値を決めるには間引いて数えれば十分で、全画素を数えると同じ要素への加算が連なって遅くなる
+        for (; x + HISTOGRAM_STEP <= hls.cols; x += HISTOGRAM_STEP, src += 3 * HISTOGRAM_STEP){
+            int const m = mix(src);
+            ++histogram[m];
+            dst[x] = bin_th < m ? 255 : 0;
+            for (int i = 1; i < HISTOGRAM_STEP; ++i){
+                dst[x + i] = bin_th < mix(src + 3 * i) ? 255 : 0;
+            }
+        }
+        for (; x < hls.cols; ++x, src += 3){
+            dst[x] = bin_th < mix(src) ? 255 : 0;
+        }
+    }
+}
+
+void mixLightnessSaturation(cv::Mat const & image, cv::Mat & mixed)
+{
+    cv::Mat hls;
+    cv::cvtColor(image, hls, CV_BGR2HLS);
+    mixed.create(image.size(), CV_8UC1);
+    for (int y = 0; y < hls.rows; ++y){
+        auto src = hls.ptr<uchar>(y);
+        auto dst = mixed.ptr<uchar>(y);
+        for (int x = 0; x < hls.cols; ++x, src += 3){
+            dst[x] = static_cast<uchar>(mix(src));
+        }
+    }
+}
+
+std::vector<cv::Point> segmentBlocks(cv::Mat const & image, int bin_th)
+{
+    return segment(image.size(), [&image, bin_th](int top, int bottom, cv::Mat & dst){
+        binarizeBlocks(image.rowRange(top, bottom), bin_th, dst);
+    });
+}
+
+std::vector<cv::Point> segmentBlocks(cv::Mat const & image, int bin_th, Histogram & histogram)
+{
+    std::mutex mutex;
+    return segment(image.size(), [&image, bin_th, &histogram, &mutex](int top, int bottom, cv::Mat & dst){
+        Histogram tile = {};
+        binarizeBlocks(image.rowRange(top, bottom), bin_th, dst, tile);
+        std::unique_lock<std::mutex> lock(mutex);
+        for (int i = 0; i < 256; ++i){
+            histogram[i] += tile[i];
+        }
+    });
+}
+
+std::vector<cv::Point> segmentMixed(cv::Mat const & mixed, int bin_th)
+{
+    return segment(mixed.size(), [&mixed, bin_th](int top, int bottom, cv::Mat & dst){
+        cv::threshold(mixed.rowRange(top, bottom), dst, bin_th, 255, cv::THRESH_BINARY);
+    });
+}
+
+std::vector<cv::Point> HlsSegmenter::contour(int pyramid) const
+{
+    cv::Mat small = image_;
+    if (1 < pyramid){
+        cv::resize(image_, small, cv::Size(), 1.0 / pyramid, 1.0 / pyramid, cv::INTER_AREA);
+    }
+    return histogram_ ? segmentBlocks(small, bin_th_, *histogram_) : segmentBlocks(small, bin_th_);
+}
+
+void HlsSegmenter::binarize(cv::Rect const & rc, cv::Mat & dst) const
+{
+    binarizeBlocks(image_(rc), bin_th_, dst);
+}
+
+std::vector<cv::Point> MixedSegmenter::contour(int pyramid) const
+{
+    return segmentMixed(pyramid <= 1 ? mixed_ : small_, bin_th_);
+}
+
+void MixedSegmenter::binarize(cv::Rect const & rc, cv::Mat & dst) const
+{
+    cv::threshold(mixed_(rc), dst, bin_th_, 255, cv::THRESH_BINARY);
+}
+
+std::vector<cv::Point> MaskSegmenter::contour(int pyramid) const
+{
+    cv::Mat small = mask_;
+    if (1 < pyramid){
+        cv::resize(mask_, small, cv::Size(), 1.0 / pyramid, 1.0 / pyramid, cv::INTER_AREA);
+    }
+    return segmentMixed(small, 127);
+}
+
+void MaskSegmenter::binarize(cv::Rect const & rc, cv::Mat & dst) const
+{
+    mask_(rc).copyTo(dst);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <array>
+
+/*!
+HLSのLとSの平均のヒストグラム
+*/
+typedef std::array<int, 256> Histogram;
+
+/*!
+ブロックとそれ以外に2値化する
+HLSのLとSの平均を閾値で切る
+@param[in] image カメラ画像
+@param[in] bin_th 2値化の閾値
+@param[out] bin 2値画像(0か255)。imageと同じ大きさで確保しておく
+*/
+void binarizeBlocks(cv::Mat const & image, int bin_th, cv::Mat & bin);
+
+/*!
+ブロックとそれ以外に2値化し、あわせてLとSの平均のヒストグラムを数える
+2値化と同じ走査で横4画素に1画素を数えるので、画像をもう一度読むことはなく、2値化だけのときとほとんど時間が変わらない
+@param[in] image カメラ画像
+@param[in] bin_th 2値化の閾値
+@param[out] bin 2値画像(0か255)。imageと同じ大きさで確保しておく
+@param[in,out] histogram ヒストグラム。数えた画素数を足す
+*/
+void binarizeBlocks(cv::Mat const & image, int bin_th, cv::Mat & bin, Histogram & histogram);
+
+/*!
+HLSのLとSの平均を求める
+2値化の閾値によらないので、閾値だけを変えて何度も2値化するときは1回だけ求めて使い回す
+@param[in] image カメラ画像
+@param[out] mixed LとSの平均(CV_8UC1)。binarizeBlocksはこれを閾値で切る
+*/
+void mixLightnessSaturation(cv::Mat const & image, cv::Mat & mixed);
+
+/*!
+カメラの画像からブロックの領域を抽出する
+画像を横長のタイルに分けて、2値化と連結成分のラベル付けをタイルごとに並列に行い、タイルの境界で連結成分をつなぐ
+輪郭は選んだ連結成分の外接矩形の中だけで求める
+並列数はcv::setNumThreadsに従う
+@param[in] image カメラ画像
+@param[in] bin_th 2値化の閾値
+@return 一番面積の広い領域の輪郭。ただし画像サイズ並みの面積だった場合は除外
+*/
+std::vector<cv::Point> segmentBlocks(cv::Mat const & image, int bin_th);
+
+/*!
+カメラの画像からブロックの領域を抽出し、あわせてLとSの平均のヒストグラムを数える
+@param[in] image カメラ画像
+@param[in] bin_th 2値化の閾値
+@param[in,out] histogram ヒストグラム。数えた画素数を足す
+@return segmentBlocksと同じ
+*/
+std::vector<cv::Point> segmentBlocks(cv::Mat const & image, int bin_th, Histogram & histogram);
+
+/*!
+mixLightnessSaturationで求めた画像からブロックの領域を抽出する
+segmentBlocksと同じ結果になる
+@param[in] mixed HLSのLとSの平均
+@param[in] bin_th 2値化の閾値
+@return segmentBlocksと同じ
+*/
+std::vector<cv::Point> segmentMixed(cv::Mat const & mixed, int bin_th);
+
+/*!
+ブロックの領域を抽出する方法
+ブロック認識は輪郭の抽出と、縮小したときの境界の2値化をこれを通して行う
+*/
+class Segmenter
+{
+public:
+    virtual ~Segmenter() {}
+    /*!
+    ブロックの領域を抽出する
+    @param[in] pyramid 縮小率。1なら縮小しない
+    @return 縮小した画像での一番面積の広い領域の輪郭(segmentBlocksと同じ)
+    */
+    virtual std::vector<cv::Point> contour(int pyramid) const = 0;
+    /*!
+    元の解像度で画像の一部を2値化する
+    @param[in] rc 2値化する範囲
+    @param[out] dst 2値画像(0か255)。rcと同じ大きさで確保しておく
+    */
+    virtual void binarize(cv::Rect const & rc, cv::Mat & dst) const = 0;
+};
+
+/*!
+HLSのLとSの平均を閾値で切る
+*/
+class HlsSegmenter : public Segmenter
+{
+    cv::Mat const image_;
+    int const bin_th_;
+    Histogram * histogram_;
+public:
+    /*!
+    @param[in] image カメラ画像
+    @param[in] bin_th 2値化の閾値
+    @param[in,out] histogram nullptrでなければ、contourで2値化した画素のLとSの平均を数える
+    */
+    HlsSegmenter(cv::Mat const & image, int bin_th, Histogram * histogram = nullptr) : image_(image), bin_th_(bin_th), histogram_(histogram) {}
+    std::vector<cv::Point> contour(int pyramid) const;
+    void binarize(cv::Rect const & rc, cv::Mat & dst) const;
+};
+
+/*!
+mixLightnessSaturationで求めておいた画像を閾値で切る
+同じ画像を閾値だけ変えて何度も2値化するときに使う
+*/
+class MixedSegmenter : public Segmenter
+{
+    cv::Mat const mixed_;
+    cv::Mat const small_;
+    int const bin_th_;
+public:
+    /*!
+    @param[in] mixed 画像のLとSの平均
+    @param[in] small 縮小した画像のLとSの平均。縮小しないなら空
+    @param[in] bin_th 2値化の閾値
+    */
+    MixedSegmenter(cv::Mat const & mixed, cv::Mat const & small, int bin_th) : mixed_(mixed), small_(small), bin_th_(bin_th) {}
+    std::vector<cv::Point> contour(int pyramid) const;
+    void binarize(cv::Rect const & rc, cv::Mat & dst) const;
+};
+
+/*!
+背景差分などで求めておいた前景の2値画像をそのまま使う
+縮小するときは前景の割合が半分を超える画素を前景とする
+*/
+class MaskSegmenter : public Segmenter
+{
+    cv::Mat const mask_;
+public:
+    /*!
+    @param[in] mask 前景を255、背景を0とした画像
+    */
+    explicit MaskSegmenter(cv::Mat const & mask) : mask_(mask) {}
+    std::vector<cv::Point> contour(int pyramid) const;
+    void binarize(cv::Rect const & rc, cv::Mat & dst) const;
+};
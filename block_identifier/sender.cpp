@@ -1,30 +1,26 @@
 #include "sender.h"
-#include "picojson.h"
+#include "orders.h"
+#include "trace.h"
+#include "metrics.h"
+#include "log.h"
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/format.hpp>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
 
 namespace
 {
+    typedef std::chrono::steady_clock clock_type;
+
     std::string makeJson(Option const & opt, std::vector<BlockInfo> const & blockInfo)
     {
-        using value = picojson::value;
-        picojson::array orders;
-        for (auto info : blockInfo){
-            auto const inst = opt.block2inst.find(info.to_block());
-            if (inst == opt.block2inst.end()){
-                std::cerr << boost::format("[%s:%d] is not mapped with any instructions.") % info.color.name % info.width << std::endl;
-                continue;
-            }
-            picojson::object item;
-            item["id"] = value(inst->second.name);
-            for(auto param : inst->second.param){
-                item[param.first] = value(param.second);
-            }
-            orders.emplace_back(item);
-        }
-        picojson::object root;
-        root["orders"] = value(orders);
-        return value(root).serialize();
+        TRACE_SCOPE("makeJson");
+        return makeOrdersJson(opt, blockInfo, [](BlockInfo const & info){
+            Metrics::get().unmapped_blocks.add();
+            LOG_WARN("orders", "[%s:%d] is not mapped with any instructions.", info.color.name, info.width);
+        });
     }
 
     /*void sendTcp(std::string const & data, std::string const & address, int port)
@@ -40,82 +36,411 @@ namespace
         std::cout << "finished" << std::endl;
     }*/
 
-    void postJson(
-        std::string host,
-        int port,
-        std::string path,
-        std::string json)
-    {
 #define NEW_LINE    "\r\n"
-        boost::asio::io_service io_service;
-        boost::asio::ip::tcp::resolver resolver(io_service);
-        boost::asio::ip::tcp::resolver::query query(host, "http");
-        boost::asio::ip::tcp::socket sock(io_service);
-        std::cout << "connecting... " << host << std::endl;
-        sock.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(host), port));
-        std::cout << "connected." << std::endl;
-
-        // request
+    /*!
+    HTTPリクエストを書き込む
+    @param[in] req_s 書き込み先
+    @param[in] host 送信先
+    @param[in] path パス
+    @param[in] json 送信するJSON
+    */
+    void writeRequest(std::ostream & req_s, std::string const & host, std::string const & path, std::string const & json)
+    {
+        req_s
+            << "POST " << path << " HTTP/1.1" NEW_LINE
+            << "Host: " << host << NEW_LINE
+            << "Accept: */*" NEW_LINE
+            << "Content-Length: " << json.size() << NEW_LINE
+            << "Content-Type: application/json" NEW_LINE
+            << "Connection: Close" NEW_LINE
+            << NEW_LINE
+            << json
+            ;
+        LOG_DEBUG("send", "message %s", json);
+    }
+
+    /*!
+    最後まで受信したHTTPレスポンスをログに書く
+    @param[in] response 受信バッファ
+    @return ステータスコード。応答がなければ0
+    */
+    unsigned int printResponse(boost::asio::streambuf & response)
+    {
+        std::istream res_s(&response);
+        std::string http_version;
+        unsigned int status_code = 0;
+        res_s >> http_version;
+        res_s >> status_code;
+        if (!res_s){
+            LOG_WARN("send", "Not found response status.");
+            return 0;
+        }
+        std::string const buf((std::istreambuf_iterator<char>(res_s)), std::istreambuf_iterator<char>());
+        const char * target = NEW_LINE NEW_LINE;
+        auto p = buf.find(target);
+        if (p == std::string::npos){
+            LOG_WARN("send", "Not found respoce message.");
+            return status_code;
+        }
+        LOG_INFO("send", "response %s %d %s", http_version, status_code, buf.substr(p + strlen(target)));
+        return status_code;
+    }
+}
+
+void validateSender(std::string const & address, int port, SendConfig const & config)
+{
+    if (config.connect_timeout_ms <= 0 || config.response_timeout_ms <= 0 || config.deadline_ms <= 0){
+        throw std::runtime_error("send timeouts should be positive.");
+    }
+    if (config.retries < 0 || config.backoff_ms < 0 || config.max_backoff_ms < config.backoff_ms || config.breaker_failures <= 0 || config.breaker_open_ms <= 0){
+        throw std::runtime_error("invalid send retry or breaker config.");
+    }
+    if (address.empty()){
+        return;
+    }
+    boost::system::error_code ec;
+    boost::asio::ip::address::from_string(address, ec);
+    if (ec){
+        throw std::runtime_error((boost::format("invalid address [%s]") % address).str());
+    }
+    if (port <= 0 || 65535 < port){
+        throw std::runtime_error((boost::format("invalid port [%d]") % port).str());
+    }
+}
+
+/*!
+送信先の状態。io_serviceのスレッドだけで使う
+*/
+struct Sender::Impl : public std::enable_shared_from_this<Sender::Impl>
+{
+    enum class Breaker
+    {
+        closed, ///< 送信する
+        open, ///< 送信を止め、接続できるか調べている
+        half_open, ///< 接続できたので、次の送信を1回だけ試す
+    };
+    boost::asio::io_service & io_service;
+    std::string const address;
+    int const port;
+    SendConfig const config;
+    boost::asio::ip::tcp::endpoint endpoint;
+    boost::asio::steady_timer probe_timer;
+    Breaker breaker;
+    int failures; ///< 連続して失敗した送信数
+    bool trial; ///< half_openで試しの送信をしている
+    bool stopped;
+
+    Impl(boost::asio::io_service & io_service, std::string const & address, int port, SendConfig const & config)
+        : io_service(io_service)
+        , address(address)
+        , port(port)
+        , config(config)
+        , probe_timer(io_service)
+        , breaker(Breaker::closed)
+        , failures(0)
+        , trial(false)
+        , stopped(false)
+    {
+        validateSender(address, port, config);
+        if (!address.empty()){
+            endpoint = boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(address), static_cast<unsigned short>(port));
+        }
+    }
+
+    /*!
+    送信を始めてよいか決める
+    @return 試行回数。0なら送信しない
+    */
+    int admit()
+    {
+        if (breaker == Breaker::open || (breaker == Breaker::half_open && trial)){
+            return 0;
+        }
+        if (breaker == Breaker::half_open){
+            trial = true;
+            return 1;
+        }
+        return config.retries + 1;
+    }
+
+    /*!
+    送信の結果から送信先が止まっているか判断する
+    @param[in] result 送信の結果
+    */
+    void finished(SendResult result)
+    {
+        trial = false;
+        if (result == SendResult::sent){
+            if (breaker != Breaker::closed){
+                LOG_INFO("send", "%s:%d recovered. resumed sending.", address, port);
+                probe_timer.cancel();
+            }
+            breaker = Breaker::closed;
+            failures = 0;
+            return;
+        }
+        ++failures;
+        if (breaker == Breaker::open || (breaker == Breaker::closed && failures < config.breaker_failures)){
+            return;
+        }
+        breaker = Breaker::open;
+        Metrics::get().breaker_opens.add();
+        LOG_ERROR("send", "%s:%d seems down after %d failures. rejecting sends and probing every %dms.", address, port, failures, config.breaker_open_ms);
+        probe();
+    }
+
+    /*!
+    breaker_open_ms後に接続できるか調べる。接続できなければ繰り返す
+    応答しないだけのプロセスでも接続はできるので、接続できたら実際の送信を1回試して判断する
+    */
+    void probe()
+    {
+        auto self = shared_from_this();
+        probe_timer.expires_from_now(std::chrono::milliseconds(config.breaker_open_ms));
+        probe_timer.async_wait([self](boost::system::error_code const & ec){
+            if (ec || self->stopped || self->breaker != Breaker::open){
+                return;
+            }
+            auto sock = std::make_shared<boost::asio::ip::tcp::socket>(self->io_service);
+            auto timer = std::make_shared<boost::asio::steady_timer>(self->io_service);
+            timer->expires_from_now(std::chrono::milliseconds(self->config.connect_timeout_ms));
+            timer->async_wait([sock](boost::system::error_code const & ec){
+                if (!ec){
+                    boost::system::error_code ignored;
+                    sock->close(ignored);
+                }
+            });
+            sock->async_connect(self->endpoint, [self, sock, timer](boost::system::error_code const & ec){
+                timer->cancel();
+                if (self->stopped || self->breaker != Breaker::open){
+                    return;
+                }
+                if (ec){
+                    self->probe();
+                    return;
+                }
+                self->breaker = Breaker::half_open;
+                LOG_INFO("send", "%s:%d accepted a connection. trying the next send.", self->address, self->port);
+            });
+        });
+    }
+};
+
+namespace
+{
+    /*!
+    1回の送信
+    接続と応答の待ち時間を段階ごとに設け、失敗したら間隔を倍にしながら再送する
+    どの待ち時間も送信の締め切りを超えない
+    */
+    class SendSession : public std::enable_shared_from_this<SendSession>
+    {
+        std::shared_ptr<Sender::Impl> sender_;
+        std::string const request_;
+        std::function<void(SendResult)> done_;
+        int const attempts_; ///< 最大試行回数
+        int attempt_; ///< 試行回数
+        clock_type::time_point const deadline_;
+        clock_type::time_point attempt_begin_;
+        boost::asio::ip::tcp::socket sock_;
+        boost::asio::steady_timer timer_;
+        boost::asio::streambuf response_;
+        bool timed_out_; ///< 待ち時間を過ぎてソケットを閉じた
+
+        /*!
+        次の段階の待ち時間を設定する。過ぎたらソケットを閉じて処理中の操作を終わらせる
+        @param[in] timeout_ms 待ち時間
+        */
+        void arm(int timeout_ms)
+        {
+            auto self = shared_from_this();
+            timer_.expires_at(std::min(clock_type::now() + std::chrono::milliseconds(timeout_ms), deadline_));
+            timer_.async_wait([self](boost::system::error_code const & ec){
+                // 期限を延ばした後に前の期限の処理が呼ばれることがあるので、期限を確かめる
+                if (ec || clock_type::now() < self->timer_.expires_at()){
+                    return;
+                }
+                self->timed_out_ = true;
+                boost::system::error_code ignored;
+                self->sock_.close(ignored);
+            });
+        }
+
+        void attempt()
+        {
+            auto self = shared_from_this();
+            ++attempt_;
+            timed_out_ = false;
+            attempt_begin_ = clock_type::now();
+            response_.consume(response_.size());
+            LOG_INFO("send", "connecting %s:%d", sender_->address, sender_->port);
+            arm(sender_->config.connect_timeout_ms);
+            sock_.async_connect(sender_->endpoint, [self](boost::system::error_code const & ec){
+                if (ec){
+                    self->failed(ec);
+                    return;
+                }
+                LOG_DEBUG("send", "connected.");
+                self->arm(self->sender_->config.response_timeout_ms);
+                boost::asio::async_write(self->sock_, boost::asio::buffer(self->request_), [self](boost::system::error_code const & ec, size_t){
+                    if (ec){
+                        self->failed(ec);
+                        return;
+                    }
+                    // Connection: Closeなので切断まで受信する
+                    boost::asio::async_read(self->sock_, self->response_, [self](boost::system::error_code const & ec, size_t){
+                        if (ec && ec != boost::asio::error::eof){
+                            self->failed(ec);
+                            return;
+                        }
+                        self->received();
+                    });
+                });
+            });
+        }
+
+        void received()
         {
-            boost::asio::streambuf request;
-            std::ostream req_s(&request);
-            req_s
-                << "POST " << path << " HTTP/1.1" NEW_LINE
-                << "Host: " << host << NEW_LINE
-                << "Accept: */*" NEW_LINE
-                << "Content-Length: " << json.size() << NEW_LINE
-                << "Content-Type: application/json" NEW_LINE
-                << "Connection: Close" NEW_LINE
-                << NEW_LINE
-                << json
-                ;
-            std::cout << "MESSAGE :\n" << json << "\n" << std::endl;
-            boost::asio::write(sock, request);
-        }
-
-        // responce
+            timer_.cancel();
+            auto const end = clock_type::now();
+            Metrics::get().http_round_trip.record(end - attempt_begin_);
+            if (Trace::enabled()){
+                Trace::record("postJson", attempt_begin_, end);
+            }
+            auto const status = printResponse(response_);
+            if (200 <= status && status < 300){
+                close();
+                finish(SendResult::sent);
+                return;
+            }
+            // 応答がないかサーバーのエラーなら再送する。それ以外は送り直しても同じ
+            retry(SendResult::failed, (boost::format("status %d") % status).str(), status == 0 || 500 <= status);
+        }
+
+        void failed(boost::system::error_code const & ec)
         {
-            boost::asio::streambuf response;
-            boost::asio::read_until(sock, response, NEW_LINE);
-            std::istream res_s(&response);
-            std::string http_version;
-            unsigned int status_code;
-            res_s >> http_version;
-            res_s >> status_code;
-            std::vector<char> buf(1000);
-            res_s.read(buf.data(), buf.size()); // TODO: eofを確認しバッファ長よりも長いデータを最後まで受けとるべき
-            buf.push_back(0);
-            const char * target = NEW_LINE NEW_LINE;
-            auto p = std::strstr(buf.data(), target);
-            if (!p){
-                std::cout << "Not found respoce message." << std::endl;
+            timer_.cancel();
+            if (timed_out_){
+                Metrics::get().send_timeouts.add();
+                retry(SendResult::timeout, "timed out", true);
+            }
+            else{
+                retry(SendResult::failed, ec.message(), true);
+            }
+        }
+
+        /*!
+        締め切りまでに間に合えば再送し、間に合わなければ諦める
+        @param[in] result 諦めたときの結果
+        @param[in] reason 失敗の理由
+        @param[in] retryable 再送してよい
+        */
+        void retry(SendResult result, std::string const & reason, bool retryable)
+        {
+            close();
+            auto const & config = sender_->config;
+            int const delay = std::min(config.max_backoff_ms, config.backoff_ms << std::min(attempt_ - 1, 16));
+            auto const next = clock_type::now() + std::chrono::milliseconds(delay);
+            if (!retryable || attempts_ <= attempt_ || deadline_ <= next){
+                LOG_ERROR("send", "failed to send after %d attempts: %s", attempt_, reason);
+                finish(result);
                 return;
             }
-            std::cout
-                << boost::format("%-12s : %s\n") % "HTTP VERSION" % http_version
-                << boost::format("%-12s : %d\n") % "STATUS CODE" % status_code
-                << boost::format("%-12s : %s\n") % "MESSAGE" % (p + strlen(target))
-                ;
+            Metrics::get().send_retries.add();
+            LOG_WARN("send", "attempt %d failed: %s. retrying in %dms.", attempt_, reason, delay);
+            auto self = shared_from_this();
+            timer_.expires_at(next);
+            timer_.async_wait([self](boost::system::error_code const & ec){
+                if (!ec){
+                    self->attempt();
+                }
+            });
+        }
+
+        void close()
+        {
+            boost::system::error_code ignored;
+            sock_.close(ignored);
+        }
+
+        void finish(SendResult result)
+        {
+            if (result == SendResult::sent){
+                Metrics::get().send_successes.add();
+            }
+            else{
+                Metrics::get().send_failures.add();
+            }
+            sender_->finished(result);
+            if (done_){
+                done_(result);
+            }
+        }
+    public:
+        SendSession(std::shared_ptr<Sender::Impl> const & sender, std::string const & request, int attempts, std::function<void(SendResult)> done)
+            : sender_(sender)
+            , request_(request)
+            , done_(done)
+            , attempts_(attempts)
+            , attempt_(0)
+            , deadline_(clock_type::now() + std::chrono::milliseconds(sender->config.deadline_ms))
+            , sock_(sender->io_service)
+            , timer_(sender->io_service)
+            , timed_out_(false)
+        {
+        }
+        void start()
+        {
+            attempt();
         }
+    };
 #undef NEW_LINE
-    }
 }
 
-void sendToServer(Option const & opt, std::vector<BlockInfo> const & blockInfo, std::string const & address, int port)
+Sender::Sender(boost::asio::io_service & io_service, std::string const & address, int port, SendConfig const & config)
+    : impl_(std::make_shared<Impl>(io_service, address, port, config))
+{
+}
+
+Sender::~Sender()
 {
+    impl_->stopped = true;
+    impl_->probe_timer.cancel();
+}
+
+void Sender::send(Option const & opt, std::vector<BlockInfo> const & blockInfo, std::function<void(SendResult)> done)
+{
+    TRACE_SCOPE("sendToServer");
     try{
         if (blockInfo.empty()){
             throw std::runtime_error("block count should be natural number.");
         }
         auto const data = makeJson(opt, blockInfo);
-        if (address.empty()){
+        if (impl_->address.empty()){
             std::cout << data << std::endl;
+            if (done){
+                done(SendResult::sent);
+            }
+            return;
         }
-        else{
-            postJson(address, port, "/api/show", data);
+        int const attempts = impl_->admit();
+        if (attempts == 0){
+            Metrics::get().send_rejected.add();
+            LOG_WARN("send", "rejected sending because %s:%d seems down.", impl_->address, impl_->port);
+            if (done){
+                done(SendResult::rejected);
+            }
+            return;
         }
+        std::ostringstream request;
+        writeRequest(request, impl_->address, "/api/show", data);
+        std::make_shared<SendSession>(impl_, request.str(), attempts, done)->start();
     }
     catch (std::exception const & e) {
-        std::cerr << e.what() << std::endl;
+        Metrics::get().send_failures.add();
+        LOG_ERROR("send", "%s", e.what());
+        if (done){
+            done(SendResult::failed);
+        }
     }
 }
@@ -1,12 +1,77 @@
 #pragma once
 
 #include "option.h"
+#include <boost/asio/io_service.hpp>
+#include <functional>
+#include <memory>
 
 /*!
-ブロック情報を送信する
-@param[in] opt オプション
-@param[in] blockInfo ブロック情報
-@param[in] address 送信先
+送信の設定
+1回の送信はdeadline_msを超えない。接続と応答の待ち時間、再送の間隔もこの中に収める
+*/
+struct SendConfig
+{
+    int connect_timeout_ms = 200; ///< 接続を待つ時間
+    int response_timeout_ms = 1000; ///< 接続してから応答を受信し終えるまで待つ時間
+    int deadline_ms = 1500; ///< 送信を始めてから諦めるまでの時間。再送も含む
+    int retries = 2; ///< 失敗したときに再送する回数
+    int backoff_ms = 50; ///< 最初の再送までの間隔。再送ごとに2倍にする
+    int max_backoff_ms = 400; ///< 再送の間隔の上限
+    int breaker_failures = 3; ///< 連続してこの回数送信に失敗したら送信を止める
+    int breaker_open_ms = 2000; ///< 送信を止めている間に接続できるか調べる間隔
+};
+
+/*!
+送信の結果
+*/
+enum class SendResult
+{
+    sent, ///< 送信して2xxの応答を受けた(送信先がなければ表示した)
+    failed, ///< 接続できないかエラーの応答で、再送しても送れなかった
+    timeout, ///< 最後の試行が時間切れだった
+    rejected, ///< 送信先が止まっているとみなし、送信しなかった
+};
+
+/*!
+送信先と送信の設定を調べる
+Senderは別スレッドで作ることがあるので、起動時に呼んで設定の誤りを先に報告する
+@param[in] address 送信先。空なら送信しない
 @param[in] port ポート番号
+@param[in] config 送信の設定
+@throw std::runtime_error 送信先か設定が正しくない
+*/
+void validateSender(std::string const & address, int port, SendConfig const & config);
+
+/*!
+ブロック情報を送信するクラス
+送信処理はio_serviceのスレッドで非同期に行い、呼び出し元はブロックしない
+連続して送信に失敗したら、送信先が止まっているとみなしてすぐに失敗を返し(サーキットブレーカー)、
+breaker_open_msごとに接続できるか調べる。接続できたら次の送信を1回だけ試し、成功したら送信を再開する
+sendはio_serviceのスレッドから呼ぶ
 */
-void sendToServer(Option const & opt, std::vector<BlockInfo> const & blockInfo, std::string const & address, int port);
+class Sender
+{
+    Sender & operator=(Sender const &) = delete;
+    Sender(Sender const &) = delete;
+public:
+    struct Impl;
+private:
+    std::shared_ptr<Impl> impl_;
+public:
+    /*!
+    @param[in] io_service 送信処理を行うio_service
+    @param[in] address 送信先。空なら送信せずに標準出力に書く
+    @param[in] port ポート番号
+    @param[in] config 送信の設定
+    @throw std::runtime_error 送信先か設定が正しくない(validateSender)
+    */
+    Sender(boost::asio::io_service & io_service, std::string const & address, int port, SendConfig const & config = SendConfig());
+    ~Sender();
+    /*!
+    ブロック情報を送信する
+    @param[in] opt オプション
+    @param[in] blockInfo ブロック情報
+    @param[in] done 送信を終えたときに結果を受け取る関数。io_serviceのスレッドで呼ぶ。省略可
+    */
+    void send(Option const & opt, std::vector<BlockInfo> const & blockInfo, std::function<void(SendResult)> done = nullptr);
+};
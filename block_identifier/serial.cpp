@@ -1,6 +1,9 @@
 #include "serial.h"
-#include <wtypes.h>
 #include <boost/format.hpp>
+#include <stdexcept>
+
+#if defined _WIN32 || defined _WIN64
+#include <wtypes.h>
 
 namespace
 {
@@ -88,7 +91,176 @@ bool Serial::receive(std::vector<unsigned char> & buffer)const
     return ReadFile(m_com, &buffer.front(), buffer.size(), &read_size, 0) && read_size == buffer.size();
 }
 
+bool Serial::wait(int timeout_ms)
+{
+    // Windowsは受信イベントを使わず、短い間隔でキューを確認する
+    for (int elapsed = 0; ; elapsed += 10){
+        DWORD dwError;
+        COMSTAT comStat;
+        if (INVALID_HANDLE_VALUE == m_com || !ClearCommError(m_com, &dwError, &comStat)){
+            return false;
+        }
+        if (0 < comStat.cbInQue){
+            return true;
+        }
+        if (timeout_ms <= elapsed){
+            return false;
+        }
+        Sleep(10);
+    }
+}
+
 bool Serial::connected()const
 {
     return m_com != INVALID_HANDLE_VALUE;
 }
+
+#else // defined _WIN32 || defined _WIN64
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+namespace
+{
+    /**
+    * ボーレートをtermiosの定数に変換する
+    * @param[in] baudrate ボーレート
+    * @return termiosの定数
+    * @note 対応していない値の場合例外を投げる
+    */
+    speed_t getSpeed(int baudrate)
+    {
+        switch (baudrate){
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        default: break;
+        }
+        throw std::runtime_error((boost::format("Invalid baudrate [%d]") % baudrate).str());
+    }
+    /**
+    * PortInfoを元にtermiosを設定する
+    * パリティ、ストップビットの値はDCBと同じ意味で解釈する
+    */
+    void setTermios(termios & tio, PortInfo const & info)
+    {
+        cfmakeraw(&tio);
+        auto const speed = getSpeed(info.baudrate);
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cflag &= ~CSIZE;
+        switch (info.bytesize){
+        case 5: tio.c_cflag |= CS5; break;
+        case 6: tio.c_cflag |= CS6; break;
+        case 7: tio.c_cflag |= CS7; break;
+        default: tio.c_cflag |= CS8; break;
+        }
+        tio.c_cflag &= ~(PARENB | PARODD);
+        if (info.parity == 1){ // ODDPARITY
+            tio.c_cflag |= PARENB | PARODD;
+        }
+        else if (info.parity == 2){ // EVENPARITY
+            tio.c_cflag |= PARENB;
+        }
+        if (info.stopbits == 2){ // TWOSTOPBITS
+            tio.c_cflag |= CSTOPB;
+        }
+        else{
+            tio.c_cflag &= ~CSTOPB;
+        }
+        tio.c_cc[VMIN] = 1; // 受信データがないときに0バイトを返すとEOFと区別できない
+        tio.c_cc[VTIME] = 0;
+    }
+}
+
+Serial::Serial()
+    : m_fd(-1)
+{
+}
+
+Serial::~Serial()
+{
+    close();
+}
+
+void Serial::open(PortInfo const & info)
+{
+    close();
+    m_fd = ::open(info.path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (m_fd < 0){
+        throw std::runtime_error((boost::format("Failed to open port %s") % info.path).str());
+    }
+    termios tio;
+    if (tcgetattr(m_fd, &tio) != 0){
+        close();
+        throw std::runtime_error("Function failed. [tcgetattr]");
+    }
+    setTermios(tio, info);
+    if (tcsetattr(m_fd, TCSANOW, &tio) != 0){
+        close();
+        throw std::runtime_error("Function failed. [tcsetattr]");
+    }
+    tcflush(m_fd, TCIFLUSH);
+}
+
+void Serial::close()
+{
+    if (0 <= m_fd){
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool Serial::send(std::vector<unsigned char> const & data)const
+{
+    return 0 <= m_fd && ::write(m_fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+}
+
+bool Serial::receive(std::vector<unsigned char> & buffer)const
+{
+    int size = 0;
+    if (m_fd < 0 || ioctl(m_fd, FIONREAD, &size) != 0 || size <= 0){
+        return false;
+    }
+    buffer.resize(size);
+    auto const read_size = ::read(m_fd, buffer.data(), buffer.size());
+    if (read_size < 0){
+        buffer.clear();
+        return false;
+    }
+    buffer.resize(read_size);
+    return true;
+}
+
+bool Serial::wait(int timeout_ms)
+{
+    if (m_fd < 0){
+        return false;
+    }
+    pollfd pfd = { m_fd, POLLIN, 0 };
+    if (poll(&pfd, 1, timeout_ms) <= 0){
+        return false;
+    }
+    // ケーブルを抜くとPOLLHUPなどがすぐに返り続けるので、閉じて再接続させる
+    if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)){
+        close();
+        return false;
+    }
+    return (pfd.revents & POLLIN) != 0;
+}
+
+bool Serial::connected()const
+{
+    return 0 <= m_fd;
+}
+
+#endif // defined _WIN32 || defined _WIN64
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <string>
 
 /*!
 ポート情報
@@ -8,6 +9,7 @@
 struct PortInfo
 {
     int port; ///< ポート番号
+    std::string path; ///< デバイスパス(windows以外)
     int baudrate; ///< ボーレート
     unsigned char bytesize; ///< バイト長
     unsigned char parity; ///< パリティ
@@ -21,7 +23,11 @@ class Serial
 {
     Serial & operator=(Serial const &) = delete;
     Serial(Serial const &) = delete;
+#if defined _WIN32 || defined _WIN64
     void * m_com;
+#else
+    int m_fd;
+#endif // defined _WIN32 || defined _WIN64
 public:
     Serial();
     ~Serial();
@@ -52,11 +58,28 @@ public:
     */
     bool receive(std::vector<unsigned char> & buffer)const;
 
+    /**
+    * データを受信するまで待つ
+    * @param[in] timeout_ms タイムアウト(ミリ秒)
+    * @retval true 受信データがある
+    * @retval false タイムアウトまたは失敗
+    * @note 切断を検知したらポートを閉じるので、connectedがfalseになる
+    */
+    bool wait(int timeout_ms);
+
     /**
     * COMポートの状態を返す
     * @retval true COMポートがオープンしている
     * @retval false COMポートがオープンしていない
-    * @note Open中にケーブルを抜いた、デバイスの電源を切ったなどの事象が発生したことは検知できない
+    * @note Open中にケーブルを抜いた、デバイスの電源を切ったなどの事象は、waitが検知するまでは分からない
     */
     bool connected()const;
+
+#if !(defined _WIN32 || defined _WIN64)
+    /**
+    * ファイルディスクリプタを返す
+    * 非同期I/Oで受信を待つため
+    */
+    int native_handle()const { return m_fd; }
+#endif // !(defined _WIN32 || defined _WIN64)
 };
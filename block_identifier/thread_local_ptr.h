@@ -0,0 +1,14 @@
+#pragma once
+
+/*!
+スレッドごとのポインタを関数内に宣言する。初期値はnullptr
+VS2013(v120)はthread_localに対応していないので処理系の拡張を使う
+拡張の変数はデストラクタを持てないので、指す先はスレッドが終了しても残る所で所有すること
+@param[in] type 指す型
+@param[in] name 変数名
+*/
+#if defined _MSC_VER
+#define THREAD_LOCAL_PTR(type, name) static __declspec(thread) type * name = nullptr
+#else
+#define THREAD_LOCAL_PTR(type, name) static __thread type * name = nullptr
+#endif // defined _MSC_VER
@@ -0,0 +1,398 @@
+#include "thread_policy.h"
+#include "log.h"
+#include <opencv2/opencv.hpp>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if defined _WIN32 || defined _WIN64
+#include <Windows.h>
+#elif defined __APPLE__
+#include <pthread.h>
+#elif defined __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif // defined _WIN32 || defined _WIN64
+
+namespace {
+    /*!
+    reserveThreadCoresで他のスレッドに残したコア
+    他のスレッドを起動する前に書き、その後は読むだけなので保護しない
+    */
+    std::vector<int> shared_cores;
+
+    /*!
+    OpenCVのスレッドプールを作らせるための何もしない並列処理
+    */
+    class WarmUpBody : public cv::ParallelLoopBody
+    {
+    public:
+        void operator()(cv::Range const &) const
+        {
+        }
+    };
+
+    /*!
+    @param[in] text 整数
+    @param[in] what エラー表示用の指定の名前
+    @param[in] spec エラー表示用の指定全体
+    @return 値
+    @throw std::runtime_error 整数でない
+    */
+    int parseInt(std::string const & text, char const * what, std::string const & spec)
+    {
+        size_t end = 0;
+        int value = 0;
+        try{
+            value = std::stoi(text, &end);
+        }
+        catch (std::exception const &){
+            end = 0;
+        }
+        if (text.empty() || end != text.size()){
+            throw std::runtime_error((boost::format("invalid %s [%s]") % what % spec).str());
+        }
+        return value;
+    }
+
+    /*!
+    @param[in] cores コアの番号
+    @return "0-1,4"のような表示
+    */
+    std::string describeCores(std::vector<int> const & cores)
+    {
+        std::ostringstream os;
+        for (size_t i = 0; i < cores.size();){
+            size_t j = i;
+            while (j + 1 < cores.size() && cores[j + 1] == cores[j] + 1){
+                ++j;
+            }
+            os << (i == 0 ? "" : ",") << cores[i];
+            if (i < j){
+                os << "-" << cores[j];
+            }
+            i = j + 1;
+        }
+        return os.str();
+    }
+
+#if defined __linux__ || defined __APPLE__
+    std::string errorMessage(int err)
+    {
+        return std::strerror(err);
+    }
+#endif // defined __linux__ || defined __APPLE__
+
+#if defined __linux__
+    /*!
+    起動したときのnice値。静的初期化はメインスレッドで行うので、メインスレッドの値になる
+    スケジューリングを指定しないスレッドはこの値に戻す
+    */
+    int const process_nice = getpriority(PRIO_PROCESS, 0);
+#endif // defined __linux__
+
+    /*!
+    @return 呼び出したスレッドが既定のスケジューリング(SCHEDULING_DEFAULT)で動いていればtrue
+    */
+    bool defaultScheduling()
+    {
+#if defined _WIN32 || defined _WIN64
+        return GetThreadPriority(GetCurrentThread()) == THREAD_PRIORITY_NORMAL;
+#elif defined __linux__ || defined __APPLE__
+        int policy = 0;
+        sched_param param = {};
+        if (pthread_getschedparam(pthread_self(), &policy, &param) != 0 || policy != SCHED_OTHER){
+            return false;
+        }
+#if defined __linux__
+        errno = 0;
+        int const nice = getpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)));
+        return errno != 0 || nice == process_nice;
+#else
+        return true;
+#endif // defined __linux__
+#else
+        return true;
+#endif // defined _WIN32 || defined _WIN64
+    }
+}
+
+ThreadPolicy parseThreadPolicy(std::string const & cores, std::string const & scheduling)
+{
+    ThreadPolicy dst;
+    std::set<int> unique;
+    std::istringstream is(cores);
+    std::string item;
+    while (std::getline(is, item, ',')){
+        auto const dash = item.find('-');
+        int const first = parseInt(item.substr(0, dash), "cores", cores);
+        int const last = dash == std::string::npos ? first : parseInt(item.substr(dash + 1), "cores", cores);
+        if (first < 0 || last < first){
+            throw std::runtime_error((boost::format("invalid cores [%s]") % cores).str());
+        }
+        for (int c = first; c <= last; ++c){
+            unique.insert(c);
+        }
+    }
+    dst.cores.assign(unique.begin(), unique.end());
+    if (scheduling.empty()){
+        return dst;
+    }
+    auto const colon = scheduling.find(':');
+    auto const kind = scheduling.substr(0, colon);
+    if (colon == std::string::npos || (kind != "fifo" && kind != "nice")){
+        throw std::runtime_error((boost::format("invalid scheduling [%s] (fifo:1-99, nice:-20-19)") % scheduling).str());
+    }
+    dst.priority = parseInt(scheduling.substr(colon + 1), "scheduling", scheduling);
+    if (kind == "fifo"){
+        dst.scheduling = ThreadPolicy::SCHEDULING_FIFO;
+        if (dst.priority < 1 || 99 < dst.priority){
+            throw std::runtime_error((boost::format("fifo priority must be 1-99 [%s]") % scheduling).str());
+        }
+    }
+    else{
+        dst.scheduling = ThreadPolicy::SCHEDULING_NICE;
+        if (dst.priority < -20 || 19 < dst.priority){
+            throw std::runtime_error((boost::format("nice must be -20-19 [%s]") % scheduling).str());
+        }
+    }
+    return dst;
+}
+
+std::string describeThreadPolicy(ThreadPolicy const & policy)
+{
+    std::string dst = "cores " + (policy.cores.empty() ? std::string("any") : describeCores(policy.cores));
+    switch (policy.scheduling){
+    case ThreadPolicy::SCHEDULING_NICE:
+        return dst + (boost::format(", nice %d") % policy.priority).str();
+    case ThreadPolicy::SCHEDULING_FIFO:
+        return dst + (boost::format(", fifo %d") % policy.priority).str();
+    default:
+        return dst + ", normal";
+    }
+}
+
+std::vector<int> availableCores()
+{
+    std::vector<int> dst;
+#if defined _WIN32 || defined _WIN64
+    DWORD_PTR process = 0;
+    DWORD_PTR system = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process, &system)){
+        for (int c = 0; c < static_cast<int>(sizeof(DWORD_PTR) * 8); ++c){
+            if (process >> c & 1){
+                dst.push_back(c);
+            }
+        }
+    }
+#elif defined __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0){
+        for (int c = 0; c < CPU_SETSIZE; ++c){
+            if (CPU_ISSET(c, &set)){
+                dst.push_back(c);
+            }
+        }
+    }
+#endif // defined _WIN32 || defined _WIN64
+    if (dst.empty()){
+        for (int c = 0; c < static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); ++c){
+            dst.push_back(c);
+        }
+    }
+    return dst;
+}
+
+bool setThreadCores(std::vector<int> const & cores, std::string & error)
+{
+#if defined _WIN32 || defined _WIN64
+    DWORD_PTR mask = 0;
+    for (auto c : cores){
+        if (static_cast<int>(sizeof(DWORD_PTR) * 8) <= c){
+            error = (boost::format("core %d is out of the affinity mask") % c).str();
+            return false;
+        }
+        mask |= static_cast<DWORD_PTR>(1) << c;
+    }
+    if (!SetThreadAffinityMask(GetCurrentThread(), mask)){
+        error = (boost::format("SetThreadAffinityMask failed (%d)") % GetLastError()).str();
+        return false;
+    }
+    return true;
+#elif defined __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto c : cores){
+        if (CPU_SETSIZE <= c){
+            error = (boost::format("core %d is out of the affinity mask") % c).str();
+            return false;
+        }
+        CPU_SET(c, &set);
+    }
+    int const err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0){
+        error = errorMessage(err);
+        return false;
+    }
+    return true;
+#else
+    (void)cores;
+    error = "pinning threads to cores is not supported";
+    return false;
+#endif // defined _WIN32 || defined _WIN64
+}
+
+bool setThreadScheduling(ThreadPolicy::Scheduling scheduling, int priority, std::string & error)
+{
+#if defined _WIN32 || defined _WIN64
+    int level = THREAD_PRIORITY_TIME_CRITICAL;
+    if (scheduling == ThreadPolicy::SCHEDULING_DEFAULT){
+        level = THREAD_PRIORITY_NORMAL;
+    }
+    else if (scheduling == ThreadPolicy::SCHEDULING_NICE){
+        level = priority <= -10 ? THREAD_PRIORITY_HIGHEST
+            : priority < 0 ? THREAD_PRIORITY_ABOVE_NORMAL
+            : priority == 0 ? THREAD_PRIORITY_NORMAL
+            : priority < 10 ? THREAD_PRIORITY_BELOW_NORMAL
+            : THREAD_PRIORITY_LOWEST;
+    }
+    if (!SetThreadPriority(GetCurrentThread(), level)){
+        error = (boost::format("SetThreadPriority failed (%d)") % GetLastError()).str();
+        return false;
+    }
+    return true;
+#elif defined __linux__ || defined __APPLE__
+    if (scheduling == ThreadPolicy::SCHEDULING_FIFO){
+        sched_param param = {};
+        param.sched_priority = priority;
+        int const err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0){
+            error = errorMessage(err);
+            return false;
+        }
+        return true;
+    }
+    if (scheduling == ThreadPolicy::SCHEDULING_DEFAULT){
+        // SCHED_OTHERの優先度はLinuxでは0だけ、macOSは範囲の中央が既定値
+        sched_param param = {};
+        param.sched_priority = (sched_get_priority_min(SCHED_OTHER) + sched_get_priority_max(SCHED_OTHER)) / 2;
+        int const err = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+        if (err != 0){
+            error = errorMessage(err);
+            return false;
+        }
+#if defined __linux__
+        priority = process_nice;
+#else
+        return true;
+#endif // defined __linux__
+    }
+#if defined __linux__
+    // Linuxのnice値はスレッドごとに持つ
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), priority) != 0){
+        error = errorMessage(errno);
+        return false;
+    }
+    return true;
+#else
+    (void)priority;
+    error = "nice of a thread is not supported";
+    return false;
+#endif // defined __linux__
+#else
+    (void)priority;
+    error = "scheduling is not supported";
+    return false;
+#endif // defined _WIN32 || defined _WIN64
+}
+
+bool applyThreadPolicy(std::string const & name, ThreadPolicy const & policy)
+{
+    ThreadPolicy applied = policy;
+    if (applied.cores.empty()){
+        applied.cores = shared_cores;
+    }
+    // スレッドは作ったスレッドのスケジューリングを引き継ぐので、fifoのカメラ取得のスレッドが作った認識のスレッドは
+    // 指定しなくてもfifoになる。指定がなければ既定に戻す
+    bool const inherited = applied.scheduling == ThreadPolicy::SCHEDULING_DEFAULT && !defaultScheduling();
+    if (applied.empty() && !inherited){
+        return true;
+    }
+    bool ok = true;
+    std::string error;
+    if (!applied.cores.empty() && !setThreadCores(applied.cores, error)){
+        LOG_WARN("thread", "%s: failed to pin to cores %s: %s", name, describeCores(applied.cores), error);
+        ok = false;
+    }
+    if ((applied.scheduling != ThreadPolicy::SCHEDULING_DEFAULT || inherited) && !setThreadScheduling(applied.scheduling, applied.priority, error)){
+        LOG_WARN("thread", "%s: failed to %s: %s", name, inherited ? "reset the inherited scheduling" : "change scheduling", error);
+        ok = false;
+    }
+    if (ok){
+        LOG_INFO("thread", "%s: %s%s", name, describeThreadPolicy(applied), inherited ? " (reset the inherited scheduling)" : "");
+    }
+    return ok;
+}
+
+std::vector<int> reserveThreadCores(ThreadConfig const & config)
+{
+    std::set<int> reserved;
+    bool scheduled = false;
+    for (auto const * policy : { &config.capture, &config.identify, &config.trigger }){
+        reserved.insert(policy->cores.begin(), policy->cores.end());
+        scheduled = scheduled || policy->scheduling != ThreadPolicy::SCHEDULING_DEFAULT;
+    }
+    if (reserved.empty()){
+        if (scheduled){
+            // プールをカメラ取得のスレッドが作るとfifoなどを引き継ぐので、設定を変える前に作らせる
+            cv::parallel_for_(cv::Range(0, cv::getNumThreads() * 4), WarmUpBody());
+        }
+        return std::vector<int>();
+    }
+    auto const available = availableCores();
+    std::vector<int> shared;
+    for (auto c : available){
+        if (!reserved.count(c)){
+            shared.push_back(c);
+        }
+    }
+    for (auto c : reserved){
+        if (std::find(available.begin(), available.end(), c) == available.end()){
+            throw std::runtime_error((boost::format("core %d is not available (%s)") % c % describeCores(available)).str());
+        }
+    }
+    if (shared.empty()){
+        throw std::runtime_error((boost::format("no core is left for other threads (%s)") % describeCores(available)).str());
+    }
+    std::string error;
+    if (!setThreadCores(shared, error)){
+        throw std::runtime_error((boost::format("failed to pin to cores %s: %s") % describeCores(shared) % error).str());
+    }
+    shared_cores = shared;
+    // プールのスレッドは最初の並列処理で作られ、Linuxでは今のスレッドのコアを引き継ぐ
+    // Windowsは引き継がないので、スレッド数を減らすだけになる
+    cv::setNumThreads(static_cast<int>(shared.size()));
+    cv::parallel_for_(cv::Range(0, static_cast<int>(shared.size()) * 4), WarmUpBody());
+    return shared;
+}
+
+void lowerThreadPriority()
+{
+#if defined _WIN32 || defined _WIN64
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined __APPLE__
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#elif defined __linux__
+    std::string error;
+    setThreadScheduling(ThreadPolicy::SCHEDULING_NICE, 10, error);
+#endif // defined _WIN32 || defined _WIN64
+}
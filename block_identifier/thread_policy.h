@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*!
+スレッドを実行するコアとスケジューリング
+*/
+struct ThreadPolicy
+{
+    enum Scheduling
+    {
+        SCHEDULING_DEFAULT, ///< 既定(SCHED_OTHERで起動したときのnice値。WindowsはTHREAD_PRIORITY_NORMAL)
+        SCHEDULING_NICE, ///< nice値(Windowsはスレッドの優先度に読み替える)
+        SCHEDULING_FIFO, ///< リアルタイム(SCHED_FIFO。WindowsはTHREAD_PRIORITY_TIME_CRITICAL)
+    };
+    std::vector<int> cores; ///< 実行するコアの番号。空なら固定しない
+    Scheduling scheduling;
+    int priority; ///< SCHEDULING_NICEならnice値(-20から19)、SCHEDULING_FIFOなら優先度(1から99)
+
+    ThreadPolicy()
+        : scheduling(SCHEDULING_DEFAULT)
+        , priority(0)
+    {
+    }
+    /*!
+    @return コアもスケジューリングも変えなければtrue
+    */
+    bool empty() const { return cores.empty() && scheduling == SCHEDULING_DEFAULT; }
+};
+
+/*!
+パイプラインのスレッドごとの設定
+トリガーの待ち受けと送信は同じスレッドで非同期に行うので、triggerは送信にも効く
+*/
+struct ThreadConfig
+{
+    ThreadPolicy capture; ///< カメラから取得するスレッド。--workersが1なら認識も行う
+    ThreadPolicy identify; ///< --workersで並列に認識するスレッド
+    ThreadPolicy trigger; ///< トリガーの待ち受けと送信のスレッド
+};
+
+/*!
+コマンドラインの指定を解釈する
+@param[in] cores "2"、"2,3"、"4-7"のようなコアの番号。空なら固定しない
+@param[in] scheduling "fifo:50"、"nice:-5"。空なら変えない
+@return 設定
+@throw std::runtime_error 書式か範囲が正しくない
+*/
+ThreadPolicy parseThreadPolicy(std::string const & cores, std::string const & scheduling);
+
+/*!
+@param[in] policy 設定
+@return "cores 2-3, fifo 50"、"cores any, normal"のような表示
+*/
+std::string describeThreadPolicy(ThreadPolicy const & policy);
+
+/*!
+@return このプロセスが使えるコアの番号
+*/
+std::vector<int> availableCores();
+
+/*!
+呼び出したスレッドを実行するコアを固定する
+@param[in] cores コアの番号
+@param[out] error 失敗した理由
+@return 固定できたらtrue。macOSはコアを固定できないのでfalse
+*/
+bool setThreadCores(std::vector<int> const & cores, std::string & error);
+
+/*!
+呼び出したスレッドのスケジューリングを変える
+負のnice値とfifoは、Linuxでは権限(CAP_SYS_NICEかrtprio)が要る
+SCHEDULING_DEFAULTなら既定に戻す
+@param[in] scheduling スケジューリング
+@param[in] priority 優先度
+@param[out] error 失敗した理由
+@return 変えられたらtrue
+*/
+bool setThreadScheduling(ThreadPolicy::Scheduling scheduling, int priority, std::string & error);
+
+/*!
+呼び出したスレッドに設定を適用し、適用した設定をログに出す
+コアを固定しない設定でも、reserveThreadCoresで他のスレッドに残したコアで実行する
+スケジューリングを指定しない設定でも、作ったスレッドから引き継いだスケジューリングは既定に戻す
+権限がないなどで失敗しても例外は投げず、警告をログに出して続ける
+@param[in] name スレッドの名前(ログ用)
+@param[in] policy 設定
+@return すべて適用できたらtrue
+*/
+bool applyThreadPolicy(std::string const & name, ThreadPolicy const & policy);
+
+/*!
+パイプラインのスレッドに割り当てたコアを、プロセスの他のスレッドとOpenCVのスレッドプールから外す
+呼び出したスレッドを残りのコアに固定し、OpenCVのスレッドプールをそのスレッド数で作らせる
+コアを指定せずにスケジューリングだけを指定したときも、引き継がないようにスレッドプールを先に作らせる
+Linuxのスレッドは作ったスレッドのコアを引き継ぐので、他のスレッドを起動する前にメインスレッドから呼ぶこと
+Windowsのスレッドは引き継がないので、外せるのはapplyThreadPolicyを呼ぶパイプラインのスレッドだけで、
+ログやプレビュー、OpenCV(ConcRT)のスレッドプールは割り当てたコアでも動く。スレッドプールのスレッド数は減らす
+@param[in] config 設定
+@return 他のスレッドに残したコア。どのスレッドもコアを固定しなければ空
+@throw std::runtime_error 使えないコアを指定したか、他のスレッドに残るコアがない
+*/
+std::vector<int> reserveThreadCores(ThreadConfig const & config);
+
+/*!
+呼び出したスレッドの優先度を下げる
+認識とトリガーのスレッドにCPUを譲るため
+*/
+void lowerThreadPriority();
@@ -0,0 +1,75 @@
+#include "threshold.h"
+#include <cmath>
+
+double const AutoThreshold::MIN_RATIO = 0.005;
+double const AutoThreshold::SMOOTHING = 0.125;
+
+int otsuThreshold(Histogram const & histogram, double & low, double & high, double & ratio)
+{
+    double total = 0;
+    double sum = 0;
+    for (int i = 0; i < 256; ++i){
+        total += histogram[i];
+        sum += static_cast<double>(i) * histogram[i];
+    }
+    int dst = -1;
+    double best = -1;
+    double w0 = 0;
+    double sum0 = 0;
+    for (int t = 0; t < 255; ++t){
+        w0 += histogram[t];
+        sum0 += static_cast<double>(t) * histogram[t];
+        double const w1 = total - w0;
+        if (w0 == 0){
+            continue;
+        }
+        if (w1 == 0){
+            break;
+        }
+        double const m0 = sum0 / w0;
+        double const m1 = (sum - sum0) / w1;
+        double const between = w0 * w1 * (m1 - m0) * (m1 - m0);
+        if (best < between){
+            best = between;
+            dst = t;
+            low = m0;
+            high = m1;
+            ratio = w1 / total;
+        }
+    }
+    return dst;
+}
+
+AutoThreshold::AutoThreshold()
+    : started_(false)
+    , smoothed_(0)
+    , current_(0)
+{
+}
+
+int AutoThreshold::get(int initial)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return started_ ? current_ : initial;
+}
+
+bool AutoThreshold::update(int initial, Histogram const & histogram)
+{
+    double low = 0;
+    double high = 0;
+    double ratio = 0;
+    int const t = otsuThreshold(histogram, low, high, ratio);
+    if (t < 0 || high - low < MIN_CONTRAST || ratio < MIN_RATIO || 1 - MIN_RATIO < ratio){
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!started_){
+        started_ = true;
+        smoothed_ = current_ = initial;
+    }
+    smoothed_ += (t - smoothed_) * SMOOTHING;
+    if (HYSTERESIS < std::abs(smoothed_ - current_)){
+        current_ = static_cast<int>(std::lround(smoothed_));
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "segment.h"
+#include <mutex>
+
+/*!
+判別分析法(大津の方法)で2値化の閾値を求める
+@param[in] histogram ヒストグラム
+@param[out] low 閾値以下の画素の平均
+@param[out] high 閾値を超えた画素の平均
+@param[out] ratio 閾値を超えた画素の割合
+@return 閾値。この値を超えた画素を前景とする。画素がなければ-1
+*/
+int otsuThreshold(Histogram const & histogram, double & low, double & high, double & ratio);
+
+/*!
+2値化の閾値を、フレームごとのLとSの平均のヒストグラムから自動で決める
+カメラの自動露出で明るさが変わっても、bin_thを調整し直さなくてよい
+そのフレームの2値化には前のフレームまでで決めた閾値を使い、2値化と同時に数えたヒストグラムで次のフレームの閾値を更新する
+閾値はフレームをまたいで平滑化し、決めた閾値からHYSTERESISを超えて離れたときだけ変える
+ブロックがないなど、背景とブロックの明るさが分かれないフレームでは更新しない
+並列に認識するフレームから同時に呼んでよい
+*/
+class AutoThreshold
+{
+    AutoThreshold & operator=(AutoThreshold const &) = delete;
+    AutoThreshold(AutoThreshold const &) = delete;
+public:
+    static int const HYSTERESIS = 3; ///< 閾値を変えるまでの平滑化した閾値との差
+    static int const MIN_CONTRAST = 32; ///< 背景とブロックの平均の差がこれより小さいフレームでは更新しない
+    static double const MIN_RATIO; ///< ブロックの画素の割合がこれより小さいか、1からこれを引いたより大きいフレームでは更新しない
+    static double const SMOOTHING; ///< 平滑化の重み。1フレームでこの割合だけ新しい閾値に近づける
+private:
+    std::mutex mutex_;
+    bool started_; ///< mutex_で保護する
+    double smoothed_; ///< 平滑化した閾値。mutex_で保護する
+    int current_; ///< 2値化に使う閾値。mutex_で保護する
+public:
+    AutoThreshold();
+    /*!
+    @param[in] initial まだ閾値を決めていないときに返す値(オプションのbin_th)
+    @return 2値化に使う閾値
+    */
+    int get(int initial);
+    /*!
+    1フレームのヒストグラムで閾値を更新する
+    @param[in] initial まだ閾値を決めていないときの値(オプションのbin_th)
+    @param[in] histogram 2値化と同時に数えたヒストグラム
+    @return 更新したらtrue
+    */
+    bool update(int initial, Histogram const & histogram);
+};
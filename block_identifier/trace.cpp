@@ -0,0 +1,149 @@
+#include "trace.h"
+#include "thread_local_ptr.h"
+#include <boost/format.hpp>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::enabled_(false);
+
+namespace {
+    /*!
+    区間
+    */
+    struct Event
+    {
+        char const * name; ///< 区間名
+        int64_t begin; ///< 開始時刻(ナノ秒)
+        int64_t end; ///< 終了時刻(ナノ秒)
+    };
+
+    /*!
+    スレッドごとのリングバッファ
+    書き込むのは所有スレッドだけで、古いイベントから上書きする
+    */
+    struct Ring
+    {
+        static size_t const SIZE = 1 << 16;
+        std::vector<Event> events;
+        std::atomic<size_t> head;
+        int tid;
+        std::string name;
+        Ring(int tid) : events(SIZE), head(0), tid(tid) {}
+    };
+
+    std::mutex g_mutex; ///< g_ringsを保護する
+    std::vector<std::shared_ptr<Ring>> g_rings; ///< スレッド終了後も書き出せるように保持する
+
+    /*!
+    現在のスレッドのリングバッファを返す。最初の呼び出しで登録する
+    */
+    Ring & ring()
+    {
+        THREAD_LOCAL_PTR(Ring, r);
+        if (!r){
+            std::unique_lock<std::mutex> lock(g_mutex);
+            g_rings.push_back(std::make_shared<Ring>(static_cast<int>(g_rings.size() + 1)));
+            r = g_rings.back().get();
+        }
+        return *r;
+    }
+
+    int64_t toNano(Trace::clock_type::time_point t)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+
+    std::string g_path; ///< シグナルで書き出すときのパス
+    volatile std::sig_atomic_t g_dump = 0;
+    volatile std::sig_atomic_t g_toggle = 0;
+    volatile std::sig_atomic_t g_exit = 0;
+
+    extern "C" void onSignal(int sig)
+    {
+#ifdef SIGUSR1
+        if (sig == SIGUSR1){
+            g_dump = 1;
+            return;
+        }
+        if (sig == SIGUSR2){
+            g_toggle = 1;
+            return;
+        }
+#endif // SIGUSR1
+        // pollを呼ばないループ(カメラを開き直す間など)でも、2回目で終了できるようにする
+        g_exit = 1;
+        std::signal(sig, SIG_DFL);
+    }
+}
+
+void Trace::record(char const * name, clock_type::time_point begin, clock_type::time_point end)
+{
+    auto & r = ring();
+    auto const head = r.head.load(std::memory_order_relaxed);
+    r.events[head % Ring::SIZE] = Event{ name, toNano(begin), toNano(end) };
+    r.head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::setThreadName(std::string const & name)
+{
+    auto & r = ring();
+    std::unique_lock<std::mutex> lock(g_mutex);
+    r.name = name;
+}
+
+void Trace::dump(std::string const & path)
+{
+    std::ofstream ofs(path);
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto sep = [&]() -> std::ostream & {
+        ofs << (first ? "" : ",\n");
+        first = false;
+        return ofs;
+    };
+    size_t count = 0;
+    std::unique_lock<std::mutex> lock(g_mutex);
+    for (auto const & r : g_rings){
+        sep() << boost::format("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}")
+            % r->tid % (r->name.empty() ? (boost::format("thread %d") % r->tid).str() : r->name);
+        // 書き出し中に上書きされたイベントは壊れている可能性があるが、診断用なので許容する
+        auto const head = r->head.load(std::memory_order_acquire);
+        for (size_t i = head < Ring::SIZE ? 0 : head - Ring::SIZE; i < head; ++i){
+            auto const & e = r->events[i % Ring::SIZE];
+            sep() << boost::format("{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}")
+                % e.name % r->tid % (e.begin / 1000.0) % ((e.end - e.begin) / 1000.0);
+            ++count;
+        }
+    }
+    ofs << "\n]}\n";
+    std::cout << boost::format("wrote %d trace events to %s") % count % path << std::endl;
+}
+
+void Trace::installSignalHandler(std::string const & path)
+{
+    g_path = path;
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, onSignal);
+    std::signal(SIGUSR2, onSignal);
+#endif // SIGUSR1
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+}
+
+bool Trace::poll()
+{
+    if (g_toggle){
+        g_toggle = 0;
+        enable(!enabled());
+        std::cout << (enabled() ? "trace enabled." : "trace disabled.") << std::endl;
+    }
+    if (g_dump || g_exit){
+        g_dump = 0;
+        dump(g_path);
+    }
+    return g_exit != 0;
+}
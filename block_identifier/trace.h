@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/*!
+処理時間のトレース
+スレッドごとのリングバッファに記録し、chrome://tracing(Perfetto)のJSON形式で書き出す
+*/
+class Trace
+{
+    static std::atomic<bool> enabled_;
+public:
+    typedef std::chrono::steady_clock clock_type;
+
+    /*!
+    トレースの記録を開始・停止する
+    */
+    static void enable(bool on) { enabled_.store(on, std::memory_order_relaxed); }
+    /*!
+    @retval true 記録中
+    */
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    /*!
+    区間を記録する
+    @param[in] name 区間名。文字列リテラルなどプログラム終了まで有効な文字列
+    @param[in] begin 開始時刻
+    @param[in] end 終了時刻
+    */
+    static void record(char const * name, clock_type::time_point begin, clock_type::time_point end);
+    /*!
+    現在のスレッドに名前をつける
+    */
+    static void setThreadName(std::string const & name);
+    /*!
+    記録したトレースを書き出す
+    @param[in] path 書き出し先
+    */
+    static void dump(std::string const & path);
+    /*!
+    シグナルでトレースを操作できるようにする
+    SIGUSR1で書き出し、SIGUSR2で記録の開始・停止、SIGINT・SIGTERMで書き出してから終了
+    SIGINT・SIGTERMは次のpollで処理する。2回目は書き出さずにすぐ終了する
+    @param[in] path 書き出し先
+    */
+    static void installSignalHandler(std::string const & path);
+    /*!
+    シグナルで要求された操作を行う。ループの区切りで呼ぶ
+    @retval true 終了が要求された
+    */
+    static bool poll();
+};
+
+/*!
+スコープの開始から終了までを記録する
+*/
+class TraceScope
+{
+    TraceScope & operator=(TraceScope const &) = delete;
+    TraceScope(TraceScope const &) = delete;
+    char const * name_;
+    Trace::clock_type::time_point begin_;
+public:
+    explicit TraceScope(char const * name)
+        : name_(Trace::enabled() ? name : nullptr)
+    {
+        if (name_){
+            begin_ = Trace::clock_type::now();
+        }
+    }
+    ~TraceScope()
+    {
+        if (name_){
+            Trace::record(name_, begin_, Trace::clock_type::now());
+        }
+    }
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+/*!
+スコープの終わりまでを区間として記録する
+*/
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
@@ -1,69 +1,307 @@
 #include "trigger.h"
-#if defined _WIN32 || defined _WIN64
 #include "serial.h"
-#endif // defined _WIN32 || defined _WIN64
+#include "http_server.h"
+#include "log.h"
+#include <algorithm>
 #include <iostream>
+#include <thread>
+#include <boost/asio.hpp>
 #include <boost/format.hpp>
 
 #if defined _WIN32 || defined _WIN64
 #pragma comment(lib,"Winmm.lib")
 #include <Windows.h>
 #include <mmsystem.h>
-class ArduinoButton : public Trigger
-{
-    Serial m;
-public:
-    ArduinoButton(int com)
+#else
+#include <unistd.h>
+#endif // defined _WIN32 || defined _WIN64
+
+namespace {
+    /*!
+    ブロッキングする関数を別スレッドで繰り返し呼び、トリガーをio_serviceへ通知する
+    非同期I/Oで待てない入力のため
+    */
+    class ThreadTrigger : public Trigger
     {
-        PortInfo info;
-        info.port = com;
-        info.baudrate = 9600;
-        info.bytesize = 8;
-        info.parity = 0;
-        info.stopbits = 1;
-        std::cout << boost::format("Opening COM Port%d ...") % com << std::endl;
-        m.open(info);
+        boost::asio::io_service & io_;
+        Fire fire_;
+        char const * source_;
+        std::function<int()> read_;
+    public:
+        /*!
+        @param[in] read トリガーが発生するまでブロックし、発生したトリガー数を返す関数。負数で終了
+        */
+        ThreadTrigger(boost::asio::io_service & io, Fire fire, char const * source, std::function<int()> read)
+            : io_(io), fire_(fire), source_(source), read_(read)
+        {
+        }
+        void start()
+        {
+            auto & io = io_;
+            auto fire = fire_;
+            auto source = source_;
+            auto read = read_;
+            // 標準入力の読み込みは中断できないので、スレッドは終了を待たない
+            std::thread([&io, fire, source, read]{
+                for (;;){
+                    int n = read();
+                    if (n < 0){
+                        break;
+                    }
+                    for (int i = 0; i < n; ++i){
+                        io.post([fire, source]{ fire(source); });
+                    }
+                }
+            }).detach();
+        }
+    };
+
+    /*!
+    受信データに含まれるボタンイベント数を返す
+    0D0Aも一緒に受信するときと、別々に受信するときがあるので改行は読み捨てる
+    */
+    int countButtonEvents(unsigned char const * data, size_t size)
+    {
+        int n = 0;
+        for (size_t i = 0; i < size; ++i){
+            if (data[i] != 0x0A && data[i] != 0x0D){
+                ++n;
+            }
+        }
+        return n;
     }
-    void wait()
+
+    /*!
+    ボタンを押したときの効果音を鳴らす
+    */
+    void playChime()
     {
-        std::cout << "\n" "PUSH BUTTON !" << std::endl;
-        std::vector<unsigned char> tmp;
-        while (tmp.size() != 1){
-            m.receive(tmp); // 0D0Aも一緒に受信するときと、別々に受信するときがある
-            for (;;){
-                if (tmp.empty() || (tmp.back() != 0x0A && tmp.back() != 0x0D)){
-                    break;
+#if defined _WIN32 || defined _WIN64
+        if (!PlaySound(L"se_maoudamashii_chime13.wav", 0, SND_FILENAME | SND_ASYNC | SND_NODEFAULT)){
+            LOG_WARN("trigger", "PlaySound returns false.");
+        }
+#endif // defined _WIN32 || defined _WIN64
+    }
+
+#if !(defined _WIN32 || defined _WIN64)
+    /*!
+    ファイルディスクリプタを非同期に読み、行または文字をトリガーとする
+    */
+    class DescriptorTrigger : public Trigger, public std::enable_shared_from_this<DescriptorTrigger>
+    {
+        boost::asio::posix::stream_descriptor desc_;
+        Fire fire_;
+        char const * source_;
+        std::function<int(unsigned char const *, size_t)> count_;
+        std::vector<unsigned char> buffer_;
+
+        void read()
+        {
+            auto self = shared_from_this();
+            desc_.async_read_some(boost::asio::buffer(buffer_), [self](boost::system::error_code const & ec, size_t size){
+                if (ec){
+                    LOG_ERROR("trigger", "%s: %s", self->source_, ec.message());
+                    return;
                 }
-                tmp.pop_back();
+                int n = self->count_(self->buffer_.data(), size);
+                for (int i = 0; i < n; ++i){
+                    self->fire_(self->source_);
+                }
+                self->read();
+            });
+        }
+    public:
+        /*!
+        @param[in] fd 読み込むファイルディスクリプタ。複製して使う
+        @param[in] count 受信データに含まれるトリガー数を返す関数
+        */
+        DescriptorTrigger(boost::asio::io_service & io, Fire fire, char const * source, int fd, std::function<int(unsigned char const *, size_t)> count)
+            : desc_(io), fire_(fire), source_(source), count_(count), buffer_(256)
+        {
+            int dup_fd = ::dup(fd);
+            if (dup_fd < 0){
+                throw std::runtime_error("Function failed. [dup]");
+            }
+            try{
+                desc_.assign(dup_fd);
+            }
+            catch (...){
+                ::close(dup_fd);
+                throw;
             }
         }
-        if (!PlaySound(L"se_maoudamashii_chime13.wav", 0, SND_FILENAME | SND_SYNC | SND_NODEFAULT)){
-            std::cerr << "PlaySound returns false." << std::endl;
+        void start()
+        {
+            read();
         }
-    }
-};
-#endif // defined _WIN32 || defined _WIN64
+    };
+#endif // !(defined _WIN32 || defined _WIN64)
 
-class StdinTrigger : public Trigger
-{
-public:
-    StdinTrigger()
+    /*!
+    標準入力の改行をトリガーとする
+    */
+    std::shared_ptr<Trigger> createConsoleTrigger(boost::asio::io_service & io, Trigger::Fire fire)
     {
+        std::cout << "Input any key and Enter..." << std::endl;
+#if !(defined _WIN32 || defined _WIN64)
+        try{
+            return std::make_shared<DescriptorTrigger>(io, fire, "stdin", STDIN_FILENO, [](unsigned char const * data, size_t size){
+                return static_cast<int>(std::count(data, data + size, '\n'));
+            });
+        }
+        catch (std::exception const &){
+            // 通常ファイルはepollで待てないのでスレッドで読む
+        }
+#endif // !(defined _WIN32 || defined _WIN64)
+        return std::make_shared<ThreadTrigger>(io, fire, "stdin", []{
+            std::string tmp;
+            return std::getline(std::cin, tmp) ? 1 : -1;
+        });
     }
-    void wait()
+
+    /*!
+    Arduinoボタンをトリガーとする
+    */
+    std::shared_ptr<Trigger> createArduinoButton(boost::asio::io_service & io, Trigger::Fire fire, PortInfo const & info)
     {
-        std::cout << "Input any key and Enter..." << std::endl;
-        std::string tmp;
-        std::cin >> tmp;
+        if (info.path.empty()){
+            std::cout << boost::format("Opening COM Port%d ...") % info.port << std::endl;
+        }
+        else{
+            std::cout << boost::format("Opening %s ...") % info.path << std::endl;
+        }
+        auto serial = std::make_shared<Serial>();
+        serial->open(info);
+        std::cout << "\n" "PUSH BUTTON !" << std::endl;
+        auto chime = [fire](char const * source){
+            playChime();
+            fire(source);
+        };
+#if defined _WIN32 || defined _WIN64
+        return std::make_shared<ThreadTrigger>(io, chime, "button", [serial]{
+            std::vector<unsigned char> tmp;
+            while (!serial->wait(1000) || !serial->receive(tmp)){
+                if (!serial->connected()){
+                    return -1;
+                }
+            }
+            return countButtonEvents(tmp.data(), tmp.size());
+        });
+#else
+        return std::make_shared<DescriptorTrigger>(io, chime, "button", serial->native_handle(), countButtonEvents);
+#endif // defined _WIN32 || defined _WIN64
     }
-};
 
-std::shared_ptr<Trigger> Trigger::create(int com)
+    /*!
+    HTTPのPOST /triggerをトリガーとする
+    ローカルホストからの要求だけを受け付ける
+    */
+    class HttpTrigger : public Trigger
+    {
+        std::shared_ptr<HttpServer> server_;
+    public:
+        HttpTrigger(boost::asio::io_service & io, Fire fire, int port)
+            : server_(std::make_shared<HttpServer>(io, port))
+        {
+            server_->route("/trigger", [fire](std::string const & method){
+                if (method != "POST"){
+                    return HttpResponse{ 405, "text/plain", "" };
+                }
+                fire("http");
+                return HttpResponse{ 200, "text/plain", "" };
+            });
+            std::cout << boost::format("POST http://127.0.0.1:%d/trigger to trigger.") % port << std::endl;
+        }
+        void start()
+        {
+            server_->start();
+        }
+    };
+
+    /*!
+    一定周期でトリガーを発生させる
+    */
+    class TimerTrigger : public Trigger, public std::enable_shared_from_this<TimerTrigger>
+    {
+        boost::asio::steady_timer timer_;
+        Fire fire_;
+        std::chrono::milliseconds interval_;
+
+        void wait()
+        {
+            auto self = shared_from_this();
+            timer_.expires_at(timer_.expires_at() + interval_);
+            timer_.async_wait([self](boost::system::error_code const & ec){
+                if (ec){
+                    return;
+                }
+                self->fire_("timer");
+                self->wait();
+            });
+        }
+    public:
+        TimerTrigger(boost::asio::io_service & io, Fire fire, int interval_ms)
+            : timer_(io), fire_(fire), interval_(interval_ms)
+        {
+        }
+        void start()
+        {
+            timer_.expires_at(std::chrono::steady_clock::now());
+            wait();
+        }
+    };
+}
+
+TriggerLoop::TriggerLoop(boost::asio::io_service & io, TriggerConfig const & config, std::function<void()> handler)
+    : io_(io)
+    , handler_(handler)
+    , debounce_(std::chrono::milliseconds(config.debounce_ms))
+    , fired_(false)
 {
+    auto fire = [this](char const * source){ this->fire(source); };
+    PortInfo info;
+    info.port = config.com;
+    info.path = config.tty;
+    info.baudrate = 9600;
+    info.bytesize = 8;
+    info.parity = 0;
+    info.stopbits = 1;
 #if defined _WIN32 || defined _WIN64
-    if (0 < com){
-        return std::make_shared<ArduinoButton>(com);
-    }
+    bool const button = 0 < config.com;
+    info.path.clear();
+#else
+    bool const button = !config.tty.empty();
 #endif // defined _WIN32 || defined _WIN64
-    return std::make_shared<StdinTrigger>();
+    if (button){
+        triggers_.push_back(createArduinoButton(io, fire, info));
+    }
+    else{
+        triggers_.push_back(createConsoleTrigger(io, fire));
+    }
+    if (0 < config.http_port){
+        triggers_.push_back(std::make_shared<HttpTrigger>(io, fire, config.http_port));
+    }
+    if (0 < config.interval_ms){
+        triggers_.push_back(std::make_shared<TimerTrigger>(io, fire, config.interval_ms));
+    }
+}
+
+void TriggerLoop::start()
+{
+    for (auto trigger : triggers_){
+        trigger->start();
+    }
+}
+
+void TriggerLoop::fire(char const * source)
+{
+    auto const now = clock_type::now();
+    if (fired_ && now - last_ < debounce_){
+        LOG_INFO("trigger", "ignored trigger from %s.", source);
+        return;
+    }
+    fired_ = true;
+    last_ = now;
+    LOG_INFO("trigger", "triggered by %s.", source);
+    handler_();
 }
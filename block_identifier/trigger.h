@@ -1,16 +1,69 @@
 #pragma once
 
+#include <boost/asio/io_service.hpp>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
+/*!
+トリガーの設定
+*/
+struct TriggerConfig
+{
+    int com; ///< COMポート(windows)
+    std::string tty; ///< シリアルデバイスのパス(windows以外)
+    int http_port; ///< POST /triggerを受け付けるポート番号(0なら無効)
+    int interval_ms; ///< 周期トリガーの間隔(0なら無効)
+    int debounce_ms; ///< 直前のトリガーからこの時間以内のトリガーは無視する
+};
+
+/*!
+トリガー発生源
+*/
 class Trigger
 {
+public:
+    typedef std::function<void(char const * source)> Fire;
+    virtual ~Trigger() {}
+    /*!
+    トリガーの待ち受けを開始する
+    */
+    virtual void start() = 0;
+};
+
+/*!
+複数のトリガー発生源を1つのio_serviceで待ち受けるクラス
+ハンドラはio_serviceのスレッドで呼ばれる
+*/
+class TriggerLoop
+{
+    TriggerLoop & operator=(TriggerLoop const &) = delete;
+    TriggerLoop(TriggerLoop const &) = delete;
+    typedef std::chrono::steady_clock clock_type;
+    boost::asio::io_service & io_;
+    std::function<void()> handler_;
+    clock_type::duration debounce_;
+    clock_type::time_point last_;
+    bool fired_;
+    std::vector<std::shared_ptr<Trigger>> triggers_;
+    /*!
+    トリガーを受け付ける。連続したトリガーは無視する
+    @param[in] source 発生源の名前
+    */
+    void fire(char const * source);
 public:
     /*!
-    トリガーを取得する
+    設定に従ってトリガー発生源を作成する
+    ボタンがないときは標準入力がトリガーとなる
+    @param[in] io トリガーを待ち受けるio_service
+    @param[in] config トリガーの設定
+    @param[in] handler トリガー発生時に呼ばれる関数
     */
-    static std::shared_ptr<Trigger> create(int com);
+    TriggerLoop(boost::asio::io_service & io, TriggerConfig const & config, std::function<void()> handler);
     /*!
-    トリガーが発生するまで待つ
+    トリガーの待ち受けを開始する
     */
-    virtual void wait() = 0;
+    void start();
 };
@@ -0,0 +1,357 @@
+#include "tune.h"
+#include "regress.h"
+#include "identify.h"
+#include <boost/format.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <type_traits>
+
+namespace {
+    typedef std::chrono::steady_clock clock_type;
+
+    /*!
+    探索する値
+    */
+    struct Axis
+    {
+        std::vector<int> values;
+        int center; ///< オプションの値の位置
+    };
+
+    /*!
+    オプションの値の前後に探索する値を並べる
+    @param[in] center オプションの値
+    @param[in] offsets オプションの値との差。0を含む昇順
+    @param[in] hi 値の上限
+    */
+    Axis around(int center, std::vector<int> const & offsets, int hi)
+    {
+        Axis dst = { {}, 0 };
+        for (auto d : offsets){
+            int const v = std::min(hi, std::max(0, center + d));
+            if (dst.values.empty() || dst.values.back() != v){
+                dst.values.push_back(v);
+            }
+            if (v == center){
+                dst.center = static_cast<int>(dst.values.size()) - 1;
+            }
+        }
+        return dst;
+    }
+
+    /*!
+    ブロックの大きさはサンプル画像ごとに撮影した距離で違うので、倍率で探す
+    */
+    double const SCALES[] = { 0.9, 0.95, 1, 1.05, 1.1 };
+    int const SCALE_CENTER = 2;
+
+    /*!
+    Tuningの候補
+    */
+    struct Candidate
+    {
+        int bin_th;
+        int stud_th;
+        int size_th;
+        double height_scale;
+        double width_scale;
+        int distance; ///< オプションの値から離れた段数の合計。評価が同じなら小さい方を選ぶ
+        std::vector<double> accuracy; ///< 画像ごとの正解率。評価していなければ負
+        double mean; ///< 評価した画像の正解率の平均
+        double min; ///< 評価した画像の正解率の最小
+        double ms; ///< 認識の平均処理時間。計っていなければ負
+
+        /*!
+        @param[in] tune 元のTuning
+        @return 候補の値にしたTuning
+        */
+        Tuning apply(Tuning tune) const
+        {
+            tune.bin_th = bin_th;
+            tune.stud_th = stud_th;
+            tune.size_th = size_th;
+            tune.block_height = std::max(1, static_cast<int>(std::lround(tune.block_height * height_scale)));
+            tune.block_width = std::max(1, static_cast<int>(std::lround(tune.block_width * width_scale)));
+            return tune;
+        }
+        /*!
+        評価した画像の正解率を集計する
+        */
+        void summarize()
+        {
+            double sum = 0;
+            int n = 0;
+            min = 1;
+            for (auto a : accuracy){
+                if (0 <= a){
+                    sum += a;
+                    min = std::min(min, a);
+                    ++n;
+                }
+            }
+            mean = n ? sum / n : 0;
+        }
+    };
+
+    bool better(Candidate const & a, Candidate const & b)
+    {
+        if (a.mean != b.mean){
+            return b.mean < a.mean;
+        }
+        if (a.min != b.min){
+            return b.min < a.min;
+        }
+        return a.distance < b.distance;
+    }
+
+    /*!
+    サンプル画像1枚と、候補の間で使い回す中間結果
+    */
+    struct Frame
+    {
+        TruthSample const * sample;
+        Option opt; ///< サンプル画像を撮影した距離でのオプション
+        cv::Mat image; ///< preprocessImageの後の画像
+        std::map<int, cv::Mat> masks; ///< bin_thごとのブロックの領域
+    };
+
+    /*!
+    n個の処理を全コアで分けて行う
+    @param[in] n 処理の数
+    @param[in] threads スレッド数
+    @param[in] f スレッド番号と処理番号を受け取る関数
+    */
+    void parallel(size_t n, unsigned threads, std::function<void(unsigned, size_t)> const & f)
+    {
+        std::atomic<size_t> next(0);
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t){
+            workers.emplace_back([&, t]{
+                try{
+                    for (size_t i; (i = next++) < n;){
+                        f(t, i);
+                    }
+                }
+                catch (...){
+                    std::unique_lock<std::mutex> lock(mutex);
+                    error = std::current_exception();
+                    next = n;
+                }
+            });
+        }
+        for (auto & w : workers){
+            w.join();
+        }
+        if (error){
+            std::rethrow_exception(error);
+        }
+    }
+
+    /*!
+    中間結果を使わずにidentifyBlockで認識し、正解率と処理時間を計る
+    @param[in] frames サンプル画像
+    @param[in] candidate 候補。nullptrならオプションのまま
+    @param[in] iterations 画像1枚あたりの認識回数
+    @param[out] c 正解率と処理時間の書き込み先
+    */
+    void measure(std::vector<Frame> const & frames, Candidate const * candidate, int iterations, Candidate & c)
+    {
+        std::vector<BlockInfo> blockInfo;
+        clock_type::duration total(0);
+        c.accuracy.clear();
+        for (auto const & frame : frames){
+            Option o = frame.opt;
+            if (candidate){
+                o.tune = candidate->apply(frame.opt.tune);
+            }
+            auto const begin = clock_type::now();
+            for (int i = 0; i < iterations; ++i){
+                identifyBlock(frame.image, o, blockInfo, FrameStamp(), false);
+            }
+            total += clock_type::now() - begin;
+            c.accuracy.push_back(blockAccuracy(frame.sample->blocks, blockNames(blockInfo)));
+        }
+        c.summarize();
+        c.ms = std::chrono::duration<double, std::milli>(total).count() / (frames.size() * iterations);
+    }
+}
+
+int runTune(std::string const & path, Option const & opt, TuneConfig const & config)
+{
+    if (config.method != "grid" && config.method != "halving"){
+        throw std::runtime_error((boost::format("unknown tune method [%s]") % config.method).str());
+    }
+    if (config.top <= 0 || config.iterations <= 0){
+        throw std::runtime_error("tune top and iterations should be positive.");
+    }
+    auto const truth = readGroundTruth(path);
+    unsigned const threads = std::max(1u, std::thread::hardware_concurrency());
+    auto const begin = clock_type::now();
+
+    // 画像の順を混ぜて、halvingの最初の数枚が似た画像に偏らないようにする
+    std::vector<Frame> frames;
+    for (auto const & sample : truth.samples){
+        Frame frame;
+        frame.sample = &sample;
+        frame.opt = sampleOption(opt, sample);
+        frame.image = cv::imread(truth.dir + sample.file);
+        if (frame.image.empty()){
+            throw std::runtime_error((boost::format("failed to read %s.") % (truth.dir + sample.file)).str());
+        }
+        preprocessImage(frame.opt, frame.image);
+        frames.push_back(std::move(frame));
+    }
+    if (frames.empty()){
+        throw std::runtime_error("no sample image.");
+    }
+    std::shuffle(frames.begin(), frames.end(), std::mt19937(1));
+
+    // 探索する候補
+    auto const & tune = opt.tune;
+    auto const bin = around(tune.bin_th, { -40, -20, -10, 0, 10, 20, 40 }, 255);
+    auto const stud = around(tune.stud_th, { -tune.stud_th / 2, -tune.stud_th / 4, 0, tune.stud_th / 4, tune.stud_th / 2 }, 255);
+    auto const size = around(tune.size_th, { -60, -30, -15, 0, 10 }, 255);
+    std::vector<Candidate> candidates;
+    for (size_t b = 0; b < bin.values.size(); ++b){
+        for (size_t s = 0; s < stud.values.size(); ++s){
+            for (size_t z = 0; z < size.values.size(); ++z){
+                for (int h = 0; h < static_cast<int>(std::extent<decltype(SCALES)>::value); ++h){
+                    for (int w = 0; w < static_cast<int>(std::extent<decltype(SCALES)>::value); ++w){
+                        Candidate c;
+                        c.bin_th = bin.values[b];
+                        c.stud_th = stud.values[s];
+                        c.size_th = size.values[z];
+                        c.height_scale = SCALES[h];
+                        c.width_scale = SCALES[w];
+                        c.distance = std::abs(static_cast<int>(b) - bin.center) + std::abs(static_cast<int>(s) - stud.center)
+                            + std::abs(static_cast<int>(z) - size.center) + std::abs(h - SCALE_CENTER) + std::abs(w - SCALE_CENTER);
+                        c.accuracy.assign(frames.size(), -1);
+                        c.ms = -1;
+                        candidates.push_back(c);
+                    }
+                }
+            }
+        }
+    }
+    std::cout << boost::format("tuning %d candidates on %d images with %d threads (%s).") % candidates.size() % frames.size() % threads % config.method << std::endl;
+
+    // 2値化の閾値までの結果を画像と閾値ごとに1回だけ求める
+    {
+        auto const t0 = clock_type::now();
+        std::vector<IdentifyCache> caches(frames.size());
+        parallel(frames.size(), threads, [&](unsigned, size_t i){
+            prepareIdentify(frames[i].image, frames[i].opt, caches[i]);
+        });
+        for (auto & frame : frames){
+            for (auto v : bin.values){
+                frame.masks[v];
+            }
+        }
+        size_t const n = frames.size() * bin.values.size();
+        parallel(n, threads, [&](unsigned, size_t i){
+            auto & frame = frames[i / bin.values.size()];
+            Option o = frame.opt;
+            o.tune.bin_th = bin.values[i % bin.values.size()];
+            frame.masks.at(o.tune.bin_th) = maskBlocks(frame.image, o, caches[i / bin.values.size()]);
+        });
+        std::cout << boost::format("shared %d block masks in %.2fs.") % n % std::chrono::duration<double>(clock_type::now() - t0).count() << std::endl;
+    }
+
+    // 後段だけを候補ごとに評価する。オプションはスレッドごとに複製して書き換える
+    std::vector<std::vector<Option>> options(threads);
+    for (auto & o : options){
+        for (auto const & frame : frames){
+            o.push_back(frame.opt);
+        }
+    }
+    size_t evaluated = 0;
+    auto evaluate = [&](std::vector<Candidate *> const & targets, size_t images){
+        size_t const n = targets.size() * images;
+        parallel(n, threads, [&](unsigned t, size_t i){
+            auto & c = *targets[i / images];
+            size_t const f = i % images;
+            if (0 <= c.accuracy[f]){
+                return;
+            }
+            auto const & frame = frames[f];
+            auto & o = options[t][f];
+            o.tune = c.apply(frame.opt.tune);
+            std::vector<BlockInfo> blockInfo;
+            splitBlocks(frame.image, frame.masks.at(c.bin_th), o, blockInfo);
+            c.accuracy[f] = blockAccuracy(frame.sample->blocks, blockNames(blockInfo));
+        });
+        for (auto c : targets){
+            c->summarize();
+        }
+        evaluated += n;
+    };
+    std::vector<Candidate *> survivors;
+    for (auto & c : candidates){
+        survivors.push_back(&c);
+    }
+    auto const t0 = clock_type::now();
+    if (config.method == "grid"){
+        evaluate(survivors, frames.size());
+    }
+    else{
+        // 1枚から始め、評価する画像を倍にしながら上位半分に絞る。書き出す数の数倍は最後まで残す
+        size_t const keep = static_cast<size_t>(config.top) * 4;
+        for (size_t images = 1;; images = std::min(frames.size(), images * 2)){
+            evaluate(survivors, images);
+            std::stable_sort(survivors.begin(), survivors.end(), [](Candidate const * a, Candidate const * b){ return better(*a, *b); });
+            if (images == frames.size()){
+                break;
+            }
+            survivors.resize(std::max(std::min(keep, survivors.size()), (survivors.size() + 1) / 2));
+        }
+    }
+    double const sec = std::chrono::duration<double>(clock_type::now() - t0).count();
+    std::cout << boost::format("evaluated %d candidate-images in %.2fs (%.0f/s).") % evaluated % sec % (evaluated / std::max(sec, 1e-9)) << std::endl;
+
+    // 正解率の上位の処理時間を計り、正解率と処理時間の順に並べる
+    std::stable_sort(survivors.begin(), survivors.end(), [](Candidate const * a, Candidate const * b){ return better(*a, *b); });
+    survivors.resize(std::min(survivors.size(), static_cast<size_t>(config.top) * 2));
+    for (auto c : survivors){
+        measure(frames, c, config.iterations, *c);
+    }
+    std::stable_sort(survivors.begin(), survivors.end(), [](Candidate const * a, Candidate const * b){
+        if (a->mean != b->mean){
+            return b->mean < a->mean;
+        }
+        if (a->min != b->min){
+            return b->min < a->min;
+        }
+        return a->ms < b->ms;
+    });
+    survivors.resize(std::min(survivors.size(), static_cast<size_t>(config.top)));
+
+    std::cout << boost::format("%-9s %8s %6s %9s %4s %4s %4s %6s %5s  %s") % "rank" % "accuracy" % "min" % "mean(ms)" % "bin" % "stud" % "size" % "height" % "width" % "file" << std::endl;
+    {
+        Candidate current;
+        measure(frames, nullptr, config.iterations, current);
+        std::cout << boost::format("%-9s %8.3f %6.3f %9.2f %4d %4d %4d %6d %5d  %s") % "current" % current.mean % current.min % current.ms
+            % tune.bin_th % tune.stud_th % tune.size_th % tune.block_height % tune.block_width % "" << std::endl;
+    }
+    for (size_t i = 0; i < survivors.size(); ++i){
+        auto const & c = *survivors[i];
+        Option o = opt;
+        o.tune = c.apply(opt.tune);
+        validateOption(o);
+        auto const file = (boost::format("%s_%d.xml") % config.output % (i + 1)).str();
+        writeOption(file, o);
+        std::cout << boost::format("%-9d %8.3f %6.3f %9.2f %4d %4d %4d %6d %5d  %s") % (i + 1) % c.mean % c.min % c.ms
+            % o.tune.bin_th % o.tune.stud_th % o.tune.size_th % o.tune.block_height % o.tune.block_width % file << std::endl;
+    }
+    std::cout << boost::format("tuned in %.1fs.") % std::chrono::duration<double>(clock_type::now() - begin).count() << std::endl;
+    return 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "option.h"
+
+/*!
+Tuningの探索の設定
+*/
+struct TuneConfig
+{
+    std::string method = "halving"; ///< grid: 全候補を全画像で評価する。halving: 少ない画像で評価して上位半分に絞ることを繰り返す
+    int top = 5; ///< 書き出す候補数
+    int iterations = 20; ///< 上位の候補の処理時間を計るときの画像1枚あたりの認識回数
+    std::string output = "tuned"; ///< 書き出すオプションファイルの接頭辞。tuned_1.xmlのように順位を付ける
+};
+
+/*!
+正解付きのサンプル画像でブロック認識の正解率が高くなるTuningを探す
+オプションの値を中心にbin_th、stud_th、size_th、ブロックの高さと幅の組み合わせを全コアで評価し、
+正解率と処理時間の順に上位の候補をオプションファイルに書き出す
+2値化の閾値によらない中間結果は画像ごとに、ブロックの領域は画像と閾値ごとに1回だけ求め、後段だけが違う候補で使い回す
+@param[in] path 正解ファイル(regressと同じ形式)
+@param[in] opt オプション。探索の中心で、Tuning以外はそのまま書き出す
+@param[in] config 探索の設定
+@return Exit code
+*/
+int runTune(std::string const & path, Option const & opt, TuneConfig const & config);
@@ -0,0 +1,90 @@
+# -*- coding: utf-8 -*-
+"""プロセス内の呼び出しとHTTPでの受け渡しの時間を比べる
+
+    python bench_blockid.py [-o block_identifier.xml] [-n 200] ../imgs/Picture\\ 8.jpg
+
+in-process : identifyを呼んで、結果をPythonのオブジェクトにするまで
+http       : 認識してJSONにし、ループバックでPOSTして受信側で解析するまで(block_identifierの送信と同じ経路)
+transfer   : httpのうち、認識の後の受け渡しにかかった時間
+"""
+import argparse
+import http.client
+import http.server
+import json
+import threading
+import time
+
+import cv2
+
+import blockid
+
+
+class _Receiver(http.server.BaseHTTPRequestHandler):
+    """描画側の代わりにPOSTを受けて解析する"""
+
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers['Content-Length']))
+        self.server.orders = json.loads(body.decode('utf-8'))['orders']
+        self.send_response(200)
+        self.send_header('Content-Length', '0')
+        self.end_headers()
+        self.server.received.set()
+
+    def log_message(self, *args):
+        pass
+
+
+def _summary(name, samples):
+    samples = sorted(samples)
+    n = len(samples)
+    print('%-12s : n=%d mean=%.1fus p50=%.1fus p99=%.1fus' % (
+        name, n, sum(samples) / n, samples[n // 2], samples[min(n - 1, int(n * 0.99))]))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('image')
+    parser.add_argument('-o', '--option', default=None)
+    parser.add_argument('-n', '--iterations', type=int, default=200)
+    args = parser.parse_args()
+
+    image = cv2.imread(args.image)
+    if image is None:
+        raise SystemExit('failed to read %s' % args.image)
+    engine = blockid.Engine(args.option)
+
+    server = http.server.HTTPServer(('127.0.0.1', 0), _Receiver)
+    server.received = threading.Event()
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    port = server.server_address[1]
+
+    in_process = []
+    http_path = []
+    transfer = []
+    for _ in range(args.iterations):
+        t0 = time.perf_counter()
+        result = engine.identify(image)
+        t1 = time.perf_counter()
+        body = engine.orders_json().encode('utf-8')
+        server.received.clear()
+        conn = http.client.HTTPConnection('127.0.0.1', port)
+        conn.request('POST', '/', body, {'Content-Type': 'application/json', 'Connection': 'close'})
+        conn.getresponse().read()
+        conn.close()
+        server.received.wait()
+        t2 = time.perf_counter()
+        assert server.orders == result.orders
+        in_process.append((t1 - t0) * 1e6)
+        http_path.append((t2 - t0) * 1e6)
+        transfer.append((t2 - t1) * 1e6)
+    server.shutdown()
+    engine.close()
+
+    print('%d blocks, %d orders' % (len(result.blocks), len(result.orders)))
+    _summary('in-process', in_process)
+    _summary('http', http_path)
+    _summary('transfer', transfer)
+
+
+if __name__ == '__main__':
+    main()
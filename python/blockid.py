@@ -0,0 +1,152 @@
+# -*- coding: utf-8 -*-
+"""libblockidのPythonバインディング
+
+描画側のプロセス内でブロックを認識する。NumPyのBGR画像はコピーせずにライブラリへ渡す。
+
+    import blockid
+    engine = blockid.Engine('block_identifier.xml')
+    result = engine.identify(frame)  # frameはカメラ画像(高さ, 幅, 3)のuint8配列
+    for order in result.orders:      # block_identifierがPOSTするordersと同じ辞書
+        print(order['id'])
+
+ライブラリは環境変数BLOCKID_LIBRARY、このファイルと同じフォルダ、OSの検索パスの順に探す。
+"""
+import collections
+import ctypes
+import json
+import os
+import sys
+
+ABI_VERSION = 1
+
+
+class _Param(ctypes.Structure):
+    _fields_ = [
+        ('name', ctypes.c_char_p),
+        ('value', ctypes.c_double),
+    ]
+
+
+class _Block(ctypes.Structure):
+    _fields_ = [
+        ('color', ctypes.c_char_p),
+        ('width', ctypes.c_int),
+        ('x', ctypes.c_int),
+        ('y', ctypes.c_int),
+        ('w', ctypes.c_int),
+        ('h', ctypes.c_int),
+        ('bgr', ctypes.c_ubyte * 3),
+        ('confidence', ctypes.c_double),
+        ('instruction', ctypes.c_char_p),
+        ('params', ctypes.POINTER(_Param)),
+        ('param_count', ctypes.c_int),
+    ]
+
+
+Block = collections.namedtuple('Block', ['color', 'width', 'rect', 'bgr', 'confidence', 'instruction', 'params'])
+"""認識したブロック。rectは縮尺と向きを変換した画像での(x, y, w, h)。命令がなければinstructionはNone"""
+
+Result = collections.namedtuple('Result', ['blocks', 'orders'])
+"""認識結果。blocksは上から順のBlock、ordersは命令が対応付けられたブロックの{'id': 命令名, パラメータ名: 値}"""
+
+
+def _library_names():
+    if sys.platform.startswith('win'):
+        return ['libblockid.dll']
+    if sys.platform == 'darwin':
+        return ['libblockid.dylib']
+    return ['libblockid.so']
+
+
+def _load():
+    path = os.environ.get('BLOCKID_LIBRARY')
+    if path:
+        return ctypes.CDLL(path)
+    here = os.path.dirname(os.path.abspath(__file__))
+    for name in _library_names():
+        candidate = os.path.join(here, name)
+        if os.path.exists(candidate):
+            return ctypes.CDLL(candidate)
+    return ctypes.CDLL(_library_names()[0])
+
+
+_lib = _load()
+_lib.blockid_abi_version.restype = ctypes.c_int
+_lib.blockid_abi_version.argtypes = []
+_lib.blockid_create.restype = ctypes.c_void_p
+_lib.blockid_create.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+_lib.blockid_destroy.restype = None
+_lib.blockid_destroy.argtypes = [ctypes.c_void_p]
+_lib.blockid_identify.restype = ctypes.c_int
+_lib.blockid_identify.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_size_t, ctypes.c_int, ctypes.POINTER(ctypes.POINTER(_Block))]
+_lib.blockid_orders_json.restype = ctypes.c_char_p
+_lib.blockid_orders_json.argtypes = [ctypes.c_void_p]
+_lib.blockid_last_error.restype = ctypes.c_char_p
+_lib.blockid_last_error.argtypes = [ctypes.c_void_p]
+
+if _lib.blockid_abi_version() != ABI_VERSION:
+    raise ImportError('libblockid ABI version %d does not match %d' % (_lib.blockid_abi_version(), ABI_VERSION))
+
+
+class Engine(object):
+    """認識エンジン。スレッドをまたいで同時に使わないこと"""
+
+    def __init__(self, option_path=None):
+        """option_pathはblock_identifierの-oと同じオプションファイル。Noneならデフォルト値"""
+        error = ctypes.create_string_buffer(1024)
+        path = option_path.encode('utf-8') if option_path else None
+        self._engine = _lib.blockid_create(path, error, len(error))
+        if not self._engine:
+            raise RuntimeError(error.value.decode('utf-8', 'replace'))
+
+    def close(self):
+        if self._engine:
+            _lib.blockid_destroy(self._engine)
+            self._engine = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def identify(self, image, preprocess=True):
+        """画像からブロックを認識する
+
+        imageは(高さ, 幅, 3)のBGR順のuint8配列。各行の中で画素が詰まっていればコピーせずに渡す
+        (行単位で切り出した配列も可)。詰まっていなければValueErrorにする。
+        preprocessがTrueならカメラ画像としてblock_identifierと同じ縮尺と向きに変換してから認識する。
+        """
+        shape = getattr(image, 'shape', None)
+        strides = getattr(image, 'strides', None)
+        if shape is None or len(shape) != 3 or shape[2] != 3 or str(image.dtype) != 'uint8':
+            raise ValueError('image should be a (height, width, 3) uint8 BGR array')
+        if strides[2] != 1 or strides[1] != 3 or strides[0] < shape[1] * 3:
+            raise ValueError('pixels of each row should be contiguous (use numpy.ascontiguousarray)')
+        blocks = ctypes.POINTER(_Block)()
+        count = _lib.blockid_identify(self._engine, image.ctypes.data, shape[1], shape[0], strides[0], 1 if preprocess else 0, ctypes.byref(blocks))
+        if count < 0:
+            raise RuntimeError(_lib.blockid_last_error(self._engine).decode('utf-8', 'replace'))
+        dst = []
+        orders = []
+        for i in range(count):
+            b = blocks[i]
+            params = collections.OrderedDict((b.params[j].name.decode('utf-8'), b.params[j].value) for j in range(b.param_count))
+            instruction = b.instruction.decode('utf-8') if b.instruction is not None else None
+            dst.append(Block(b.color.decode('utf-8'), b.width, (b.x, b.y, b.w, b.h), tuple(b.bgr), b.confidence, instruction, params))
+            if instruction is not None:
+                order = {'id': instruction}
+                order.update(params)
+                orders.append(order)
+        return Result(dst, orders)
+
+    def orders_json(self):
+        """最後のidentifyの結果を、block_identifierがPOSTするのと同じJSON文字列で返す"""
+        return _lib.blockid_orders_json(self._engine).decode('utf-8')
+
+    def orders(self):
+        """orders_jsonを解析した辞書"""
+        return json.loads(self.orders_json())